@@ -0,0 +1,349 @@
+/*
+    Benchmark of the player table of the server
+    Compares the work of one turn with thousands of players in a game:
+    - The old layout, an array of pointers to a separately allocated structure
+      for every player, which points to another allocation with its message
+    - The player table, one contiguous array per field (struct of arrays)
+    Every turn the update is copied into the message of every player still in the
+    game and the connection of the player is looked up, as the player threads do
+    With "tls" it measures instead the turn of one player on loopback TCP, plain and with kTLS:
+    the server sends an update and the client answers with a color
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+// Custom libraries
+#include "player_table.h"
+#include "fred_game.h"
+#include "ktls.h"
+
+// Turns measured for every size of game
+#define BENCH_TURNS 2000
+// Turns measured on a socket, much shorter than a turn of a big game
+#define BENCH_SOCKET_TURNS 20000
+// Other allocations made between the players in the old layout, as in a busy server
+#define BENCH_NOISE 3
+
+// Player as it was allocated before the player table
+typedef struct old_player_struct
+{
+    connection_t *connection;
+    socketCommunication_t *clientData;
+} old_player_t;
+
+///// FUNCTION DECLARATIONS
+void usage(char *program);
+double benchOld(int players, int turns, long *checksum);
+double benchTable(int players, int turns, long *checksum);
+double elapsed(struct timespec *start);
+int benchTransports(int turns);
+double benchSocket(int tls, int turns);
+void *tlsServerThread(void *arg);
+void *echoThread(void *arg);
+
+///// MAIN FUNCTION
+int main(int argc, char *argv[])
+{
+    int sizes[] = {1000, 4000, 10000, 50000};
+    int numSizes = sizeof sizes / sizeof sizes[0];
+    int transports = argc > 1 && strcmp(argv[1], "tls") == 0;
+    int turns = argc > 1 + transports ? atoi(argv[1 + transports]) : transports ? BENCH_SOCKET_TURNS : BENCH_TURNS;
+    long checkOld = 0;
+    long checkTable = 0;
+    double timeOld;
+    double timeTable;
+
+    if (argc > 2 + transports || turns < 1)
+    {
+        usage(argv[0]);
+    }
+    if (transports)
+    {
+        return benchTransports(turns);
+    }
+
+    printf("%8s  %14s  %14s  %7s\n", "players", "pointers ns", "table ns", "speedup");
+    for (int i = 0; i < numSizes; i++)
+    {
+        timeOld = benchOld(sizes[i], turns, &checkOld);
+        timeTable = benchTable(sizes[i], turns, &checkTable);
+        printf("%8d  %14.0f  %14.0f  %6.2fx\n", sizes[i], timeOld / turns * 1e9, timeTable / turns * 1e9, timeOld / timeTable);
+    }
+
+    //Both layouts must have done the same work
+    if (checkOld != checkTable)
+    {
+        printf("Checksums differ: %ld %ld\n", checkOld, checkTable);
+        return 1;
+    }
+
+    return 0;
+}
+
+///// FUNCTION DEFINITIONS
+
+/*
+    Explanation to the user of the parameters required to run the program
+*/
+void usage(char *program)
+{
+    printf("Usage:\n");
+    printf("\t%s [turns]\n", program);
+    printf("\tShows the time per turn of a game with the old player layout and with the player table\n");
+    printf("\t%s tls [turns]\n", program);
+    printf("\tShows the time per turn of one player on loopback TCP, plain and encrypted by the kernel (kTLS)\n");
+    printf("\tNeeds a build with \"make TLS=1\", and the certificate in %s, %s and %s\n", TLS_CERT_VARIABLE, TLS_KEY_VARIABLE, TLS_CA_VARIABLE);
+    exit(EXIT_FAILURE);
+}
+
+/*
+    Seconds since 'start'
+*/
+double elapsed(struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+    Turns with the old layout, the players out are skipped with the states of the rules
+    Returns the seconds taken
+*/
+double benchOld(int players, int turns, long *checksum)
+{
+    old_player_t **playerArray = malloc(players * sizeof(old_player_t *));
+    void **noise = malloc(players * BENCH_NOISE * sizeof(void *));
+    int *playerStates = malloc(players * sizeof(int));
+    fred_update_t update;
+    struct timespec start;
+    double seconds;
+
+    //Allocated one by one, the way the players connected
+    for (int i = 0; i < players; i++)
+    {
+        playerArray[i] = malloc(sizeof(old_player_t));
+        for (int j = 0; j < BENCH_NOISE; j++)
+        {
+            noise[i * BENCH_NOISE + j] = malloc(32 + (i + j) % 96);
+        }
+        playerArray[i]->connection = malloc(sizeof(connection_t));
+        playerArray[i]->connection->fd = i;
+        playerArray[i]->clientData = malloc(sizeof(socketCommunication_t));
+        playerStates[i] = i % 7 != 0 ? PWAIT : LOSER;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int turn = 0; turn < turns; turn++)
+    {
+        update.color = turn % 7 + 1;
+        update.wrongColor = turn % 2;
+        update.newColor = 0;
+        update.newRound = 1;
+
+        for (int i = 0; i < players; i++)
+        {
+            if (playerStates[i] != LOSER)
+            {
+                playerArray[i]->clientData->color = update.color;
+                playerArray[i]->clientData->wrongColor = update.wrongColor;
+                playerArray[i]->clientData->newColor = update.newColor;
+                playerArray[i]->clientData->newRound = update.newRound;
+                *checksum += playerArray[i]->connection->fd + playerArray[i]->clientData->color;
+            }
+        }
+    }
+    seconds = elapsed(&start);
+
+    for (int i = 0; i < players; i++)
+    {
+        free(playerArray[i]->connection);
+        free(playerArray[i]->clientData);
+        free(playerArray[i]);
+        for (int j = 0; j < BENCH_NOISE; j++)
+        {
+            free(noise[i * BENCH_NOISE + j]);
+        }
+    }
+    free(playerArray);
+    free(noise);
+    free(playerStates);
+
+    return seconds;
+}
+
+/*
+    Turns with the player table, the players out are skipped with the states of the rules
+    Returns the seconds taken
+*/
+double benchTable(int players, int turns, long *checksum)
+{
+    player_table_t table;
+    int *playerStates = malloc(players * sizeof(int));
+    fred_update_t update;
+    struct timespec start;
+    double seconds;
+
+    initPlayerTable(&table);
+    growPlayerTable(&table, players);
+    for (int i = 0; i < players; i++)
+    {
+        table.connections[i].fd = i;
+        playerStates[i] = i % 7 != 0 ? PWAIT : LOSER;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int turn = 0; turn < turns; turn++)
+    {
+        update.color = turn % 7 + 1;
+        update.wrongColor = turn % 2;
+        update.newColor = 0;
+        update.newRound = 1;
+
+        for (int i = 0; i < players; i++)
+        {
+            if (playerStates[i] != LOSER)
+            {
+                table.clientData[i].color = update.color;
+                table.clientData[i].wrongColor = update.wrongColor;
+                table.clientData[i].newColor = update.newColor;
+                table.clientData[i].newRound = update.newRound;
+                *checksum += table.connections[i].fd + table.clientData[i].color;
+            }
+        }
+    }
+    seconds = elapsed(&start);
+
+    freePlayerTable(&table);
+    free(playerStates);
+
+    return seconds;
+}
+
+/*
+    Turns of one player on loopback TCP, without and with kTLS
+    Returns the exit status of the program
+*/
+int benchTransports(int turns)
+{
+    double plain = benchSocket(0, turns);
+    double encrypted = benchSocket(1, turns);
+
+    if (encrypted < 0)
+    {
+        return 1;
+    }
+
+    printf("%8s  %14s  %14s  %8s\n", "turns", "plain ns", "kTLS ns", "overhead");
+    printf("%8d  %14.0f  %14.0f  %7.1f%%\n", turns, plain / turns * 1e9, encrypted / turns * 1e9, (encrypted / plain - 1) * 100);
+
+    return 0;
+}
+
+/*
+    Connect a client to a server on loopback, and time the turns: an update from the server
+    and a color back, through the same calls as the game
+    Returns the seconds taken, or -1 if the kTLS handshake failed
+*/
+double benchSocket(int tls, int turns)
+{
+    struct sockaddr_in address;
+    socklen_t length = sizeof address;
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int client_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int server_fd;
+    int handshake = 1;
+    pthread_t tid;
+    connection_t server;
+    connection_t client;
+    socketCommunication_t message;
+    struct timespec start;
+    double seconds;
+
+    //Any free port of loopback
+    memset(&address, 0, sizeof address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listen_fd, (struct sockaddr *)&address, sizeof address) == -1 || listen(listen_fd, 1) == -1
+        || getsockname(listen_fd, (struct sockaddr *)&address, &length) == -1
+        || connect(client_fd, (struct sockaddr *)&address, sizeof address) == -1)
+    {
+        fatalError("ERROR: loopback");
+    }
+    server_fd = accept(listen_fd, NULL, NULL);
+    close(listen_fd);
+
+    //Both sides of the handshake at the same time
+    if (tls)
+    {
+        pthread_create(&tid, NULL, tlsServerThread, &server_fd);
+        handshake = tlsConnect(client_fd, "127.0.0.1");
+        pthread_join(tid, NULL);
+        if (!handshake || server_fd == -1)
+        {
+            close(client_fd);
+            return -1;
+        }
+    }
+    openConnection(&server, server_fd, TRANSPORT_SOCKET);
+    openConnection(&client, client_fd, TRANSPORT_SOCKET);
+
+    memset(&message, 0, sizeof message);
+    pthread_create(&tid, NULL, echoThread, &client);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int turn = 0; turn < turns; turn++)
+    {
+        message.color = turn % 7 + 1;
+        sendMessage(&server, &message, sizeof message);
+        recvMessage(&server, &message, sizeof message);
+    }
+    seconds = elapsed(&start);
+
+    //The client stops when the server closes
+    shutdown(server_fd, SHUT_WR);
+    pthread_join(tid, NULL);
+    close(server_fd);
+    close(client_fd);
+
+    return seconds;
+}
+
+/*
+    Server side of the handshake, the socket is set to -1 if it failed
+*/
+void *tlsServerThread(void *arg)
+{
+    int *fd = arg;
+
+    if (!tlsAccept(*fd))
+    {
+        close(*fd);
+        *fd = -1;
+    }
+
+    return NULL;
+}
+
+/*
+    Client of the benchmark, answers every update with its color
+*/
+void *echoThread(void *arg)
+{
+    connection_t *client = arg;
+    socketCommunication_t message;
+
+    while (recvMessage(client, &message, sizeof message))
+    {
+        sendMessage(client, &message, sizeof message);
+    }
+
+    return NULL;
+}
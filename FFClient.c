@@ -11,21 +11,34 @@
 #include <unistd.h>
 #include <poll.h>
 #include <errno.h>
+#include <time.h>
 // Sockets libraries
 #include <netdb.h>
 #include <arpa/inet.h>
 // Custom libraries
 #include "sockets.h"
+#include "connection.h"
+#include "delta_update.h"
 #include "fatal_error.h"
+#include "solo.h"
+#include "render.h"
 //Ncurses library
 #include <ncurses.h>
 //Thread library
 #include <pthread.h>
 //game/player state enums
 #include "Game_Codes.h"
+//Tracepoints
+#include "fred_probes.h"
 
 #define BUFFER_SIZE 1024
 #define COLORNUM 7
+//Keys that can be typed ahead of the turn
+#define TYPEAHEAD_SIZE 64
+//Milliseconds between checks for an update while reading keys
+#define INPUT_POLL_MS 20
+//Environment variable with the ID of the player for the stats
+#define PLAYER_ID_VARIABLE "FRED_PLAYER_ID"
 
 //Mutex for the thread synchronization variable
 pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -37,8 +50,10 @@ typedef struct thread_data_struct
 {
     char *address;
     char *port;
-    //The id of the player connected
-    int connection_fd;
+    //Set when playing alone against the engine of solo.h, without a server
+    int solo;
+    //The connection to the server, socket or shared memory
+    connection_t *connection;
     int gameState;
     int playerState;
     char buffer[BUFFER_SIZE];
@@ -47,37 +62,48 @@ typedef struct thread_data_struct
     int wrongColor;
     int newColor;
     int newRound;
+    //ID of the player for the stats
+    int playerID;
+    //Last state received from the server, the colors picked are sent back in it
+    socketCommunication_t state;
+    //Updates received so far
+    int updates;
+    //Colors typed ahead, in a ring, sent as soon as the turn of the player allows them
+    int typeAhead[TYPEAHEAD_SIZE];
+    int typedFirst;
+    int typedCount;
+    //Colors of the sequence, colors of the current turn (the sequence and a new one)
+    //and colors already sent in it
+    int sequenceSize;
+    int turnLength;
+    int turnSent;
 } thread_data_t;
 
-//Client structure - what the visualizing thread needs to know from the server
-typedef struct socket_Communication
-{
-    int playersExpected;
-    int playerState;
-    int gameState;
-    int color;
-    int wrongColor;
-    int newColor;
-    int newRound;
-} socketCommunication_t;
-
 
 ///// FUNCTION DECLARATIONS
 void usage(char *program);
 void quit();
 void initBoard(int colorNum);
 int positionColor(int color);
+void showMark(int color, const char *mark);
 void youLose();
 int startGame(thread_data_t *sharedData);
 void *communicationThread(void *arg);
 void drawBoard(thread_data_t *sharedData);
 void playingLoop(thread_data_t *sharedData);
+int waitNextMatch(thread_data_t *sharedData);
+void copyUpdate(thread_data_t *sharedData, socketCommunication_t *communication);
+void readKeys(thread_data_t *sharedData, int milliseconds);
+void waitUpdate(thread_data_t *sharedData, int seen);
+void sendTyped(thread_data_t *sharedData);
+void showTyped(thread_data_t *sharedData);
 
 ///// MAIN FUNCTION
 int main(int argc, char *argv[])
 {
     // Check the correct arguments
-    if (argc != 3)
+    // Unix endpoints do not need a port number
+    if (argc != 3 && !(argc == 2 && (isUnixEndpoint(argv[1]) || isShmEndpoint(argv[1]) || strcmp(argv[1], SOLO_ENDPOINT) == 0)))
     {
         usage(argv[0]);
     }
@@ -86,7 +112,8 @@ int main(int argc, char *argv[])
     thread_data_t *sharedData = NULL;
     sharedData = malloc(sizeof(thread_data_t));
     sharedData->address = argv[1];
-    sharedData->port = argv[2];
+    sharedData->port = argc == 3 ? argv[2] : NULL;
+    sharedData->solo = argc == 2 && strcmp(argv[1], SOLO_ENDPOINT) == 0;
     sharedData->gameState = GWAIT;
     sharedData->playerState = PWAIT;
     sharedData->color = 0;
@@ -95,6 +122,14 @@ int main(int argc, char *argv[])
     sharedData->playersExpected = 0;
     sharedData->newRound = 1;
     bzero(sharedData->buffer, BUFFER_SIZE);
+    bzero(&sharedData->state, sizeof(socketCommunication_t));
+    sharedData->playerID = 0;
+    sharedData->updates = 0;
+    sharedData->typedFirst = 0;
+    sharedData->typedCount = 0;
+    sharedData->sequenceSize = 0;
+    sharedData->turnLength = 0;
+    sharedData->turnSent = 0;
 
     //Starts a thread for server communication
     startGame(sharedData);
@@ -118,6 +153,10 @@ void usage(char *program)
 {
     printf("Usage:\n");
     printf("\t%s {server_address} {port_number}\n", program);
+    printf("\t%s tls:{server_address} {port_number}\n", program);
+    printf("\t%s {unix:/path | unix:@name | shm:/path | shm:@name}\n", program);
+    printf("\t%s %s (practice alone, without a server)\n", program, SOLO_ENDPOINT);
+    printf("\tThe ID of the player for the stats is taken from %s, or the user ID\n", PLAYER_ID_VARIABLE);
     exit(EXIT_FAILURE);
 }
 
@@ -138,19 +177,17 @@ void initBoard(int colorNum)
     {
         //Color pairs (background, foreground) have to be initialized
         init_pair(i, 0, i);
-        color_set(i, 0);
 
         //Calculate the x position of the color square
         int x = positionColor(i);
         //The color square
-        char colorBox[3];
+        char colorBox[16];
         sprintf(colorBox, "%c %d %c", 32, i, 32);
-        mvaddstr(10, x, colorBox);
+        drawStatic(10, x, i, colorBox);
     }
 
     //Reset window color to white on black
     init_pair(0, 7, 0);
-    color_set(0, 0);
 }
 
 /*
@@ -168,6 +205,14 @@ int positionColor(int color)
     return x;
 }
 
+/*
+    Show a mark under a color, alone on its row
+*/
+void showMark(int color, const char *mark)
+{
+    setRegion(REGION_MARK, positionColor(color), color, mark);
+}
+
 /*
     Initialize ncurses window as the user playing interface. 
     Get user input and show game updates.
@@ -183,24 +228,30 @@ void drawBoard(thread_data_t *sharedData)
     clear();
     curs_set(0);
     keypad(stdscr, TRUE);
+    //The board is drawn in a window of its own, a frame at a time
+    initRender();
 
     //Title
-    mvaddstr(5, 5, "FABULOUS FRED");
+    drawStatic(5, 5, 0, "FABULOUS FRED");
 
     //Color buttons
     initBoard(COLORNUM);
 
-    strcpy(sharedData->buffer, "Waiting for players to connect...");
-    mvaddstr(17, 5, sharedData->buffer);
-    refresh();
+    setRegion(REGION_MESSAGE, 5, 0, "Waiting for players to connect...");
     
     //Wait for the game to begin
     while (sharedData->gameState == GWAIT)
     {
+        flushFrame();
+
+        //The first update may have come already, a solo game begins at once
         if(sharedData->playerState == PWAIT)
         {
             pthread_mutex_lock(&mutex);
-            pthread_cond_wait(&cond, &mutex);
+            while (sharedData->gameState == GWAIT && sharedData->playerState == PWAIT)
+            {
+                pthread_cond_wait(&cond, &mutex);
+            }
             pthread_mutex_unlock(&mutex);
         }
 
@@ -208,22 +259,12 @@ void drawBoard(thread_data_t *sharedData)
         if(sharedData->playerState == FIRST)
         {
             pthread_mutex_lock(&mutex);
-            strcpy(sharedData->buffer, "Setup the game! Number of players: ");
-            curs_set(1);
-            mvaddstr(17, 5, sharedData->buffer);
-            scanw("%d", &sharedData->playersExpected);
-            
-            //Delete last line
-            move(17, 5);
-            deleteln();
-            insertln();
-            refresh();
+            sharedData->playersExpected = promptNumber(REGION_MESSAGE, 5, "Setup the game! Number of players: ");
 
             bzero(sharedData->buffer, BUFFER_SIZE);
             sprintf(sharedData->buffer, "Waiting for %d players to connect.", sharedData->playersExpected);
-            curs_set(0);
-            mvaddstr(17,5, sharedData->buffer);
-            refresh();
+            setRegion(REGION_MESSAGE, 5, 0, sharedData->buffer);
+            flushFrame();
             pthread_cond_signal(&cond);
             pthread_mutex_unlock(&mutex);
 
@@ -231,162 +272,150 @@ void drawBoard(thread_data_t *sharedData)
             bzero(sharedData->buffer, BUFFER_SIZE);
             pthread_mutex_lock(&mutex);
             pthread_cond_wait(&cond, &mutex);
-            refresh();
             pthread_mutex_unlock(&mutex);
             
-            move(17, 5);
-            deleteln();
-            insertln();
-            refresh();
+            clearRegion(REGION_MESSAGE);
         }
     }
 
+    //Set when the update shown is the result of a color picked here, already on the screen
+    int picked;
+    //Updates already shown
+    int seen;
+
+    //From now on the colors are single keys, read while waiting for the server
+    noecho();
+
     //Playing loop
     while (sharedData->gameState == GACTIVE)
     {   
+        picked = 0;
+        pthread_mutex_lock(&mutex);
+        seen = sharedData->updates;
+        pthread_mutex_unlock(&mutex);
+
         //Messages for the waiting players
         if (sharedData->playerState == PWAIT)
         {
-            move(17, 5);
-            deleteln();
-            insertln();
-            refresh();
-            bzero(sharedData->buffer, BUFFER_SIZE);
-            strcpy(sharedData->buffer, "Wait and remember!");
-            mvaddstr(17, 5, sharedData->buffer);
-            refresh();
+            setRegion(REGION_MESSAGE, 5, 0, "Wait and remember!");
 
             //Indicate the player that the following color is a new one
             if (sharedData->newColor == 1)
             {
-                move(17, 5);
-                deleteln();
-                insertln();
-                refresh();
-                bzero(sharedData->buffer, BUFFER_SIZE);
-                strcpy(sharedData->buffer, "New Color!");
-                mvaddstr(14, 5, sharedData->buffer);
-                refresh();
-                sleep(1);
-                deleteln();
-                insertln();
-                refresh();
+                clearRegion(REGION_MESSAGE);
+                setRegion(REGION_NOTICE, 5, 0, "New Color!");
+                readKeys(sharedData, 1000);
+                clearRegion(REGION_NOTICE);
             }
 
             //Indicate the player that the sequence begins from the start again
             if (sharedData->newRound == 1)
             {
-                bzero(sharedData->buffer, BUFFER_SIZE);
-                strcpy(sharedData->buffer, "New Round!"); 
-                mvaddstr(14, 5, sharedData->buffer);
-                refresh();
-                sleep(1);
-                deleteln();
-                insertln();
-                refresh();
+                setRegion(REGION_NOTICE, 5, 0, "New Round!");
+                readKeys(sharedData, 1000);
+                clearRegion(REGION_NOTICE);
             }
         }
 
         //Interaction with the active player
         if (sharedData->playerState == PACTIVE)
         {
-            curs_set(1);
-            bzero(sharedData->buffer, BUFFER_SIZE);
-            move(17, 5);
-            deleteln();
-            insertln();
-            refresh();
+            //Indicate to remember a color from the sequence, or to add a new color
+            //The keys 1 to 7 are sent as they are typed, and can be typed ahead
+            setRegion(REGION_MESSAGE, 5, 0, sharedData->newColor == 0 ? "Your Turn! Pick a color (1-7)" : "Add a new color (1-7)");
+            picked = 1;
+        }
+
+        //All clients wait for game update from server, the keys typed meanwhile are queued
+        waitUpdate(sharedData, seen);
 
-            //Indicate to remember a color from the sequence
-            if (sharedData->newColor == 0)
+        //The active player saw its color when it picked it, a right one is only confirmed
+        if (picked && sharedData->wrongColor == 0)
+        {
+            showMark(sharedData->color, "  :) ");
+        }
+        //Show selected color to all players, and roll back a wrong pick
+        else
+        {
+            //Indicate if color was remembered wrong or right
+            if(sharedData->wrongColor == 0)
             {
-                strcpy(sharedData->buffer, "Your Turn! Pick a color: ");
-                mvaddstr(17, 5, sharedData->buffer);
-                pthread_mutex_lock(&mutex);
-                scanw("%d", &sharedData->color);
-                pthread_cond_signal(&cond);
-                pthread_mutex_unlock(&mutex);
-                
-                move(17, 5);
-                deleteln();
-                refresh();
+                showMark(sharedData->color, "  :) ");
             }
-            //Indicate to add a new color
-            if (sharedData->newColor == 1)
+            else if(sharedData->wrongColor == 1)
             {
-                strcpy(sharedData->buffer, "Add a new color: ");
-                mvaddstr(17, 5, sharedData->buffer);
-                pthread_mutex_lock(&mutex);
-                scanw("%d", &sharedData->color);
-                pthread_cond_signal(&cond);
-                pthread_mutex_unlock(&mutex);
-                move(17, 5);
-                deleteln();
-                insertln();
-                refresh();
+                showMark(sharedData->color, "  X  ");
             }
+
+            readKeys(sharedData, 1000);
+            clearRegion(REGION_MARK);
         }
 
-        curs_set(0);
         bzero(sharedData->buffer, BUFFER_SIZE);
-
-        //All clients wait for game update from server
-        pthread_mutex_lock(&mutex);
-        pthread_cond_wait(&cond, &mutex);
-        pthread_mutex_unlock(&mutex);
-
-        //Show selected color to all players
-        int x = positionColor(sharedData->color);
-        color_set(sharedData->color, 0);
-
-        //Indicate if color was remembered wrong or right
-        if(sharedData->wrongColor == 0)
-        {
-            mvaddstr(12, x, "  :) ");
-        }
-        else if(sharedData->wrongColor == 1)
+ 
+        //In a tournament the next match follows, or the final result
+        if ((sharedData->playerState == LOSER || sharedData->playerState == WINNER) && sharedData->gameState == GWAIT)
         {
-            mvaddstr(12, x, "  X  ");
+            if (waitNextMatch(sharedData))
+            {
+                continue;
+            }
         }
 
-        refresh();
-        sleep(1);
-        deleteln();
-        insertln();
-        refresh();
-
-        //Reset colors for messages
-        color_set(0, 0);
-
-        bzero(sharedData->buffer, BUFFER_SIZE);
- 
         //Check and print player's status
         if (sharedData->playerState == LOSER)
         {
 
-            strcpy(sharedData->buffer, "You Lose!");
-            mvaddstr(17, 5, sharedData->buffer);
-            refresh();
+            //Alone there is nobody to lose against, the score is the sequence repeated
+            if (sharedData->solo)
+            {
+                sprintf(sharedData->buffer, "Game over! You remembered %d colors", sharedData->sequenceSize - 1);
+            }
+            else
+            {
+                strcpy(sharedData->buffer, "You Lose!");
+            }
+            setRegion(REGION_MESSAGE, 5, 0, sharedData->buffer);
+            flushFrame();
             curs_set(1);
+            timeout(-1);
             getch();
             pthread_exit(NULL);
         }
 
         if (sharedData->playerState == WINNER)
         {
-            move(17, 5);
-            deleteln();
-            insertln();
-            refresh();
-            strcpy(sharedData->buffer, "You Win!");
-            mvaddstr(17, 5, sharedData->buffer);
-            refresh();
+            setRegion(REGION_MESSAGE, 5, 0, "You Win!");
+            flushFrame();
             curs_set(1);
+            timeout(-1);
             getch();
         }
     }
 }
 
+/*
+    Wait for the next match of a tournament, after a match was won or lost
+    Returns 1 when the next match begins, or 0 when the tournament ended
+*/
+int waitNextMatch(thread_data_t *sharedData)
+{
+    setRegion(REGION_MESSAGE, 5, 0, sharedData->playerState == WINNER ? "Match won! Waiting for the next round..." : "Match lost! Waiting for the next round...");
+    flushFrame();
+
+    pthread_mutex_lock(&mutex);
+    while (sharedData->gameState == GWAIT)
+    {
+        pthread_cond_wait(&cond, &mutex);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    clearRegion(REGION_MESSAGE);
+
+    //The final result is shown like the end of a single game
+    return sharedData->gameState == GACTIVE;
+}
+
 /*
     Create thread for communication with server
 */
@@ -411,19 +440,30 @@ void *communicationThread(void *arg)
     thread_data_t *sharedData = (thread_data_t *)arg;
 
     socketCommunication_t communication;
+    //Last state received from the server, the updates only carry the changes to it
+    socketCommunication_t received;
 
-    //Connect to the server
-    sharedData->connection_fd = connectSocket(sharedData->address, sharedData->port);
+    //Connect to the server, or to the engine in this process for a solo game
+    sharedData->connection = sharedData->solo ? startSolo() : connectServer(sharedData->address, sharedData->port);
+
+    //The stats of the player are kept under its ID, the user ID unless another one is given
+    int playerID = getenv(PLAYER_ID_VARIABLE) != NULL ? atoi(getenv(PLAYER_ID_VARIABLE)) : (int)getuid();
+    sharedData->playerID = playerID;
+    sendMessage(sharedData->connection, &playerID, sizeof(int));
 
     //Get first update about game status and player status
-    recv(sharedData->connection_fd, &communication, sizeof(socketCommunication_t), 0);
+    bzero(&received, sizeof received);
+    recvUpdate(sharedData->connection, &received);
+    //The server turns players away when it gets more connections than it can take
+    if (received.playerState == EXIT)
+    {
+        endwin();
+        printf("The server is full, try again later\n");
+        exit(EXIT_FAILURE);
+    }
+    communication = received;
     pthread_mutex_lock(&mutex);
-    sharedData->gameState = communication.gameState;
-    sharedData->playerState = communication.playerState;
-    sharedData->color = communication.color;
-    sharedData->newColor = communication.newColor;
-    sharedData->wrongColor = communication.wrongColor;
-    sharedData->newRound = communication.newRound;
+    copyUpdate(sharedData, &communication);
     
     pthread_cond_signal(&cond);
     pthread_mutex_unlock(&mutex);
@@ -437,17 +477,13 @@ void *communicationThread(void *arg)
         communication.playersExpected = sharedData->playersExpected;
         pthread_mutex_unlock(&mutex);
         //Send amount of players
-        send(sharedData->connection_fd, &communication, sizeof(socketCommunication_t), 0);
+        sendMessage(sharedData->connection, &communication, sizeof(socketCommunication_t));
 
         //receive following message, which changes the game state flag and the player state
         pthread_mutex_lock(&mutex);
-        recv(sharedData->connection_fd, &communication, sizeof(socketCommunication_t), 0);
-        sharedData->gameState = communication.gameState;
-        sharedData->playerState = communication.playerState;
-        sharedData->color = communication.color;
-        sharedData->newColor = communication.newColor;
-        sharedData->wrongColor = communication.wrongColor;
-        sharedData->newRound = communication.newRound;
+        recvUpdate(sharedData->connection, &received);
+        communication = received;
+        copyUpdate(sharedData, &communication);
 
         pthread_cond_signal(&cond);
         pthread_mutex_unlock(&mutex);
@@ -456,48 +492,190 @@ void *communicationThread(void *arg)
     //Actual playing loop
     while (sharedData->gameState == GACTIVE)
     {
-        //Playing loop for active player
-        if (communication.playerState == PACTIVE)
-        {
-            //Wait for visualizing thread to get user input
-            pthread_mutex_lock(&mutex);
-            pthread_cond_wait(&cond, &mutex);
-            communication.color = sharedData->color;
-            pthread_mutex_unlock(&mutex);
-
-            send(sharedData->connection_fd, &communication, sizeof(socketCommunication_t), 0);
-        }
-
+        //The colors of the active player are sent by the visualizing thread as they are typed
         //Receives the Update
-        recv(sharedData->connection_fd, &communication, sizeof(socketCommunication_t), 0);
+        recvUpdate(sharedData->connection, &received);
+        communication = received;
+        FRED_PROBE4(recv_update, playerID, communication.color, communication.wrongColor, communication.playerState);
         
         pthread_mutex_lock(&mutex);
-        sharedData->gameState = communication.gameState;
-        sharedData->playerState = communication.playerState;
-        sharedData->color = communication.color;
-        sharedData->newColor = communication.newColor;
-        sharedData->wrongColor = communication.wrongColor;
-        sharedData->newRound = communication.newRound;
+        copyUpdate(sharedData, &communication);
         //Signal the visualizing thread, that the game info was updated
         pthread_cond_signal(&cond);
         pthread_mutex_unlock(&mutex);
 
-        //Quit thread if player lost
-        if (communication.playerState == LOSER)
+        //Quit thread if player lost or won, unless a tournament goes on
+        if ((communication.playerState == LOSER || communication.playerState == WINNER) && communication.gameState != GWAIT)
         {
             pthread_exit(NULL);
         }
 
-        //Quit thread if player won
-        if (communication.playerState == WINNER)
+        //The next match of the tournament begins, or the final result comes, with the next message
+        if (communication.playerState == LOSER || communication.playerState == WINNER)
         {
-            pthread_exit(NULL);
+            recvUpdate(sharedData->connection, &received);
+            communication = received;
+
+            pthread_mutex_lock(&mutex);
+            //A new match starts with a new sequence
+            sharedData->sequenceSize = 0;
+            copyUpdate(sharedData, &communication);
+            pthread_cond_broadcast(&cond);
+            pthread_mutex_unlock(&mutex);
         }
     }
 
     // Close the socket
-    close(sharedData->connection_fd);
+    closeConnection(sharedData->connection);
 
     pthread_exit(EXIT_SUCCESS);
 }
 
+/*
+    Copy a message from the server to the data of the visualizing thread
+*/
+void copyUpdate(thread_data_t *sharedData, socketCommunication_t *communication)
+{
+    //A new color was added to the sequence
+    if (communication->wrongColor == 0 && communication->newRound == 1)
+    {
+        sharedData->sequenceSize++;
+    }
+    //The turn of this player begins: the whole sequence again, then a new color
+    //Alone, the new colors come from the engine
+    if (communication->playerState == PACTIVE && sharedData->playerState != PACTIVE)
+    {
+        sharedData->turnLength = sharedData->sequenceSize + (sharedData->solo ? 0 : 1);
+        sharedData->turnSent = 0;
+    }
+
+    sharedData->state = *communication;
+    sharedData->updates++;
+    sharedData->gameState = communication->gameState;
+    sharedData->playerState = communication->playerState;
+    sharedData->color = communication->color;
+    sharedData->newColor = communication->newColor;
+    sharedData->wrongColor = communication->wrongColor;
+    sharedData->newRound = communication->newRound;
+}
+
+/*
+    Read the keys typed for up to 'milliseconds', and send the colors the turn allows
+    The keys 1 to 7 are queued, Backspace takes back the last one still queued
+*/
+void readKeys(thread_data_t *sharedData, int milliseconds)
+{
+    struct timespec start;
+    struct timespec now;
+    int left = milliseconds;
+    int frame;
+    int key;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    do
+    {
+        //The turn may have begun with the colors already queued
+        sendTyped(sharedData);
+
+        //A frame held back by the rate cap goes as soon as it may, the keys are read meanwhile
+        frame = renderFrame();
+        timeout(frame != -1 && frame < left ? frame : left);
+        key = getch();
+        if (key >= '1' && key < '1' + COLORNUM)
+        {
+            pthread_mutex_lock(&mutex);
+            if (sharedData->typedCount < TYPEAHEAD_SIZE)
+            {
+                sharedData->typeAhead[(sharedData->typedFirst + sharedData->typedCount) % TYPEAHEAD_SIZE] = key - '0';
+                sharedData->typedCount++;
+            }
+            pthread_mutex_unlock(&mutex);
+            showTyped(sharedData);
+            sendTyped(sharedData);
+        }
+        else if (key == KEY_BACKSPACE || key == 127 || key == '\b')
+        {
+            pthread_mutex_lock(&mutex);
+            if (sharedData->typedCount > 0)
+            {
+                sharedData->typedCount--;
+            }
+            pthread_mutex_unlock(&mutex);
+            showTyped(sharedData);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        left = milliseconds - ((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+    } while (left > 0);
+}
+
+/*
+    Read keys until an update comes after the 'seen' first ones
+*/
+void waitUpdate(thread_data_t *sharedData, int seen)
+{
+    int updates;
+
+    do
+    {
+        readKeys(sharedData, INPUT_POLL_MS);
+        pthread_mutex_lock(&mutex);
+        updates = sharedData->updates;
+        pthread_mutex_unlock(&mutex);
+    } while (updates == seen && sharedData->gameState == GACTIVE);
+}
+
+/*
+    Send the colors typed ahead that the turn of the player allows, one message each,
+    without waiting for the update of the one before
+    A turn has the whole sequence and a new color, sending more would be read in a later turn
+*/
+void sendTyped(thread_data_t *sharedData)
+{
+    socketCommunication_t message;
+    int last = 0;
+    int final = 0;
+
+    pthread_mutex_lock(&mutex);
+    while (sharedData->typedCount > 0 && sharedData->playerState == PACTIVE && sharedData->turnSent < sharedData->turnLength)
+    {
+        message = sharedData->state;
+        message.color = sharedData->typeAhead[sharedData->typedFirst];
+        sharedData->typedFirst = (sharedData->typedFirst + 1) % TYPEAHEAD_SIZE;
+        sharedData->typedCount--;
+        sendMessage(sharedData->connection, &message, sizeof(socketCommunication_t));
+        FRED_PROBE2(send_color, sharedData->playerID, message.color);
+
+        sharedData->turnSent++;
+        last = message.color;
+        //The new color that ends the turn can't be wrong
+        final = !sharedData->solo && sharedData->turnSent == sharedData->turnLength;
+    }
+    pthread_mutex_unlock(&mutex);
+
+    //Shown at once as pending, until the server says if it was right
+    if (last != 0)
+    {
+        showMark(last, final ? "  :) " : "  ?  ");
+        showTyped(sharedData);
+    }
+}
+
+/*
+    Show the colors still typed ahead
+*/
+void showTyped(thread_data_t *sharedData)
+{
+    char line[2 * TYPEAHEAD_SIZE + 16];
+    int length;
+
+    pthread_mutex_lock(&mutex);
+    length = sprintf(line, "%s", sharedData->typedCount > 0 ? "Typed ahead:" : "");
+    for (int i = 0; i < sharedData->typedCount; i++)
+    {
+        length += sprintf(line + length, " %d", sharedData->typeAhead[(sharedData->typedFirst + i) % TYPEAHEAD_SIZE]);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    setRegion(REGION_TYPED, 5, 0, line);
+}
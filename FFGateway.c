@@ -0,0 +1,604 @@
+/*
+    WebSocket gateway for Fabulous Fred
+    Lets browsers play: answers their HTTP upgrade, and connects every browser to the server
+    as if it were an FFClient, translating the messages both ways
+    - A single thread with an event loop (epoll) serves every browser, there is no thread
+      or blocking call for a connection, so thousands of browsers cost only their buffers
+    - The browser connects to ws://host:port/?id=N, N being its player ID (0 if not given)
+    - Every update of the server goes to the browser as a text message with the whole state:
+        {"playersExpected":3,"playerState":2,"gameState":1,"color":4,"wrongColor":0,"newColor":1,"newRound":0}
+    - The browser sends a text message with a number: the number of players when its
+      playerState is FIRST (0), or a color (1 to 7) otherwise
+    - When the server closes the connection at the end of the game, the browser gets a close frame
+    - The connection to the server is made in the event loop too: a browser whose connection
+      is refused (the server is down or restarting) gets a close frame with the code 1013
+      (try again later), and the other browsers go on
+*/
+
+// Needed for accept4
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+// Custom libraries
+#include "connection.h"
+#include "delta_update.h"
+#include "websocket.h"
+#include "fatal_error.h"
+#include "Game_Codes.h"
+
+// Most browsers connected at the same time
+#define MAX_BROWSERS 16384
+#define MAX_QUEUE 1024
+// Events taken from epoll in one call
+#define MAX_EVENTS 256
+// Largest HTTP upgrade request, and the room for the frames of a browser not processed yet
+#define BROWSER_BUFFER 4096
+// Messages waiting for a slow browser or server, the browser is dropped if they don't fit
+#define OUTPUT_BUFFER 4096
+// Longest text message sent to a browser
+#define STATE_TEXT 192
+// Close codes: the game is over, or the server can't be reached now
+#define CLOSE_NORMAL 1000
+#define CLOSE_TRY_LATER 1013
+
+// One of the two sockets of a browser, for the events of epoll
+typedef struct side_struct
+{
+    struct browser_struct *browser;
+    int isServer;
+} side_t;
+
+// Browser connected to the gateway, and its connection to the server
+typedef struct browser_struct
+{
+    int browser_fd;
+    int server_fd;
+    side_t sides[2];
+    //The upgrade was answered, what arrives now are frames
+    int open;
+    //The connection to the server is still being made, what the browser sends waits meanwhile
+    int connecting;
+    //Close both sockets as soon as the browser has got everything queued for it
+    int closing;
+    //Closed in this batch of events, freed after it
+    int closed;
+    struct browser_struct *next;
+    //Last state received from the server, the updates only carry the changes
+    socketCommunication_t state;
+    unsigned char browserIn[BROWSER_BUFFER];
+    size_t browserInSize;
+    unsigned char browserOut[OUTPUT_BUFFER];
+    size_t browserOutSize;
+    char serverIn[sizeof(int32_t) * (DELTA_FIELDS + 1)];
+    size_t serverInSize;
+    char serverOut[OUTPUT_BUFFER];
+    size_t serverOutSize;
+} browser_t;
+
+// Everything the event loop works with
+typedef struct gateway_struct
+{
+    int epoll_fd;
+    int listen_fd;
+    char *address;
+    char *port;
+    int browsers;
+    //Browsers closed in the current batch of events, later events may still point to them
+    browser_t *closed;
+} gateway_t;
+
+///// FUNCTION DECLARATIONS
+void usage(char *program);
+void raiseFileLimit();
+void acceptBrowsers(gateway_t *gateway);
+void watch(gateway_t *gateway, browser_t *browser);
+int readBrowser(gateway_t *gateway, browser_t *browser);
+int upgrade(gateway_t *gateway, browser_t *browser);
+int connected(browser_t *browser);
+int readFrames(browser_t *browser);
+int readServer(browser_t *browser);
+int queueBytes(void *buffer, size_t *size, const void *data, size_t length);
+int queueFrame(browser_t *browser, int opcode, const void *payload, size_t length);
+int queueClose(browser_t *browser, int code);
+int flush(int fd, void *buffer, size_t *size);
+void closeBrowser(gateway_t *gateway, browser_t *browser);
+
+///// MAIN FUNCTION
+int main(int argc, char *argv[])
+{
+    gateway_t gateway;
+    struct epoll_event events[MAX_EVENTS];
+    struct epoll_event event;
+
+    if (argc < 3 || argc > 4 || isShmEndpoint(argv[1]) || isShmEndpoint(argv[2]) || (argc == 3 && !isUnixEndpoint(argv[2])))
+    {
+        usage(argv[0]);
+    }
+
+    //A browser that left is found when writing to it
+    signal(SIGPIPE, SIG_IGN);
+    raiseFileLimit();
+
+    gateway.address = argv[2];
+    gateway.port = argc > 3 ? argv[3] : NULL;
+    gateway.browsers = 0;
+    gateway.closed = NULL;
+    gateway.listen_fd = initServer(argv[1], MAX_QUEUE);
+    fcntl(gateway.listen_fd, F_SETFL, fcntl(gateway.listen_fd, F_GETFL) | O_NONBLOCK);
+    gateway.epoll_fd = epoll_create1(0);
+    if (gateway.epoll_fd == -1)
+    {
+        fatalError("ERROR: epoll_create1");
+    }
+    //The listener is the only event without a browser
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    epoll_ctl(gateway.epoll_fd, EPOLL_CTL_ADD, gateway.listen_fd, &event);
+    printf("Gateway for browsers on %s, playing on %s%s%s\n", argv[1], gateway.address, gateway.port ? " " : "", gateway.port ? gateway.port : "");
+
+    while (1)
+    {
+        int numEvents = epoll_wait(gateway.epoll_fd, events, MAX_EVENTS, -1);
+
+        if (numEvents == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fatalError("ERROR: epoll_wait");
+        }
+
+        for (int i = 0; i < numEvents; i++)
+        {
+            side_t *side = events[i].data.ptr;
+            browser_t *browser;
+            int ok = 1;
+
+            if (side == NULL)
+            {
+                acceptBrowsers(&gateway);
+                continue;
+            }
+
+            browser = side->browser;
+            if (browser->closed)
+            {
+                continue;
+            }
+            if (side->isServer && browser->connecting)
+            {
+                //Nothing else can happen on the socket before the connection ends
+                ok = connected(browser);
+            }
+            else if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+            {
+                ok = side->isServer ? readServer(browser) : readBrowser(&gateway, browser);
+            }
+            //Whatever was queued by reading is sent right away
+            if (ok && browser->browserOutSize > 0)
+            {
+                ok = flush(browser->browser_fd, browser->browserOut, &browser->browserOutSize);
+            }
+            if (ok && browser->serverOutSize > 0 && browser->server_fd != -1 && !browser->connecting)
+            {
+                ok = flush(browser->server_fd, browser->serverOut, &browser->serverOutSize);
+            }
+
+            if (!ok || (browser->closing && browser->browserOutSize == 0))
+            {
+                closeBrowser(&gateway, browser);
+            }
+            else
+            {
+                watch(&gateway, browser);
+            }
+        }
+
+        while (gateway.closed != NULL)
+        {
+            browser_t *browser = gateway.closed;
+
+            gateway.closed = browser->next;
+            free(browser);
+        }
+    }
+
+    return 0;
+}
+
+///// FUNCTION DEFINITIONS
+
+/*
+    Explanation to the user of the parameters required to run the program
+*/
+void usage(char *program)
+{
+    printf("Usage:\n");
+    printf("\t%s {port_number | unix:/path | unix:@name} {server_address server_port | unix:/path | unix:@name}\n", program);
+    printf("\tListens for browsers on the first endpoint and plays for them on the server\n");
+    exit(EXIT_FAILURE);
+}
+
+/*
+    Every browser uses two file descriptors, allow as many as the system lets this user
+*/
+void raiseFileLimit()
+{
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max)
+    {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+}
+
+/*
+    Accept every browser waiting on the listener, as many as arrived since the last time
+*/
+void acceptBrowsers(gateway_t *gateway)
+{
+    while (1)
+    {
+        int fd = accept4(gateway->listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        browser_t *browser;
+        struct epoll_event event;
+
+        if (fd == -1)
+        {
+            return;
+        }
+        //Refused at once, instead of waiting in the queue of the listener
+        if (gateway->browsers == MAX_BROWSERS)
+        {
+            close(fd);
+            continue;
+        }
+
+        browser = calloc(1, sizeof(browser_t));
+        if (browser == NULL)
+        {
+            fatalError("ERROR: calloc");
+        }
+        browser->browser_fd = fd;
+        browser->server_fd = -1;
+        browser->sides[0].browser = browser;
+        browser->sides[0].isServer = 0;
+        browser->sides[1].browser = browser;
+        browser->sides[1].isServer = 1;
+
+        event.events = EPOLLIN;
+        event.data.ptr = &browser->sides[0];
+        epoll_ctl(gateway->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+        gateway->browsers++;
+    }
+}
+
+/*
+    Wait for the sockets of a browser to be writable only while there is something queued for them
+*/
+void watch(gateway_t *gateway, browser_t *browser)
+{
+    struct epoll_event event;
+
+    event.events = (browser->closing ? 0 : EPOLLIN) | (browser->browserOutSize > 0 ? EPOLLOUT : 0);
+    event.data.ptr = &browser->sides[0];
+    epoll_ctl(gateway->epoll_fd, EPOLL_CTL_MOD, browser->browser_fd, &event);
+
+    //The server sees the player leave as soon as the browser is closing
+    if (browser->server_fd != -1 && browser->closing)
+    {
+        close(browser->server_fd);
+        browser->server_fd = -1;
+    }
+    if (browser->server_fd != -1)
+    {
+        //A connection being made ends by becoming writable
+        event.events = EPOLLIN | (browser->serverOutSize > 0 || browser->connecting ? EPOLLOUT : 0);
+        event.data.ptr = &browser->sides[1];
+        epoll_ctl(gateway->epoll_fd, EPOLL_CTL_MOD, browser->server_fd, &event);
+    }
+}
+
+/*
+    Read what the browser sent: the upgrade request first, then frames
+    Returns 1 on success, or 0 if the browser must be dropped
+*/
+int readBrowser(gateway_t *gateway, browser_t *browser)
+{
+    ssize_t bytes;
+
+    if (browser->closing)
+    {
+        return 1;
+    }
+
+    bytes = recv(browser->browser_fd, browser->browserIn + browser->browserInSize, BROWSER_BUFFER - browser->browserInSize - 1, 0);
+    if (bytes == -1 && (errno == EAGAIN || errno == EINTR))
+    {
+        return 1;
+    }
+    if (bytes <= 0)
+    {
+        return 0;
+    }
+    browser->browserInSize += bytes;
+
+    if (!browser->open)
+    {
+        return upgrade(gateway, browser);
+    }
+
+    return readFrames(browser);
+}
+
+/*
+    Answer the upgrade request once it is complete, and start connecting the browser to the server
+    Returns 1 on success, or 0 if the browser must be dropped
+*/
+int upgrade(gateway_t *gateway, browser_t *browser)
+{
+    char path[256];
+    char response[256];
+    char *query;
+    char *end;
+    int length;
+    int playerID = 0;
+    struct epoll_event event;
+
+    browser->browserIn[browser->browserInSize] = '\0';
+    end = strstr((char *)browser->browserIn, "\r\n\r\n");
+    if (end == NULL)
+    {
+        //A request that fills the buffer is not a browser
+        return browser->browserInSize < BROWSER_BUFFER - 1;
+    }
+
+    length = wsHandshake((char *)browser->browserIn, path, sizeof path, response, sizeof response);
+    if (length == 0)
+    {
+        const char *refusal = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\n\r\n";
+
+        send(browser->browser_fd, refusal, strlen(refusal), MSG_NOSIGNAL);
+        return 0;
+    }
+
+    query = strstr(path, "id=");
+    if (query != NULL)
+    {
+        playerID = atoi(query + 3);
+    }
+
+    browser->open = 1;
+    queueBytes(browser->browserOut, &browser->browserOutSize, response, length);
+
+    //The ID goes first once the server is connected, a refusal only closes this browser
+    browser->server_fd = startConnect(gateway->address, gateway->port);
+    if (browser->server_fd == -1)
+    {
+        browser->closing = 1;
+        return queueClose(browser, CLOSE_TRY_LATER);
+    }
+    browser->connecting = 1;
+    event.events = EPOLLOUT;
+    event.data.ptr = &browser->sides[1];
+    epoll_ctl(gateway->epoll_fd, EPOLL_CTL_ADD, browser->server_fd, &event);
+    queueBytes(browser->serverOut, &browser->serverOutSize, &playerID, sizeof playerID);
+
+    //Frames sent right after the request
+    end += 4;
+    browser->browserInSize -= end - (char *)browser->browserIn;
+    memmove(browser->browserIn, end, browser->browserInSize);
+
+    return readFrames(browser);
+}
+
+/*
+    The connection to the server ended, the socket became writable or failed
+    A failed one closes the browser with a close frame, so it can try again later
+    Returns 1 on success, or 0 if the browser must be dropped
+*/
+int connected(browser_t *browser)
+{
+    browser->connecting = 0;
+    if (finishConnect(browser->server_fd))
+    {
+        return 1;
+    }
+
+    //Closing removes the socket from epoll
+    close(browser->server_fd);
+    browser->server_fd = -1;
+    browser->closing = 1;
+
+    return queueClose(browser, CLOSE_TRY_LATER);
+}
+
+/*
+    Translate the whole frames received from the browser
+    Returns 1 on success, or 0 if the browser must be dropped
+*/
+int readFrames(browser_t *browser)
+{
+    ws_frame_t frame;
+    long used;
+    size_t start = 0;
+    int ok = 1;
+
+    while (ok && !browser->closing && (used = wsDecodeFrame(browser->browserIn + start, browser->browserInSize - start, &frame)) > 0)
+    {
+        start += used;
+
+        if (frame.opcode == WS_TEXT || frame.opcode == WS_BINARY)
+        {
+            socketCommunication_t message = browser->state;
+            char text[16];
+            size_t length = frame.length < sizeof text - 1 ? frame.length : sizeof text - 1;
+
+            memcpy(text, frame.payload, length);
+            text[length] = '\0';
+            if (browser->state.playerState == FIRST)
+            {
+                message.playersExpected = atoi(text);
+            }
+            else
+            {
+                message.color = atoi(text);
+            }
+            ok = queueBytes(browser->serverOut, &browser->serverOutSize, &message, sizeof message);
+        }
+        else if (frame.opcode == WS_PING)
+        {
+            ok = queueFrame(browser, WS_PONG, frame.payload, frame.length);
+        }
+        else if (frame.opcode == WS_CLOSE)
+        {
+            //The close is answered, and the server sees the player leave when the sockets are closed
+            ok = queueFrame(browser, WS_CLOSE, frame.payload, frame.length < 2 ? frame.length : 2);
+            browser->closing = 1;
+        }
+    }
+
+    if (used == -1)
+    {
+        return 0;
+    }
+    browser->browserInSize -= start;
+    memmove(browser->browserIn, browser->browserIn + start, browser->browserInSize);
+
+    return ok;
+}
+
+/*
+    Read the updates of the server, and send each one to the browser as the whole state
+    Returns 1 on success, or 0 if the browser must be dropped
+*/
+int readServer(browser_t *browser)
+{
+    ssize_t bytes;
+
+    //Never more than one update at a time, so the buffer is always enough
+    while (1)
+    {
+        size_t size = browser->serverInSize < sizeof(int32_t) ? sizeof(int32_t) : updateSize(*(int32_t *)browser->serverIn);
+
+        if (browser->serverInSize == size)
+        {
+            char text[STATE_TEXT];
+            int length;
+
+            applyUpdate((int32_t *)browser->serverIn, &browser->state);
+            browser->serverInSize = 0;
+            length = snprintf(text, sizeof text,
+                "{\"playersExpected\":%d,\"playerState\":%d,\"gameState\":%d,\"color\":%d,\"wrongColor\":%d,\"newColor\":%d,\"newRound\":%d}",
+                browser->state.playersExpected, browser->state.playerState, browser->state.gameState, browser->state.color,
+                browser->state.wrongColor, browser->state.newColor, browser->state.newRound);
+            if (!queueFrame(browser, WS_TEXT, text, length))
+            {
+                return 0;
+            }
+            continue;
+        }
+
+        bytes = recv(browser->server_fd, browser->serverIn + browser->serverInSize, size - browser->serverInSize, 0);
+        if (bytes == -1 && (errno == EAGAIN || errno == EINTR))
+        {
+            return 1;
+        }
+        if (bytes <= 0)
+        {
+            //The game is over (or the server is gone), the browser is told before closing
+            browser->closing = 1;
+            return queueClose(browser, CLOSE_NORMAL);
+        }
+        browser->serverInSize += bytes;
+    }
+}
+
+/*
+    Add bytes to the end of an output buffer
+    Returns 1 on success, or 0 if they don't fit
+*/
+int queueBytes(void *buffer, size_t *size, const void *data, size_t length)
+{
+    if (*size + length > OUTPUT_BUFFER)
+    {
+        return 0;
+    }
+    memcpy((char *)buffer + *size, data, length);
+    *size += length;
+
+    return 1;
+}
+
+/*
+    Add a frame to the output of a browser
+    Returns 1 on success, or 0 if it doesn't fit
+*/
+int queueFrame(browser_t *browser, int opcode, const void *payload, size_t length)
+{
+    unsigned char frame[WS_MAX_HEADER + STATE_TEXT];
+
+    if (length > STATE_TEXT)
+    {
+        return 0;
+    }
+
+    return queueBytes(browser->browserOut, &browser->browserOutSize, frame, wsEncodeFrame(frame, opcode, payload, length));
+}
+
+/*
+    Add a close frame with a status code to the output of a browser
+    Returns 1 on success, or 0 if it doesn't fit
+*/
+int queueClose(browser_t *browser, int code)
+{
+    unsigned char reason[2] = {code >> 8, code & 0xFF};
+
+    return queueFrame(browser, WS_CLOSE, reason, sizeof reason);
+}
+
+/*
+    Send as much of an output buffer as the socket takes now
+    Returns 1 on success, or 0 if the peer is gone
+*/
+int flush(int fd, void *buffer, size_t *size)
+{
+    ssize_t bytes = send(fd, buffer, *size, MSG_NOSIGNAL);
+
+    if (bytes == -1)
+    {
+        return errno == EAGAIN || errno == EINTR;
+    }
+    *size -= bytes;
+    memmove(buffer, (char *)buffer + bytes, *size);
+
+    return 1;
+}
+
+/*
+    Close both sockets of a browser, the server sees the player leave
+*/
+void closeBrowser(gateway_t *gateway, browser_t *browser)
+{
+    //Closing removes the sockets from epoll
+    close(browser->browser_fd);
+    if (browser->server_fd != -1)
+    {
+        close(browser->server_fd);
+    }
+    browser->closed = 1;
+    browser->next = gateway->closed;
+    gateway->closed = browser;
+    gateway->browsers--;
+}
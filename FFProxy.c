@@ -0,0 +1,605 @@
+/*
+    Network impairment proxy for Fabulous Fred
+    Sits between the clients (or bots) and the server, and forwards the bytes of every
+    connection with the delay, jitter, bandwidth limit, reordering and resets of a bad network
+    - The bytes are read in segments of at most PROXY_SEGMENT, and every segment gets its
+      delivery time when it is read
+    - A segment held back (reordered) also delays the ones read after it, as the reassembly of TCP
+      does: the program on the other side sees the gap as extra latency, never bytes out of order
+    - A reset closes both sides of the connection at once with a TCP RST (or a plain close
+      on Unix sockets), as a middlebox dropping the connection would
+    - The random numbers of every connection depend only on the seed and the number of the
+      connection, so a run with the same seed and the same clients gives the same impairments
+      to the same segments
+    Shared memory endpoints can't be proxied, the clients must use TCP or Unix sockets
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+// Custom libraries
+#include "connection.h"
+#include "fatal_error.h"
+
+// Largest segment read at once, the payload of a TCP segment on an Ethernet link
+#define PROXY_SEGMENT 1448
+// Most connections forwarded at the same time
+#define MAX_PAIRS 1024
+// Bytes queued in one direction before the proxy stops reading from that side
+#define MAX_QUEUED (1 << 20)
+#define MAX_QUEUE 64
+// Hold time of a reordered segment when it is not given
+#define DEFAULT_HOLD_MS 20
+
+// Impairments, the same for every connection
+typedef struct impairment_struct
+{
+    //One way delay and the most jitter added to it, in nanoseconds
+    uint64_t delay;
+    uint64_t jitter;
+    //Bytes per second in every direction of a connection, 0 for no limit
+    uint64_t bandwidth;
+    //Probability that a segment is held back, and for how long in nanoseconds
+    double reorderRate;
+    uint64_t hold;
+    //Probability that a segment resets the connection instead of being delivered
+    double resetRate;
+    uint64_t seed;
+} impairment_t;
+
+// Segment waiting to be delivered
+typedef struct segment_struct
+{
+    struct segment_struct *next;
+    uint64_t due;
+    size_t size;
+    //Bytes already written, when the other side could not take the whole segment
+    size_t sent;
+    char data[PROXY_SEGMENT];
+} segment_t;
+
+// One direction of a connection
+typedef struct direction_struct
+{
+    int from;
+    int to;
+    segment_t *first;
+    segment_t *last;
+    size_t queued;
+    //When the link finishes sending what it has, for the bandwidth limit
+    uint64_t linkFree;
+    //Delivery time of the last segment, none can be delivered before it
+    uint64_t lastDue;
+    uint64_t random;
+    //The sender closed its side, the other side is shut down when the queue is empty
+    int finished;
+    //The receiver could not take more, wait until it is writable
+    int blocked;
+    long segments;
+    long held;
+    //The connection was reset by the proxy, on a segment of this direction
+    int injected;
+} direction_t;
+
+// Connection of a client, forwarded to the server
+typedef struct pair_struct
+{
+    int number;
+    //Client to server, and server to client
+    direction_t up;
+    direction_t down;
+    //Both sides must be closed at once, dropping what is queued
+    int reset;
+    //The connection to the server is still being made, or it failed
+    int connecting;
+    int refused;
+} pair_t;
+
+///// FUNCTION DECLARATIONS
+void usage(char *program);
+int parseOptions(int argc, char *argv[], impairment_t *impairment);
+uint64_t now();
+uint64_t nextRandom(uint64_t *state);
+double randomUnit(uint64_t *state);
+pair_t *openPair(int client_fd, char *address, char *port, int number, impairment_t *impairment);
+void initDirection(direction_t *direction, int from, int to, uint64_t random);
+int readSegment(direction_t *direction, impairment_t *impairment);
+int deliver(direction_t *direction, uint64_t time);
+void closePair(pair_t *pair);
+void freeQueue(direction_t *direction);
+
+///// MAIN FUNCTION
+int main(int argc, char *argv[])
+{
+    impairment_t impairment;
+    pair_t *pairs[MAX_PAIRS];
+    struct pollfd fds[MAX_PAIRS * 2 + 1];
+    int numPairs = 0;
+    int connections = 0;
+    int first = parseOptions(argc, argv, &impairment);
+    int server_fd;
+    char *address;
+    char *port;
+
+    if (first < 0 || argc - first < 2 || argc - first > 3)
+    {
+        usage(argv[0]);
+    }
+    address = argv[first + 1];
+    port = argc - first > 2 ? argv[first + 2] : NULL;
+    if (isShmEndpoint(argv[first]) || isShmEndpoint(address) || (port == NULL && !isUnixEndpoint(address)))
+    {
+        usage(argv[0]);
+    }
+
+    //A side that left is found when writing to it
+    signal(SIGPIPE, SIG_IGN);
+    //The log is read while the proxy runs
+    setvbuf(stdout, NULL, _IOLBF, 0);
+    server_fd = initServer(argv[first], MAX_QUEUE);
+    printf("Forwarding %s to %s%s%s with seed %llu\n", argv[first], address, port ? " " : "", port ? port : "", (unsigned long long)impairment.seed);
+
+    while (1)
+    {
+        uint64_t time = now();
+        uint64_t wake = UINT64_MAX;
+        int timeout = -1;
+        int numFds = 1;
+
+        //Deliver what is due, and find when the next segment is
+        for (int i = 0; i < numPairs; i++)
+        {
+            direction_t *directions[2] = {&pairs[i]->up, &pairs[i]->down};
+
+            for (int j = 0; j < 2 && !pairs[i]->reset; j++)
+            {
+                direction_t *direction = directions[j];
+
+                if (!deliver(direction, time))
+                {
+                    pairs[i]->reset = 1;
+                    break;
+                }
+                if (direction->first != NULL && !direction->blocked && direction->first->due < wake)
+                {
+                    wake = direction->first->due;
+                }
+                if (direction->finished && direction->first == NULL && direction->to != -1)
+                {
+                    shutdown(direction->to, SHUT_WR);
+                    direction->to = -1;
+                }
+            }
+
+            if (pairs[i]->reset || (pairs[i]->up.to == -1 && pairs[i]->down.to == -1))
+            {
+                closePair(pairs[i]);
+                numPairs--;
+                pairs[i] = pairs[numPairs];
+                i--;
+            }
+        }
+
+        //Listener first, then both sides of every connection
+        fds[0].fd = numPairs < MAX_PAIRS ? server_fd : -1;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < numPairs; i++)
+        {
+            pair_t *pair = pairs[i];
+
+            fds[numFds].fd = pair->up.from;
+            fds[numFds].events = (!pair->up.finished && pair->up.queued < MAX_QUEUED ? POLLIN : 0) | (pair->down.blocked ? POLLOUT : 0);
+            fds[numFds + 1].fd = pair->down.from;
+            fds[numFds + 1].events = (!pair->connecting && !pair->down.finished && pair->down.queued < MAX_QUEUED ? POLLIN : 0) | (pair->up.blocked ? POLLOUT : 0);
+            //Sides with nothing to wait for are skipped, so a hangup doesn't wake the proxy again and again
+            fds[numFds].fd = fds[numFds].events ? fds[numFds].fd : -1;
+            fds[numFds + 1].fd = fds[numFds + 1].events ? fds[numFds + 1].fd : -1;
+            numFds += 2;
+        }
+
+        if (wake != UINT64_MAX)
+        {
+            //Rounded up, so the segment is due when poll returns
+            timeout = wake > time ? (wake - time + 999999) / 1000000 : 0;
+        }
+        if (poll(fds, numFds, timeout) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fatalError("ERROR: poll");
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            int client_fd = accept(server_fd, NULL, NULL);
+
+            if (client_fd != -1)
+            {
+                connections++;
+                pairs[numPairs] = openPair(client_fd, address, port, connections, &impairment);
+                numPairs += pairs[numPairs] != NULL;
+            }
+        }
+
+        for (int i = 0; i < (numFds - 1) / 2; i++)
+        {
+            pair_t *pair = pairs[i];
+            struct pollfd *client = &fds[1 + i * 2];
+            struct pollfd *server = &fds[2 + i * 2];
+
+            if (client->revents & POLLOUT)
+            {
+                pair->down.blocked = 0;
+            }
+            //The connection to the server ended, what the client sent meanwhile can go
+            if (pair->connecting && (server->revents & (POLLOUT | POLLHUP | POLLERR)))
+            {
+                pair->connecting = 0;
+                if (!finishConnect(pair->down.from))
+                {
+                    pair->refused = 1;
+                    pair->reset = 1;
+                    continue;
+                }
+            }
+            if (server->revents & POLLOUT)
+            {
+                pair->up.blocked = 0;
+            }
+            if ((client->events & POLLIN) && (client->revents & (POLLIN | POLLHUP | POLLERR)) && !readSegment(&pair->up, &impairment))
+            {
+                pair->reset = 1;
+            }
+            if ((server->events & POLLIN) && (server->revents & (POLLIN | POLLHUP | POLLERR)) && !readSegment(&pair->down, &impairment))
+            {
+                pair->reset = 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+///// FUNCTION DEFINITIONS
+
+/*
+    Explanation to the user of the parameters required to run the program
+*/
+void usage(char *program)
+{
+    printf("Usage:\n");
+    printf("\t%s [-d ms] [-j ms] [-b bytes_per_second] [-r rate[:ms]] [-k rate] [-s seed] {port_number | unix:/path | unix:@name} {server_address server_port | unix:/path | unix:@name}\n", program);
+    printf("\tListens on the first endpoint and forwards every connection to the server\n");
+    printf("\t-d: delay of every segment, one way\n");
+    printf("\t-j: most random jitter added to the delay\n");
+    printf("\t-b: bandwidth of every direction of a connection\n");
+    printf("\t-r: probability that a segment is held back, for the given time (default %d ms)\n", DEFAULT_HOLD_MS);
+    printf("\t-k: probability that a segment resets the connection\n");
+    printf("\t-s: seed of the random numbers, the same seed gives the same impairments\n");
+    exit(EXIT_FAILURE);
+}
+
+/*
+    Read the options of the impairments, before the endpoints
+    Returns the position of the first endpoint, or -1 if an option is not valid
+*/
+int parseOptions(int argc, char *argv[], impairment_t *impairment)
+{
+    int i = 1;
+
+    memset(impairment, 0, sizeof *impairment);
+    impairment->hold = DEFAULT_HOLD_MS * 1000000ULL;
+    impairment->seed = 1;
+
+    while (i + 1 < argc && argv[i][0] == '-' && argv[i][1] != '\0' && argv[i][2] == '\0')
+    {
+        char *value = argv[i + 1];
+        char *end;
+
+        switch (argv[i][1])
+        {
+            case 'd':
+                impairment->delay = strtoull(value, &end, 10) * 1000000ULL;
+                break;
+            case 'j':
+                impairment->jitter = strtoull(value, &end, 10) * 1000000ULL;
+                break;
+            case 'b':
+                impairment->bandwidth = strtoull(value, &end, 10);
+                break;
+            case 'r':
+                impairment->reorderRate = strtod(value, &end);
+                if (*end == ':')
+                {
+                    impairment->hold = strtoull(end + 1, &end, 10) * 1000000ULL;
+                }
+                break;
+            case 'k':
+                impairment->resetRate = strtod(value, &end);
+                break;
+            case 's':
+                impairment->seed = strtoull(value, &end, 0);
+                break;
+            default:
+                return -1;
+        }
+
+        if (end == value || *end != '\0')
+        {
+            return -1;
+        }
+        i += 2;
+    }
+
+    if (impairment->reorderRate < 0 || impairment->reorderRate > 1 || impairment->resetRate < 0 || impairment->resetRate > 1)
+    {
+        return -1;
+    }
+
+    return i;
+}
+
+/*
+    Monotonic time in nanoseconds
+*/
+uint64_t now()
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (uint64_t)time.tv_sec * 1000000000ULL + time.tv_nsec;
+}
+
+/*
+    Random number generator (xorshift64*), the same as the one of FFSim
+*/
+uint64_t nextRandom(uint64_t *state)
+{
+    uint64_t x = *state ? *state : 0x2545F4914F6CDD1DULL;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+    Random number in [0, 1)
+*/
+double randomUnit(uint64_t *state)
+{
+    return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/*
+    Start connecting a client that just arrived to the server
+    Both sockets are non blocking, the proxy waits for all of them in a single poll, the
+    connection to the server too: what the client sends meanwhile waits in the queue
+    Returns the new connection, or NULL if the server refused it and the client was closed
+*/
+pair_t *openPair(int client_fd, char *address, char *port, int number, impairment_t *impairment)
+{
+    pair_t *pair;
+    int server_fd = startConnect(address, port);
+    //Every direction of every connection has its own sequence of random numbers
+    uint64_t random = impairment->seed ^ ((uint64_t)number * 0x9E3779B97F4A7C15ULL);
+
+    if (server_fd == -1)
+    {
+        printf("Connection %d refused by the server\n", number);
+        close(client_fd);
+        return NULL;
+    }
+
+    pair = malloc(sizeof(pair_t));
+    if (pair == NULL)
+    {
+        fatalError("ERROR: malloc");
+    }
+
+    fcntl(client_fd, F_SETFL, fcntl(client_fd, F_GETFL) | O_NONBLOCK);
+    pair->number = number;
+    pair->reset = 0;
+    pair->refused = 0;
+    initDirection(&pair->up, client_fd, server_fd, nextRandom(&random));
+    initDirection(&pair->down, server_fd, client_fd, nextRandom(&random));
+    //Nothing is sent to the server until it is connected, it is writable then
+    pair->connecting = 1;
+    pair->up.blocked = 1;
+    printf("Connection %d opened\n", number);
+
+    return pair;
+}
+
+/*
+    Prepare an empty direction that forwards from 'from' to 'to', with its own random numbers
+*/
+void initDirection(direction_t *direction, int from, int to, uint64_t random)
+{
+    memset(direction, 0, sizeof *direction);
+    direction->from = from;
+    direction->to = to;
+    direction->random = random;
+}
+
+/*
+    Read the next segment of a direction and choose when it is delivered
+    Returns 1 on success, or 0 if the connection must be reset
+*/
+int readSegment(direction_t *direction, impairment_t *impairment)
+{
+    segment_t *segment = malloc(sizeof(segment_t));
+    uint64_t time = now();
+    uint64_t due;
+    ssize_t bytes;
+
+    if (segment == NULL)
+    {
+        fatalError("ERROR: malloc");
+    }
+
+    bytes = recv(direction->from, segment->data, PROXY_SEGMENT, 0);
+    if (bytes <= 0)
+    {
+        free(segment);
+        if (bytes == -1 && (errno == EAGAIN || errno == EINTR))
+        {
+            return 1;
+        }
+        //The sender closed its side in order, what is queued still goes through
+        direction->finished = 1;
+        return bytes == 0;
+    }
+
+    //The same number of draws for every segment, so one impairment doesn't shift the others
+    double reorder = randomUnit(&direction->random);
+    double reset = randomUnit(&direction->random);
+    uint64_t jitter = nextRandom(&direction->random) % (impairment->jitter + 1);
+
+    direction->segments++;
+    if (reset < impairment->resetRate)
+    {
+        free(segment);
+        direction->injected = 1;
+        return 0;
+    }
+
+    //The time on the link for the bandwidth, then the delay
+    due = direction->linkFree > time ? direction->linkFree : time;
+    if (impairment->bandwidth > 0)
+    {
+        due += bytes * 1000000000ULL / impairment->bandwidth;
+    }
+    direction->linkFree = due;
+    due += impairment->delay + jitter;
+    if (reorder < impairment->reorderRate)
+    {
+        due += impairment->hold;
+        direction->held++;
+    }
+    //Delivered in order, a late segment holds back the ones behind it
+    if (due < direction->lastDue)
+    {
+        due = direction->lastDue;
+    }
+    direction->lastDue = due;
+
+    segment->next = NULL;
+    segment->due = due;
+    segment->size = bytes;
+    segment->sent = 0;
+    if (direction->last == NULL)
+    {
+        direction->first = segment;
+    }
+    else
+    {
+        direction->last->next = segment;
+    }
+    direction->last = segment;
+    direction->queued += bytes;
+
+    return 1;
+}
+
+/*
+    Write the segments of a direction that are due by 'time'
+    Returns 1 on success, or 0 if the receiver is gone
+*/
+int deliver(direction_t *direction, uint64_t time)
+{
+    while (direction->first != NULL && direction->first->due <= time && !direction->blocked && direction->to != -1)
+    {
+        segment_t *segment = direction->first;
+        ssize_t bytes = send(direction->to, segment->data + segment->sent, segment->size - segment->sent, MSG_NOSIGNAL);
+
+        if (bytes == -1)
+        {
+            if (errno == EAGAIN || errno == EINTR)
+            {
+                direction->blocked = 1;
+                return 1;
+            }
+            return 0;
+        }
+
+        segment->sent += bytes;
+        if (segment->sent == segment->size)
+        {
+            direction->first = segment->next;
+            if (direction->first == NULL)
+            {
+                direction->last = NULL;
+            }
+            direction->queued -= segment->size;
+            free(segment);
+        }
+    }
+
+    return 1;
+}
+
+/*
+    Close both sides of a connection and show what was done to it
+    After a reset the sides get a TCP RST, and what was still queued is dropped
+*/
+void closePair(pair_t *pair)
+{
+    struct linger linger = {1, 0};
+    const char *reason = "closed";
+
+    if (pair->refused)
+    {
+        reason = "refused by the server";
+    }
+    else if (pair->up.injected || pair->down.injected)
+    {
+        reason = "reset by the proxy";
+    }
+    else if (pair->reset)
+    {
+        reason = "reset by a peer";
+    }
+
+    if (pair->reset)
+    {
+        setsockopt(pair->up.from, SOL_SOCKET, SO_LINGER, &linger, sizeof linger);
+        setsockopt(pair->down.from, SOL_SOCKET, SO_LINGER, &linger, sizeof linger);
+    }
+    close(pair->up.from);
+    close(pair->down.from);
+
+    printf("Connection %d %s: %ld segments up (%ld held back), %ld down (%ld held back)\n",
+        pair->number, reason, pair->up.segments, pair->up.held, pair->down.segments, pair->down.held);
+
+    freeQueue(&pair->up);
+    freeQueue(&pair->down);
+    free(pair);
+}
+
+/*
+    Free the segments still queued in a direction
+*/
+void freeQueue(direction_t *direction)
+{
+    while (direction->first != NULL)
+    {
+        segment_t *segment = direction->first;
+
+        direction->first = segment->next;
+        free(segment);
+    }
+}
@@ -5,6 +5,9 @@
 
 */
 
+// Needed for pipe2
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -14,520 +17,2321 @@
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/wait.h>
 // Custom libraries
 #include "sockets.h"
+#include "connection.h"
+#include "supervisor.h"
+#include "hot_restart.h"
 #include "fatal_error.h"
+#include "fred_game.h"
+#include "placement.h"
+#include "lock_profile.h"
+#include "fred_probes.h"
+#include "player_table.h"
+#include "tournament.h"
+#include "stats_store.h"
+#include "analytics.h"
+#include "mpsc_queue.h"
+#include "clock_time.h"
+#include "sequence_store.h"
+#include "admission.h"
+#include "admin.h"
+#include "ktls.h"
 //Thread library
 #include <pthread.h>
 //game/player state enums
 #include "Game_Codes.h"
 
 #define BUFFER_SIZE 1024
-#define MAX_QUEUE 5
+//Backlog of the listeners, a burst of clients waits there until the admission thread takes it
+#define MAX_QUEUE 1024
+//Backlog of the control socket, one admin is served at a time
+#define ADMIN_QUEUE 4
 #define PLAYERS 3
+//Maximum number of endpoints the server can listen on at the same time
+#define MAX_LISTENERS 8
 
-//Mutex for the playersConnected variable
-pthread_mutex_t mutex1 = PTHREAD_MUTEX_INITIALIZER;
-//Mutex for the thread synchronization variable
-pthread_mutex_t mutex2 = PTHREAD_MUTEX_INITIALIZER;
-//Condition variable for mutex2
-pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
-
-//The struct to be sent to the client
-typedef struct socket_Communication
+// Where the players for new games come from
+typedef struct server_struct
 {
-    int playersExpected;
-    int playerState;
-    int gameState;
-    int color;
-    int wrongColor;
-    int newColor;
-    int newRound;
-} socketCommunication_t;
-
-//Player struct
-typedef struct player_info_struct
+    //Listening sockets, TCP and / or Unix domain
+    int *server_fds;
+    //Transport used by the clients of every listener (see connection.h)
+    int *transports;
+    int numServers;
+    //Channel to the supervisor when running as a worker process, -1 otherwise
+    int supervisor_fd;
+    //Set when no more players can arrive
+    int finished;
+    //Program, options and endpoints, to start a new copy of the server on a hot restart
+    char *program;
+    char **arguments;
+    int numArguments;
+    //Becomes readable when a hot restart begins, so nobody keeps waiting for clients
+    int upgradePipe[2];
+    //Channel to the new server during a hot restart
+    int handoff_fd;
+    //Mutex for the handoff channel and the game counters
+    profiled_mutex_t handoffMutex;
+    //Condition variable for handoffMutex
+    profiled_cond_t handoffCond;
+    //Games running in this process
+    int activeGames;
+    //Set while the main thread may still have a game to hand over
+    int forming;
+    //Game that the old server was forming, to be continued first after a hot restart
+    struct thread_data_struct *resumedGame;
+    //Results of the players on their way to the stats, NULL if no stats are kept
+    mpsc_queue_t *statsQueue;
+    //File of the stats and the thread that writes it, the only one using the store
+    char *statsPath;
+    stats_store_t stats;
+    pthread_t statsThread;
+    int statsClosing;
+    //Summaries of the games on their way to the batch files, NULL if none are written
+    mpsc_queue_t *analyticsQueue;
+    //Batches being filled and the thread that writes them, the only one using them
+    char *analyticsPath;
+    analytics_t analytics;
+    pthread_t analyticsThread;
+    int analyticsClosing;
+    //Limits on new clients, and the clients accepted that wait for formGame
+    admission_t admission;
+    pending_clients_t pending;
+    //Thread that accepts from the listeners, not used in worker processes
+    pthread_t admissionThread;
+    //Settings that can be changed while running, read by the games without locks
+    live_config_t config;
+    //Control socket and the thread that serves it, -1 without one
+    int admin_fd;
+    pthread_t adminThread;
+} server_t;
+
+// A tournament played by the players of one roster
+typedef struct tournament_data_struct
 {
-    //Boolean, correct if player already lost and is disconnected
-    int isOut;
-    int client_fd;
-    socketCommunication_t *clientData;
-} player_t;
-
-// Structure to hold all the data that will be shared between threads for the server
+    server_t *server;
+    tournament_t tournament;
+    //Connections of the entrants still playing and their IDs, by their number in the roster
+    connection_t *connections;
+    int *ids;
+    //Mutex for the results and the matches running
+    profiled_mutex_t mutex;
+    //Matches of the current round still being played, the last one to end starts the next round
+    int matchesRunning;
+} tournament_data_t;
+
+// Structure to hold all the data that will be shared between threads of one game
 typedef struct thread_data_struct
 {
-    int server_fd;
+    server_t *server;
+    //Number of the game in this process, for the tracepoints
+    int gameID;
+    //Mutex for the playerID variable
+    profiled_mutex_t mutex1;
+    //Mutex for the thread synchronization variables
+    profiled_mutex_t mutex2;
+    //Condition variable for mutex2
+    profiled_cond_t cond;
+    //Threads attending the players that haven't finished yet, the last one ends the game
+    int threadsRunning;
     //The number of players that are already connected
     int playersConnected;
     //The numbers of expected players for this game
     int playersExpected;
     int playerID;
+    //GWAIT while forming, GACTIVE while playing, END from the update that ended the game on
+    //Changed only together with the update, under mutex2
     int gameState;
-    //The color sequence to remember so far
-    int *colorSequence;
-    int sequenceSize;
-    //The least remembered color by current player
-    int color;
-    int wrongColor;
+    //Rules of the game, with the color sequence and the state of every player
+    fred_game_t game;
+    //Result of the last color played
+    fred_update_t update;
+    int sentTo;
+    //Increased every time all players got an update
+    int broadcastRound;
+    //Connections and messages of the players
+    player_table_t players;
+    //Set if the game came from the old server in a hot restart
+    int resumed;
+    //Set once the game belongs to the new server in a hot restart
+    int handedOff;
+    //Tournament the game is a match of, or NULL
+    tournament_data_t *tournament;
+    //Seat in the tournament of the first player of the match
+    int firstSeat;
+    //When the game started, by the wall clock and for its duration, in microseconds
+    int64_t startTime;
+    int64_t startClock;
+    //File of the color sequence in endurance mode, NULL when it is on the heap
+    sequence_store_t *sequenceStore;
+} thread_data_t;
+
+//State of a game as handed over in a hot restart, followed by the color sequence
+typedef struct game_record_struct
+{
+    int gameState;
+    int playersExpected;
+    int playersConnected;
     int playerTurn;
     int turnCounter;
-    int sentTo;
     int losers;
+    int sequenceSize;
+    //Position in the sequence of the active player
+    int index;
+    int color;
+    int wrongColor;
     int newColor;
     int newRound;
-    //Player info array
-    player_t **playerArray;
-} thread_data_t;
+    //Number of players that follow, each in its own record with its sockets
+    int numPlayers;
+} game_record_t;
+
+//State of a player as handed over in a hot restart
+typedef struct player_record_struct
+{
+    //State in the rules of a running game
+    int state;
+    //Last message prepared for the player, empty while the game is formed
+    socketCommunication_t clientData;
+    //ID the player gave when it connected
+    int id;
+} player_record_t;
+
+//Tournament played by every roster formed, -1 for single games
+//Read from the command line before the worker processes are forked, so they have it too
+static int tournamentFormat = -1;
+static int playersPerMatch = 0;
+
+//Directory of the files of the color sequences in endurance mode, NULL to keep them on the heap
+//Read from the command line before the worker processes are forked, so they have it too
+static char *enduranceDirectory = NULL;
+
+//Games started by this process, numbering them for the tracepoints
+static int gamesCreated = 0;
+
+//Cores the games run on, and the NUMA node of every worker process, when -a is given
+static placement_t placement;
 
 ///// FUNCTION DECLARATIONS
 void usage(char *program);
-void waitForConnections(int server_fd);
+int parseTournament(char *option);
+void runWorker(int supervisor_fd, int worker);
+void initHotRestart(server_t *server);
+void *upgradeThread(void *arg);
+void receiveState(server_t *server, int handoff_fd);
+void handOffGame(thread_data_t *sharedData);
+void waitForConnections(server_t *server);
+thread_data_t *newGame(server_t *server);
+thread_data_t *formGame(server_t *server);
+int waitForInput(thread_data_t *sharedData, int playerID);
+thread_data_t *receiveGame(server_t *server, int handoff_fd, game_record_t *game, int size);
+int acceptPlayer(server_t *server, connection_t *connection, int *id);
+int receiveID(server_t *server, connection_t *connection, int *id, int milliseconds);
 void *attendClient(void *arg);
+void leaveGame(thread_data_t *sharedData);
+void endGame(thread_data_t *sharedData);
 void startGame(thread_data_t *sharedData);
-void setupGame(thread_data_t *sharedData);
-void compareColors(thread_data_t *sharedData, int playerID, int index);
-void whoseTurn(thread_data_t *sharedData, int playerID);
-int checkIfWinner(thread_data_t *sharedData, int playerID);
-void addColor(thread_data_t *sharedData, int playerID, int index);
-int checkColor(thread_data_t *sharedData, int index);
+int setupGame(thread_data_t *sharedData);
+void playColor(thread_data_t *sharedData, int playerID);
 void freeAll(thread_data_t *sharedData);
+int *newSequence(thread_data_t *sharedData, int *capacity);
+void sequenceToHeap(thread_data_t *sharedData);
+void receiveSequence(thread_data_t *sharedData, int handoff_fd, game_record_t *game, int size);
+void startTournament(thread_data_t *sharedData);
+void startRound(tournament_data_t *tournament);
+int matchResult(thread_data_t *sharedData, int playerID);
+void matchEnded(tournament_data_t *tournament);
+void endTournament(tournament_data_t *tournament);
+void startAdmission(server_t *server);
+void defaultConfig(server_config_t *config);
+int logging(server_t *server, int level);
+void *adminThread(void *arg);
+void runCommand(server_t *server, int client_fd, char *line);
+void changeConfig(server_t *server, const server_config_t *config);
+void *admissionThread(void *arg);
+void startStats(server_t *server);
+void *statsThread(void *arg);
+void stopStats(server_t *server);
+void sendStats(thread_data_t *sharedData, int playerID);
+void startAnalytics(server_t *server);
+void *analyticsThread(void *arg);
+void stopAnalytics(server_t *server);
+int64_t analyticsGame(thread_data_t *sharedData);
+void sendPlayerSummary(thread_data_t *sharedData, analytics_player_t *summary);
+void sendGameSummary(thread_data_t *sharedData);
 
 
 ///// MAIN FUNCTION
 int main(int argc, char *argv[])
 {
-    int server_fd;
+    int server_fds[MAX_LISTENERS];
+    int transports[MAX_LISTENERS];
+    int numServers = argc - 1;
+    int numWorkers = 0;
+    int handoff_fd = -1;
+    char **endpoints = &argv[1];
+    char *statsPath = NULL;
+    char *analyticsPath = NULL;
+    char *limits = NULL;
+    char *adminEndpoint = NULL;
+    server_config_t config;
+    server_t server;
 
     printf("\n=== FABULOUS FRED SERVER STARTING ===\n");
 
-    // Check the correct arguments
-    if (argc != 2)
+    // Started by a running server in a hot restart
+    if (argc > 2 && strcmp(argv[1], RESUME_OPTION) == 0)
     {
-        usage(argv[0]);
+        handoff_fd = atoi(argv[2]);
+        numServers -= 2;
+        endpoints += 2;
+        // Tell the old server that this program is up
+        send(handoff_fd, "R", 1, MSG_NOSIGNAL);
     }
 
-    // Show the IPs assigned to this computer
-    printLocalIPs();
-
-    // Start the server
-    server_fd = initServer(argv[1], MAX_QUEUE);
-
-    //setupHandlers();
-
-    // Listen for connections from the clients
-    waitForConnections(server_fd);
-
-    // Close the socket
-    close(server_fd);
-
-    return 0;
-}
-
-///// FUNCTION DEFINITIONS
-
-/*
-    Explanation to the user of the parameters required to run the program
-*/
-void usage(char *program)
-{
-    printf("Usage:\n");
-    printf("\t%s {port_number}\n", program);
-    exit(EXIT_FAILURE);
-}
-
-/*
-    Main loop to wait for incomming connections
-*/
-
-void waitForConnections(int server_fd)
-{
-
-    //Initialize struct for sharing between threads
-    thread_data_t *sharedData = NULL;
-    sharedData = malloc(sizeof(thread_data_t));
-    sharedData->server_fd = server_fd;
-    sharedData->playersExpected = 1;
-    sharedData->playersConnected = 0;
-    sharedData->playerTurn = 0;
-    sharedData->playerID = 0;
-    sharedData->turnCounter = 0;
-    sharedData->gameState = GWAIT;
-    sharedData->wrongColor = 0;
-    sharedData->sequenceSize = 0;
-    sharedData->color = 0;
-    sharedData->losers = 0;
-    sharedData->newColor = 0;
-    sharedData->newRound = 0;
-    //Allocate space for one player
-    sharedData->playerArray = malloc(__SIZEOF_POINTER__);
-
-    //Array of threads
-    pthread_t tid[1];
+    // Everything from here on is passed again to a new server in a hot restart
+    server.arguments = endpoints;
+    server.numArguments = numServers;
 
-    struct sockaddr_in client_address;
-    socklen_t client_address_size;
-    char client_presentation[INET_ADDRSTRLEN];
-    // Get the size of the structure to store client information
-    client_address_size = sizeof client_address;
-
-    //Server waits for first player to  connect
-    //Allocate player struct
-    sharedData->playerArray[sharedData->playersConnected] = malloc(sizeof(player_t));
-
-    //Connect with the first client
-    sharedData->playerArray[sharedData->playersConnected]->client_fd = accept(sharedData->server_fd, (struct sockaddr *)&client_address, &client_address_size);
-    if (sharedData->playerArray[sharedData->playersConnected]->client_fd == -1)
+    // Supervisor mode, the games are run by worker processes
+    if (argc > 2 && strcmp(argv[1], "-w") == 0)
     {
-        fatalError("accept");
+        numWorkers = atoi(argv[2]);
+        numServers -= 2;
+        endpoints += 2;
+        if (numWorkers < 1 || numWorkers > MAX_WORKERS)
+        {
+            usage(argv[0]);
+        }
     }
 
-    // Get the data from the client
-    inet_ntop(client_address.sin_family, &client_address.sin_addr, client_presentation, sizeof client_presentation);
-    printf("Received incomming connection from %s on port %d\n", client_presentation, client_address.sin_port);
-
-    //Communication for the first player to set up the game
-    setupGame(sharedData);
+    // Tournament mode, every roster formed plays a tournament
+    if (numServers > 2 && strcmp(endpoints[0], "-t") == 0)
+    {
+        if (!parseTournament(endpoints[1]))
+        {
+            usage(argv[0]);
+        }
+        numServers -= 2;
+        endpoints += 2;
+    }
 
-    printf("playersexpected: %d\n", sharedData->playersExpected);
+    // Endurance mode, the sequences of the games are kept in files
+    if (numServers > 2 && strcmp(endpoints[0], "-e") == 0)
+    {
+        sequence_store_t store;
 
-    sharedData->playersConnected++;
+        if (!openSequence(&store, endpoints[1]))
+        {
+            fprintf(stderr, "ERROR: can't keep sequences in %s\n", endpoints[1]);
+            exit(EXIT_FAILURE);
+        }
+        closeSequence(&store);
+        enduranceDirectory = endpoints[1];
+        numServers -= 2;
+        endpoints += 2;
+    }
 
-    //Server loops for the other expected players.
-    while (sharedData->playersConnected < sharedData->playersExpected)
+    // Stats of the players, kept by the process running the games
+    // The worker processes would all write the same file
+    if (numServers > 2 && strcmp(endpoints[0], "-s") == 0)
     {
-        //Allocate player struct
-        sharedData->playerArray[sharedData->playersConnected] = malloc(sizeof(player_t));
+        if (numWorkers > 0)
+        {
+            usage(argv[0]);
+        }
+        statsPath = endpoints[1];
+        numServers -= 2;
+        endpoints += 2;
+    }
 
-        sharedData->playerArray[sharedData->playersConnected]->client_fd = accept(sharedData->server_fd, (struct sockaddr *)&client_address, &client_address_size);
-        if (sharedData->playerArray[sharedData->playersConnected]->client_fd == -1)
+    // Summaries of the games, written as batches by the process running the games
+    if (numServers > 2 && strcmp(endpoints[0], "-g") == 0)
+    {
+        if (numWorkers > 0)
         {
-            fatalError("accept");
+            usage(argv[0]);
         }
+        analyticsPath = endpoints[1];
+        numServers -= 2;
+        endpoints += 2;
+    }
 
-        sharedData->playersConnected++;
+    // Placement of the games on the cores, and of the worker processes on the NUMA nodes
+    placement.enabled = 0;
+    if (numServers > 2 && strcmp(endpoints[0], "-a") == 0)
+    {
+        if (!initPlacement(&placement, endpoints[1]))
+        {
+            usage(argv[0]);
+        }
+        numServers -= 2;
+        endpoints += 2;
+    }
 
-        // Get the data from the client
-        inet_ntop(client_address.sin_family, &client_address.sin_addr, client_presentation, sizeof client_presentation);
-        printf("Received incomming connection from %s on port %d\n", client_presentation, client_address.sin_port);
+    // Limits on the connections per second, for everybody and for every address
+    if (numServers > 2 && strcmp(endpoints[0], "-l") == 0)
+    {
+        limits = endpoints[1];
+        numServers -= 2;
+        endpoints += 2;
+    }
+    initAdmission(&server.admission, ADMISSION_RATE, ADMISSION_ADDRESS_RATE);
+    if (limits != NULL && !parseAdmission(&server.admission, limits))
+    {
+        usage(argv[0]);
     }
 
-    // Create threads for the server connection
-    for (int i = 0; i < sharedData->playersExpected; i++)
+    // Control socket, only local, for the process running the games
+    if (numServers > 2 && strcmp(endpoints[0], "-c") == 0)
     {
-        if (pthread_create(&tid[i], NULL, &attendClient, sharedData) == -1)
+        if (numWorkers > 0 || !isUnixEndpoint(endpoints[1]))
         {
-            fprintf(stderr, "ERROR: pthread_create\n");
-            exit(EXIT_FAILURE);
+            usage(argv[0]);
         }
+        adminEndpoint = endpoints[1];
+        numServers -= 2;
+        endpoints += 2;
     }
+    defaultConfig(&config);
+    config.rate = server.admission.global.rate;
+    config.addressRate = server.admission.addressRate;
+    initConfig(&server.config, &config);
+    server.admin_fd = -1;
 
-    //Wait for threads to finish
-    for (int i = 0; i < sharedData->playersExpected; i++)
+    // Check the correct arguments
+    if (numServers < 1 || numServers > MAX_LISTENERS)
     {
-        pthread_join(tid[i], NULL);
+        usage(argv[0]);
     }
-    
-    //Free Memory
-    freeAll(sharedData);
-}
 
-/*
-    Thread with game logic
-*/
-void *attendClient(void *arg)
-{
-    thread_data_t *sharedData = (thread_data_t *)arg;
+    server.server_fds = server_fds;
+    server.transports = transports;
+    server.numServers = numServers;
+    server.supervisor_fd = -1;
+    server.finished = 0;
+    server.program = argv[0];
+    server.statsPath = statsPath;
+    server.analyticsPath = analyticsPath;
 
-    //Assign an individual client to the thread
-    pthread_mutex_lock(&mutex1);
-    int playerID = sharedData->playerID;
-    sharedData->playerID++;
-    pthread_mutex_unlock(&mutex1);
+    if (handoff_fd == -1)
+    {
+        // Show the IPs assigned to this computer
+        printLocalIPs();
 
-    //Allocate the structure to send to the client
-    sharedData->playerArray[playerID]->clientData = malloc(sizeof(socketCommunication_t));
+        // Start the server, one listener for each endpoint given
+        for (int i = 0; i < numServers; i++)
+        {
+            server_fds[i] = listenEndpoint(endpoints[i], MAX_QUEUE);
+            transports[i] = endpointTransport(endpoints[i]);
+        }
+    }
 
+    //setupHandlers();
 
-    //Prepare data for first send()
-    sharedData->playerArray[playerID]->clientData->playerState = PWAIT;
-    sharedData->playerArray[sharedData->playerTurn]->clientData->playerState = PACTIVE; 
-    sharedData->playerArray[playerID]->clientData->gameState = GACTIVE;
-    sharedData->playerArray[playerID]->clientData->newColor = 0;
-    sharedData->playerArray[playerID]->clientData->color = 0;
-    sharedData->gameState = GACTIVE;
-    //Player is not yet marked "kicked out" and the beginning of the game
-    sharedData->playerArray[playerID]->isOut = 1;
-    //Default is: not ready to send
-    sharedData->sentTo = -1;
-    //Initialize color array
-    sharedData->colorSequence = malloc(sizeof(int));
+    // Report of the locks on SIGUSR1, only in a build with LOCK_PROFILE
+    startLockReport();
 
-    //Initial sending, the game begins
-    send(sharedData->playerArray[playerID]->client_fd, sharedData->playerArray[playerID]->clientData, sizeof(socketCommunication_t), 0);
+    if (numWorkers > 0)
+    {
+        runSupervisor(server_fds, transports, numServers, numWorkers, &server.admission, runWorker);
+    }
 
-    //Variable to iterate through the colorSequence array
-    int index = 0;
+    // Hot restarts are done by the process running the games, with SIGUSR2
+    initHotRestart(&server);
 
-    //START GAME LOOP
-    while (sharedData->gameState == GACTIVE && (checkIfWinner(sharedData, playerID) != 0))
+    // Results can be queued at once, the store is opened once the old server closed it
+    server.statsQueue = NULL;
+    if (statsPath != NULL)
     {
-        //For the active player
-        if (sharedData->playerArray[playerID]->clientData->playerState == PACTIVE)
-        {   
-            //Checks if next send() will come with a new round
-            if(index == sharedData->sequenceSize)
-            {
-                sharedData->newRound = 1;
-            }
-            else
-            {
-                sharedData->newRound = 0;
-            }
-
-            //If it's the first color to add or a new color for the array, we will enter here
-            if (sharedData->sequenceSize == index)
-            {
-                addColor(sharedData, playerID, index);
-                //Now it's another player's turn
-                whoseTurn(sharedData, playerID);
-
-                //Reset colorSequence index counter
-                index = 0;
-                //Reset newColor variable
-                sharedData->newColor = 0;
-            }
-            else
-            {
-                //If the index already has a color, enter here
-                compareColors(sharedData, playerID, index);
-                index++;   
-                //Check if player is about to enter last color to be compared
-                if (index == sharedData->sequenceSize)
-                {
-                    sharedData->newColor = 1;
-                }
-            }
+        server.statsQueue = malloc(sizeof(mpsc_queue_t));
+        initMpscQueue(server.statsQueue, STATS_QUEUE_SIZE, sizeof(stats_result_t));
+    }
+    server.analyticsQueue = NULL;
+    if (analyticsPath != NULL)
+    {
+        server.analyticsQueue = malloc(sizeof(mpsc_queue_t));
+        initMpscQueue(server.analyticsQueue, ANALYTICS_QUEUE_SIZE, sizeof(analytics_record_t));
+    }
 
-            //Now ready to prepare the results of this round
-            pthread_mutex_lock(&mutex2);
-            sharedData->sentTo = 0;
-            //Send signal to waiting clients
-            for(int i = 0; i < (sharedData->playersConnected - 1); i++)
-            {
-                pthread_cond_signal(&cond);
-            }
-            pthread_mutex_unlock(&mutex2);
-        }
+    // The listeners, the games and the clients waiting come from the old server
+    initPending(&server.pending);
+    if (handoff_fd != -1)
+    {
+        receiveState(&server, handoff_fd);
+    }
+    startAdmission(&server);
 
-        //Make clients wait for the readiness of the data to be sent
-        pthread_mutex_lock(&mutex2);
-        while (sharedData->sentTo < 0)
-        {
-            //Block while until signal comes from active player thread
-            pthread_cond_wait(&cond, &mutex2);
-        }
-        
-        //Prepare data for the client
-        sharedData->playerArray[playerID]->clientData->color = sharedData->color;
-        sharedData->playerArray[playerID]->clientData->wrongColor = sharedData->wrongColor;
-        sharedData->playerArray[playerID]->clientData->newColor = sharedData->newColor;
-        sharedData->playerArray[playerID]->clientData->newRound = sharedData->newRound;
-        pthread_mutex_unlock(&mutex2);
+    // The control socket comes from the old server too, unless it had none
+    if (adminEndpoint != NULL && server.admin_fd == -1)
+    {
+        server.admin_fd = listenEndpoint(adminEndpoint, ADMIN_QUEUE);
+    }
+    if (server.admin_fd != -1 && pthread_create(&server.adminThread, NULL, &adminThread, &server) != 0)
+    {
+        fprintf(stderr, "ERROR: pthread_create\n");
+        exit(EXIT_FAILURE);
+    }
 
-        //Check if player is Winner!
-        if (checkIfWinner(sharedData, playerID) == 0)
-        {
-            printf("Nr %d: WIN!\n", playerID);
-        }
+    if (statsPath != NULL)
+    {
+        startStats(&server);
+    }
+    if (analyticsPath != NULL)
+    {
+        startAnalytics(&server);
+    }
 
-        //Data is sent to all clients
-        send(sharedData->playerArray[playerID]->client_fd, sharedData->playerArray[playerID]->clientData, sizeof(socketCommunication_t), 0);
-        
-        //sentTo variable controls that everyone has got an update
-        pthread_mutex_lock(&mutex2);
-        sharedData->sentTo++;
-        pthread_mutex_unlock(&mutex2);
+    // Listen for connections from the clients
+    waitForConnections(&server);
 
-        printf("Update sent to player %d , sentTo = %d\n", playerID, sharedData->sentTo);
+    // Only reached in a hot restart, the new server owns the sockets now
+    // The restart thread ends the process once everything was handed over
+    pthread_exit(NULL);
+}
 
-        //Last thread updates the checking variable and informs other threads to go on
-        pthread_mutex_lock(&mutex2);
-        if (sharedData->sentTo == sharedData->playersConnected)
-        {
-            //Reset synchronization variable
-            sharedData->sentTo = -1;
-            //Signal to all threads that the synchronization variable has been changed
-            for (int i = 0; i < (sharedData->playersConnected - 1); i++)
-            {
-                pthread_cond_signal(&cond);
-            }
+///// FUNCTION DEFINITIONS
 
-            printf("sentTo resettet!\n");
-        }
-        pthread_mutex_unlock(&mutex2);
+/*
+    Explanation to the user of the parameters required to run the program
+*/
+void usage(char *program)
+{
+    printf("Usage:\n");
+    printf("\t%s [-w workers] [-t {bracket | swiss}:players] [-e sequence_directory] [-s stats_file] [-g analytics_directory] [-a cores] [-l rate:per_address] [-c unix:admin_socket] {port_number | tls:port_number | unix:/path | unix:@name | shm:/path | shm:@name} ...\n", program);
+    printf("\t-w: accept in a supervisor process and run the games in the given number of worker processes\n");
+    printf("\t-t: the number of players chosen by the first player is the roster of a tournament,\n");
+    printf("\t    played in matches of the given number of players (at least 2)\n");
+    printf("\t-e: endurance mode, the color sequences are kept in files in the given directory, for very long games\n");
+    printf("\t-s: keep the stats of the players in the given file (not with -w)\n");
+    printf("\t-g: write summaries of the games and the players in batch files to the given directory (not with -w)\n");
+    printf("\t-a: run every game on one core of the list (\"all\" or like \"0-7,16-23\"),\n");
+    printf("\t    and every worker process on one NUMA node\n");
+    printf("\t-l: new connections per second for everybody and for every address, 0 for no limit (default %d:%d),\n", ADMISSION_RATE, ADMISSION_ADDRESS_RATE);
+    printf("\t    clients over the limits are told the server is full\n");
+    printf("\t-c: take commands on the given Unix endpoint, to see the state and change the settings (not with -w)\n");
+    printf("\tSend SIGUSR2 to restart the server from its program file without ending the games\n");
+    exit(EXIT_FAILURE);
+}
 
-        //Check if sentTo variable was resetted and if threads can go on with the playing loop
-        while (sharedData->sentTo > 0)
-        {
-            //Block thread until signal was received from last thread
-            pthread_mutex_lock(&mutex2);
-            pthread_cond_wait(&cond, &mutex2);
-            pthread_mutex_unlock(&mutex2);
-        }
+/*
+    Read the kind of tournament and the players of every match, as "bracket:4" or "swiss:4"
+    Returns 1 on success, or 0 if the option is not valid
+*/
+int parseTournament(char *option)
+{
+    char format[16];
 
-        //Kick out the loser
-        if (sharedData->playerArray[playerID]->clientData->playerState == LOSER)
-        {
-            pthread_mutex_lock(&mutex1);
-            sharedData->playersConnected--;
-            pthread_mutex_unlock(&mutex1);
-            //pthread_exit(NULL);
-            break;
-        }
+    if (sscanf(option, "%15[a-z]:%d", format, &playersPerMatch) != 2 || playersPerMatch < 2)
+    {
+        return 0;
     }
 
-    if (sharedData->gameState == END)
+    if (strcmp(format, "bracket") == 0)
+    {
+        tournamentFormat = TOURNAMENT_BRACKET;
+    }
+    else if (strcmp(format, "swiss") == 0)
     {
-        printf("Game ended!\n");
+        tournamentFormat = TOURNAMENT_SWISS;
+    }
+    else
+    {
+        return 0;
     }
 
-    pthread_exit(NULL);
+    return 1;
 }
 
 /*
-    Communication with first client to setup the number of players
+    Main function of a worker process in supervisor mode
+    The players come from the supervisor instead of the listeners
 */
-void setupGame(thread_data_t *sharedData)
+void runWorker(int supervisor_fd, int worker)
 {
-    socketCommunication_t clientData;
-    clientData.playerState = FIRST;
-    clientData.gameState = GWAIT;
-
-    send(sharedData->playerArray[0]->client_fd, &clientData, sizeof(socketCommunication_t), 0);
+    server_t server;
+    server_config_t config;
 
-    recv(sharedData->playerArray[0]->client_fd, &clientData, sizeof(socketCommunication_t), 0);
-    sharedData->playersExpected = clientData.playersExpected;
+    //Before any thread starts, so they all stay on the node
+    if (placement.enabled)
+    {
+        placeWorker(&placement, worker);
+    }
+    //The report thread of the supervisor was not forked
+    startLockReport();
+
+    server.server_fds = NULL;
+    server.transports = NULL;
+    server.numServers = 0;
+    server.supervisor_fd = supervisor_fd;
+    server.finished = 0;
+    //No hot restarts in worker processes
+    server.upgradePipe[0] = -1;
+    server.upgradePipe[1] = -1;
+    server.handoff_fd = -1;
+    initMutex(&server.handoffMutex, "handoffMutex");
+    initCond(&server.handoffCond, "handoffCond");
+    server.activeGames = 0;
+    server.forming = 0;
+    server.resumedGame = NULL;
+    server.statsQueue = NULL;
+    server.analyticsQueue = NULL;
+    //The settings of the workers can't be changed
+    defaultConfig(&config);
+    initConfig(&server.config, &config);
+    server.admin_fd = -1;
+
+    waitForConnections(&server);
+
+    //Let the games still running finish before the process ends
+    pthread_exit(NULL);
 }
 
 /*
-    Compares the player's color with the colorsequence at given index
+    Prepare the hot restart: block SIGUSR2 in every thread and start the thread that waits for it
+    Must be called before any other thread is created
 */
-int checkColor(thread_data_t *sharedData, int index)
+void initHotRestart(server_t *server)
 {
-    int result = 1;
+    sigset_t signals;
+    pthread_t tid;
 
-    if (sharedData->color == sharedData->colorSequence[index])
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR2);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    if (pipe2(server->upgradePipe, O_CLOEXEC) == -1)
     {
-        sharedData->wrongColor = 0;
-        result = 1;
+        fatalError("ERROR: pipe2");
     }
-    else if (sharedData->color != sharedData->colorSequence[index])
+    server->handoff_fd = -1;
+    initMutex(&server->handoffMutex, "handoffMutex");
+    initCond(&server->handoffCond, "handoffCond");
+    server->activeGames = 0;
+    server->forming = 1;
+    server->resumedGame = NULL;
+
+    if (pthread_create(&tid, NULL, &upgradeThread, server) != 0)
     {
-        sharedData->wrongColor = 1;
-        result = 0;
+        fprintf(stderr, "ERROR: pthread_create\n");
+        exit(EXIT_FAILURE);
     }
-    return result;
-
+    pthread_detach(tid);
 }
 
 /*
-    Increase the counter of turns taken and calculate the new active player, update status
+    Thread that waits for SIGUSR2 and hands everything over to a new copy of the server
+    Ends the process once the new server has the games and the listeners
 */
-void whoseTurn(thread_data_t *sharedData, int playerID)
-{    
-    int i = 0;
-
-    while (i < sharedData->playersExpected)
+void *upgradeThread(void *arg)
+{
+    server_t *server = (server_t *)arg;
+    sigset_t signals;
+    int signal;
+    char ready;
+    struct timespec start;
+    struct timespec end;
+    int clients[MAX_PASSED_FDS];
+    int clientTransports[MAX_PASSED_FDS];
+    int numClients;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR2);
+
+    while (1)
     {
-        sharedData->turnCounter++;
-        sharedData->playerTurn = sharedData->turnCounter % sharedData->playersExpected;
+        sigwait(&signals, &signal);
 
-        //If the player is still in the game
-        if (sharedData->playerArray[sharedData->playerTurn]->isOut == 1)
+        //The matches of a tournament depend on each other, they can't be handed over one by one
+        if (tournamentFormat != -1)
         {
-            //Desactivate status of current player
-            sharedData->playerArray[playerID]->clientData->playerState = PWAIT;
-            //Activate status of next player
-            sharedData->playerArray[sharedData->playerTurn]->clientData->playerState = PACTIVE;
+            printf("Hot restart: not possible while tournaments are played\n");
+            continue;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        printf("Hot restart: starting %s\n", server->program);
 
+        //Nothing is handed over until the new program is known to run
+        server->handoff_fd = startNewServer(server->program, server->arguments, server->numArguments);
+        if (recv(server->handoff_fd, &ready, 1, MSG_WAITALL) == 1)
+        {
             break;
         }
 
-        i++;
+        printf("Hot restart: the new server did not start, keeping this one\n");
+        close(server->handoff_fd);
+        server->handoff_fd = -1;
+        waitpid(-1, NULL, WNOHANG);
     }
-}
 
-/*
-    Checks if player is last one in the game and thus the winner
-*/
-int checkIfWinner(thread_data_t *sharedData, int playerID)
-{
-    //Player wins when he is the last one standing, except when he plays alone, then he cant win
-    if (sharedData->playersExpected != 1 && (sharedData->playersExpected - sharedData->losers == 1) && sharedData->playerArray[playerID]->clientData->playerState != LOSER)
+    //Everybody waiting for a client stops and hands its game over
+    lockMutex(&server->handoffMutex);
+    if (write(server->upgradePipe[1], "U", 1) != 1)
     {
-        sharedData->playerArray[playerID]->clientData->playerState = WINNER;
-        sharedData->gameState = END;
-        sharedData->playerArray[playerID]->clientData->gameState = END;
-        return 0;
+        fatalError("ERROR: write");
+    }
+    //The main thread may be waiting to form a game
+    broadcastCond(&server->handoffCond);
+    while (server->activeGames > 0 || server->forming)
+    {
+        waitCond(&server->handoffCond, &server->handoffMutex);
     }
 
-    return 1;
-}
+    //No more results here, the new server opens the stats after the listeners
+    if (server->statsQueue != NULL)
+    {
+        stopStats(server);
+    }
+    //The batches being filled are written, the new server starts files of its own
+    if (server->analyticsQueue != NULL)
+    {
+        stopAnalytics(server);
+    }
 
-/*
-    Add a new color to the colorSequence array and update status and tags
-*/
-void addColor(thread_data_t *sharedData, int playerID, int index)
-{
-    recv(sharedData->playerArray[playerID]->client_fd, sharedData->playerArray[playerID]->clientData, sizeof(socketCommunication_t), 0);
-    sharedData->color = sharedData->playerArray[playerID]->clientData->color;
+    //The clients accepted that no game took yet go with their transports
+    pthread_join(server->admissionThread, NULL);
+    while ((numClients = drainClients(&server->pending, clients, clientTransports, MAX_PASSED_FDS)) > 0)
+    {
+        sendHandoff(server->handoff_fd, HANDOFF_CLIENTS, clientTransports, numClients * sizeof(int), clients, numClients);
+        for (int i = 0; i < numClients; i++)
+        {
+            close(clients[i]);
+        }
+    }
 
-    //If it is not the first color, reallocate the memory of colorSequence[]
-    if (index != 0)
+    //The settings go with the control socket, after the last command
+    if (server->admin_fd != -1)
     {
-        sharedData->colorSequence = realloc(sharedData->colorSequence, sizeof(int));
+        pthread_join(server->adminThread, NULL);
+        sendHandoff(server->handoff_fd, HANDOFF_ADMIN, readConfig(&server->config), sizeof(server_config_t), &server->admin_fd, 1);
     }
 
-    sharedData->colorSequence[index] = sharedData->color;
-    sharedData->sequenceSize++;
-    sharedData->wrongColor = 0;
-    sharedData->playerArray[playerID]->clientData->wrongColor = 0;
-    sharedData->playerArray[playerID]->clientData->playerState = PWAIT;
+    //The listeners go last, until now this server kept accepting
+    sendHandoff(server->handoff_fd, HANDOFF_LISTENERS, server->transports, server->numServers * sizeof(int), server->server_fds, server->numServers);
+    sendHandoff(server->handoff_fd, HANDOFF_END, NULL, 0, NULL, 0);
+    unlockMutex(&server->handoffMutex);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("Hot restart: handed over in %.3f ms\n", (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1000000.0);
+
+    exit(EXIT_SUCCESS);
 }
 
 /*
-    Receives color from active player, and evaluates its comparison
+    Send a game to the new server in a hot restart, with the sockets of its players
+    The threads of the game leave it afterwards, without closing the connections
 */
-void compareColors(thread_data_t *sharedData, int playerID, int index)
+void handOffGame(thread_data_t *sharedData)
 {
-    recv(sharedData->playerArray[playerID]->client_fd, sharedData->playerArray[playerID]->clientData, sizeof(socketCommunication_t), 0);
-    sharedData->color = sharedData->playerArray[playerID]->clientData->color;
-
-    //If the return value of checkColor is 0, the player had remembered the wrong color
-    if (checkColor(sharedData, index) == 0)
+    server_t *server = sharedData->server;
+    int numPlayers = sharedData->gameState == GACTIVE ? sharedData->playersExpected : sharedData->playersConnected;
+    game_record_t *game = malloc(sizeof(game_record_t));
+    player_record_t player;
+    connection_t *connection;
+    int fds[2];
+
+    game->gameState = sharedData->gameState;
+    game->playersExpected = sharedData->playersExpected;
+    game->playersConnected = sharedData->playersConnected;
+    game->playerTurn = sharedData->game.playerTurn;
+    game->turnCounter = sharedData->game.turnCounter;
+    game->losers = sharedData->game.losers;
+    game->sequenceSize = sharedData->game.sequenceSize;
+    game->index = sharedData->game.index;
+    game->color = sharedData->update.color;
+    game->wrongColor = sharedData->update.wrongColor;
+    game->newColor = sharedData->update.newColor;
+    game->newRound = sharedData->update.newRound;
+    game->numPlayers = numPlayers;
+
+    //Records of different games must not mix on the channel
+    lockMutex(&server->handoffMutex);
+    sendHandoff(server->handoff_fd, HANDOFF_GAME, game, sizeof(game_record_t), NULL, 0);
+    //The sequence follows a chunk at a time, straight from where it is kept
+    for (int first = 0; first < sharedData->game.sequenceSize; first += SEQUENCE_CHUNK)
     {
-        //Calculate whose' turn is it next
-        whoseTurn(sharedData, playerID);
-        sharedData->playerArray[playerID]->clientData->playerState = LOSER;
-        sharedData->playerArray[playerID]->isOut = 0;
-        sharedData->losers++;
-        sharedData->newColor = 0;
-        sharedData->newRound = 1;
+        int colors = sharedData->game.sequenceSize - first < SEQUENCE_CHUNK ? sharedData->game.sequenceSize - first : SEQUENCE_CHUNK;
+
+        if (sharedData->sequenceStore != NULL)
+        {
+            followSequence(sharedData->sequenceStore, first);
+        }
+        sendHandoff(server->handoff_fd, HANDOFF_SEQUENCE, sharedData->game.sequence + first, colors * sizeof(int), NULL, 0);
+    }
+    for (int i = 0; i < numPlayers; i++)
+    {
+        bzero(&player, sizeof player);
+        if (sharedData->game.playerStates != NULL)
+        {
+            player.state = sharedData->game.playerStates[i];
+        }
+        player.clientData = sharedData->players.clientData[i];
+        player.id = sharedData->players.ids[i];
+
+        connection = &sharedData->players.connections[i];
+        fds[0] = connection->fd;
+        if (connection->shm != NULL)
+        {
+            fds[1] = connection->shm->memory_fd;
+        }
+        sendHandoff(server->handoff_fd, HANDOFF_PLAYER, &player, sizeof player, fds, connection->shm != NULL ? 2 : 1);
+    }
+    unlockMutex(&server->handoffMutex);
+
+    free(game);
+
+    //Let the other threads of the game go
+    lockMutex(&sharedData->mutex2);
+    sharedData->handedOff = 1;
+    broadcastCond(&sharedData->cond);
+    unlockMutex(&sharedData->mutex2);
+}
+
+/*
+    Receive a game from the old server in a hot restart
+    'size' is the size of the record of the game
+    Returns the data for the game, ready to be started or to continue forming
+*/
+thread_data_t *receiveGame(server_t *server, int handoff_fd, game_record_t *game, int size)
+{
+    thread_data_t *sharedData = newGame(server);
+    handoff_header_t header;
+    player_record_t *player;
+    int fds[MAX_PASSED_FDS];
+    int slots = game->playersExpected > game->numPlayers ? game->playersExpected : game->numPlayers;
+
+    sharedData->resumed = 1;
+    sharedData->gameState = game->gameState;
+    sharedData->playersExpected = game->playersExpected;
+    sharedData->playersConnected = game->playersConnected;
+    //A game that is still being formed gets its rules when it starts
+    if (game->gameState == GACTIVE)
+    {
+        sharedData->game.players = game->playersExpected;
+        sharedData->game.playerStates = malloc(game->playersExpected * sizeof(int));
+        sharedData->game.gameState = GACTIVE;
+        sharedData->game.winner = -1;
+        sharedData->game.playerTurn = game->playerTurn;
+        sharedData->game.turnCounter = game->turnCounter;
+        sharedData->game.losers = game->losers;
+        sharedData->game.sequence = newSequence(sharedData, &sharedData->game.capacity);
+        sharedData->game.sequenceSize = game->sequenceSize;
+        sharedData->game.index = game->index;
+        receiveSequence(sharedData, handoff_fd, game, size);
+    }
+    sharedData->update.color = game->color;
+    sharedData->update.wrongColor = game->wrongColor;
+    sharedData->update.newColor = game->newColor;
+    sharedData->update.newRound = game->newRound;
+
+    growPlayerTable(&sharedData->players, slots > 0 ? slots : 1);
+
+    for (int i = 0; i < game->numPlayers; i++)
+    {
+        if (!recvHandoff(handoff_fd, &header, (void **)&player, fds) || header.type != HANDOFF_PLAYER || header.numFds < 1)
+        {
+            fatalError("ERROR: receiving a player from the old server");
+        }
+
+        if (sharedData->game.playerStates != NULL && i < game->playersExpected)
+        {
+            sharedData->game.playerStates[i] = player->state;
+        }
+        sharedData->players.clientData[i] = player->clientData;
+        sharedData->players.ids[i] = player->id;
+        if (!adoptConnection(&sharedData->players.connections[i], fds[0], header.numFds > 1 ? fds[1] : -1))
+        {
+            fatalError("ERROR: adopting a player from the old server");
+        }
+
+        free(player);
+    }
+
+    //The players still in the game follow from their states
+    if (sharedData->game.playerStates != NULL)
+    {
+        fredRestore(&sharedData->game, malloc(FRED_ALIVE_WORDS(sharedData->game.players) * sizeof(uint64_t)));
+    }
+
+    return sharedData;
+}
+
+/*
+    Receive the color sequence of a running game from the old server, a chunk at a time
+    An older server sends it in the record of the game instead, of 'size' bytes
+*/
+void receiveSequence(thread_data_t *sharedData, int handoff_fd, game_record_t *game, int size)
+{
+    fred_game_t *rules = &sharedData->game;
+    handoff_header_t header;
+    void *chunk;
+    int fds[MAX_PASSED_FDS];
+    int received = 0;
+
+    //Space for the whole sequence first, on the heap if the file can't have it
+    if (sharedData->sequenceStore != NULL)
+    {
+        while (sharedData->sequenceStore->capacity < game->sequenceSize)
+        {
+            if (!extendSequence(sharedData->sequenceStore))
+            {
+                break;
+            }
+        }
+        rules->capacity = sharedData->sequenceStore->capacity;
+        if (rules->capacity < game->sequenceSize)
+        {
+            sequenceToHeap(sharedData);
+        }
+    }
+    if (sharedData->sequenceStore == NULL && rules->capacity < game->sequenceSize)
+    {
+        rules->capacity = game->sequenceSize;
+        rules->sequence = realloc(rules->sequence, rules->capacity * sizeof(int));
+    }
+
+    //An older server sends it in the record of the game
+    if (size >= (int)sizeof(game_record_t) + game->sequenceSize * (int)sizeof(int) && game->sequenceSize > 0)
+    {
+        memcpy(rules->sequence, game + 1, game->sequenceSize * sizeof(int));
+        received = game->sequenceSize;
+    }
+
+    while (received < game->sequenceSize)
+    {
+        if (!recvHandoff(handoff_fd, &header, &chunk, fds) || header.type != HANDOFF_SEQUENCE || header.size <= 0 ||
+            header.size % sizeof(int) != 0 || header.size / (int)sizeof(int) > game->sequenceSize - received)
+        {
+            fatalError("ERROR: receiving a sequence from the old server");
+        }
+
+        if (sharedData->sequenceStore != NULL)
+        {
+            followSequence(sharedData->sequenceStore, received);
+        }
+        memcpy(rules->sequence + received, chunk, header.size);
+        received += header.size / sizeof(int);
+        free(chunk);
+    }
+
+    if (sharedData->sequenceStore != NULL)
+    {
+        followSequence(sharedData->sequenceStore, rules->index);
+    }
+}
+
+/*
+    Receive the games, the clients waiting, the settings and the listeners from the old server in a hot restart
+    The running games are started again, a game that was being formed is kept for formGame
+*/
+void receiveState(server_t *server, int handoff_fd)
+{
+    handoff_header_t header;
+    thread_data_t *sharedData = NULL;
+    void *data = NULL;
+    int fds[MAX_PASSED_FDS];
+    int games = 0;
+    server_config_t settings;
+
+    while (1)
+    {
+        if (!recvHandoff(handoff_fd, &header, &data, fds))
+        {
+            fatalError("ERROR: old server is gone");
+        }
+
+        if (header.type == HANDOFF_END)
+        {
+            free(data);
+            break;
+        }
+
+        if (header.type == HANDOFF_GAME && header.size >= (int)sizeof(game_record_t))
+        {
+            sharedData = receiveGame(server, handoff_fd, (game_record_t *)data, header.size);
+            if (sharedData->gameState == GACTIVE)
+            {
+                startGame(sharedData);
+                games++;
+            }
+            else
+            {
+                server->resumedGame = sharedData;
+            }
+        }
+        else if (header.type == HANDOFF_LISTENERS && header.numFds <= MAX_LISTENERS)
+        {
+            server->numServers = header.numFds;
+            for (int i = 0; i < header.numFds; i++)
+            {
+                server->server_fds[i] = fds[i];
+                server->transports[i] = ((int *)data)[i];
+            }
+        }
+        else if (header.type == HANDOFF_ADMIN && header.size == (int)sizeof(server_config_t) && header.numFds == 1)
+        {
+            settings = *(server_config_t *)data;
+            server->admin_fd = fds[0];
+        }
+        else if (header.type == HANDOFF_CLIENTS && header.size == header.numFds * (int)sizeof(int))
+        {
+            for (int i = 0; i < header.numFds; i++)
+            {
+                pushClient(&server->pending, fds[i], ((int *)data)[i]);
+            }
+        }
+
+        free(data);
+    }
+
+    //Applied once the listeners are here
+    if (server->admin_fd != -1)
+    {
+        changeConfig(server, &settings);
+    }
+
+    close(handoff_fd);
+    printf("Hot restart: resumed %d games\n", games);
+}
+
+/*
+    Main loop to wait for incomming connections
+    Every game runs in its own thread, so the next one can be formed meanwhile
+    Returns only when there are no more players to receive,
+    the games still running are finished by their own threads
+*/
+void waitForConnections(server_t *server)
+{
+    thread_data_t *sharedData = NULL;
+    const server_config_t *config;
+
+    while (!server->finished)
+    {
+        //No new game while draining or with the most games running, until a hot restart begins
+        lockMutex(&server->handoffMutex);
+        while (server->handoff_fd == -1)
+        {
+            config = readConfig(&server->config);
+            if (!config->draining && (config->maxGames == 0 || server->activeGames < config->maxGames))
+            {
+                break;
+            }
+            waitCond(&server->handoffCond, &server->handoffMutex);
+        }
+        unlockMutex(&server->handoffMutex);
+
+        sharedData = formGame(server);
+        if (sharedData != NULL && tournamentFormat != -1)
+        {
+            startTournament(sharedData);
+        }
+        else if (sharedData != NULL)
+        {
+            startGame(sharedData);
+        }
+    }
+
+    //In a hot restart the restart thread can finish now
+    lockMutex(&server->handoffMutex);
+    server->forming = 0;
+    broadcastCond(&server->handoffCond);
+    unlockMutex(&server->handoffMutex);
+}
+
+/*
+    Initialize the data shared by the threads of a new game
+*/
+thread_data_t *newGame(server_t *server)
+{
+    thread_data_t *sharedData = NULL;
+    sharedData = malloc(sizeof(thread_data_t));
+    sharedData->server = server;
+    sharedData->gameID = __atomic_fetch_add(&gamesCreated, 1, __ATOMIC_RELAXED);
+    initMutex(&sharedData->mutex1, "mutex1");
+    initMutex(&sharedData->mutex2, "mutex2");
+    initCond(&sharedData->cond, "cond");
+    sharedData->threadsRunning = 0;
+    sharedData->playersExpected = 0;
+    sharedData->playersConnected = 0;
+    sharedData->playerID = 0;
+    sharedData->gameState = GWAIT;
+    //The rules are started with the game, once the number of players is known
+    bzero(&sharedData->game, sizeof(fred_game_t));
+    bzero(&sharedData->update, sizeof(fred_update_t));
+    //Default is: not ready to send
+    sharedData->sentTo = -1;
+    sharedData->broadcastRound = 0;
+    sharedData->resumed = 0;
+    sharedData->handedOff = 0;
+    sharedData->tournament = NULL;
+    sharedData->firstSeat = 0;
+    sharedData->sequenceStore = NULL;
+    //Allocate space for one player
+    initPlayerTable(&sharedData->players);
+    growPlayerTable(&sharedData->players, 1);
+
+    return sharedData;
+}
+
+/*
+    Connect the players for a new game
+    A game left half formed by the old server in a hot restart is continued first
+    Returns the data for the game, or NULL if the game could not be formed
+*/
+thread_data_t *formGame(server_t *server)
+{
+    thread_data_t *sharedData = server->resumedGame;
+    int setup;
+
+    if (sharedData == NULL)
+    {
+        sharedData = newGame(server);
+    }
+    server->resumedGame = NULL;
+
+    //Server waits for first player to  connect
+    if (sharedData->playersConnected == 0)
+    {
+        //Connect with the first client
+        if (!acceptPlayer(server, &sharedData->players.connections[0], &sharedData->players.ids[0]))
+        {
+            freeAll(sharedData);
+            return NULL;
+        }
+
+        sharedData->playersConnected++;
+    }
+
+    //Communication for the first player to set up the game
+    //If the first player leaves during the setup, the game is dropped
+    if (sharedData->playersExpected == 0)
+    {
+        setup = setupGame(sharedData);
+        if (setup == -1)
+        {
+            handOffGame(sharedData);
+            server->finished = 1;
+            sharedData->playersExpected = sharedData->playersConnected;
+            freeAll(sharedData);
+            return NULL;
+        }
+        if (setup == 0)
+        {
+            if (logging(server, LOG_INFO))
+            {
+                printf("Game setup failed\n");
+            }
+            if (server->supervisor_fd != -1)
+            {
+                reportToSupervisor(server->supervisor_fd, REPORT_FORMED, 1);
+                reportToSupervisor(server->supervisor_fd, REPORT_FINISHED, 1);
+            }
+            sharedData->playersExpected = 1;
+            freeAll(sharedData);
+            return NULL;
+        }
+
+        if (logging(server, LOG_INFO))
+        {
+            printf("playersexpected: %d\n", sharedData->playersExpected);
+        }
+
+        //Now the size of the game is known, make space for every player
+        growPlayerTable(&sharedData->players, sharedData->playersExpected);
+    }
+
+    //From here on a resumed game is formed and started like any other
+    sharedData->resumed = 0;
+
+    //Server loops for the other expected players.
+    while (sharedData->playersConnected < sharedData->playersExpected)
+    {
+        if (!acceptPlayer(server, &sharedData->players.connections[sharedData->playersConnected], &sharedData->players.ids[sharedData->playersConnected]))
+        {
+            //In a hot restart the players already connected go to the new server
+            if (server->handoff_fd != -1)
+            {
+                handOffGame(sharedData);
+            }
+            //No more players will come, the ones already connected are released
+            sharedData->playersExpected = sharedData->playersConnected;
+            freeAll(sharedData);
+            return NULL;
+        }
+
+        sharedData->playersConnected++;
+    }
+
+    //The supervisor can send the next players to any worker now
+    if (server->supervisor_fd != -1)
+    {
+        reportToSupervisor(server->supervisor_fd, REPORT_FORMED, sharedData->playersExpected);
+    }
+
+    return sharedData;
+}
+
+/*
+    Take the next player accepted by the admission thread, or receive it from the supervisor
+    Clients of shared memory listeners hand over their region before they count as connected,
+    and every client sends its ID, each step within the handshake timeout of the configuration
+    The connection is stored in 'connection' and the ID in 'id'
+    Returns 1 on success, or 0 if the supervisor is gone, a hot restart has begun or the server is draining
+*/
+int acceptPlayer(server_t *server, connection_t *connection, int *id)
+{
+    int connected = 0;
+    int client_fd;
+    int transport;
+    int timeout;
+
+    while (!connected)
+    {
+        if (server->supervisor_fd != -1)
+        {
+            client_fd = recvClient(server->supervisor_fd, &transport);
+            if (client_fd == -1)
+            {
+                server->finished = 1;
+                return 0;
+            }
+        }
+        else
+        {
+            //A draining server lets go of the game being formed, but goes on
+            client_fd = popClient(&server->pending, &transport);
+            if (client_fd == -1)
+            {
+                server->finished = server->pending.closed;
+                return 0;
+            }
+        }
+
+        //A client that doesn't go on with its setup would hold up the game being formed, TLS
+        //handshakes have their own timeout
+        timeout = readConfig(&server->config)->handshakeTimeout * 1000;
+        if (transport == TRANSPORT_SHM && !waitSocket(client_fd, timeout))
+        {
+            close(client_fd);
+        }
+        else
+        {
+            connected = openConnection(connection, client_fd, transport);
+        }
+        if (connected)
+        {
+            connected = receiveID(server, connection, id, timeout);
+            if (connected == 1)
+            {
+                FRED_PROBE2(accept, connection->fd, *id);
+            }
+            if (connected != 1)
+            {
+                shutConnection(connection);
+            }
+            //The client is dropped, it hadn't joined any game yet
+            if (connected == -1)
+            {
+                server->finished = 1;
+                return 0;
+            }
+        }
+
+        //A shared memory client that left during the setup still counts for the supervisor
+        if (!connected && server->supervisor_fd != -1)
+        {
+            reportToSupervisor(server->supervisor_fd, REPORT_FORMED, 1);
+            reportToSupervisor(server->supervisor_fd, REPORT_FINISHED, 1);
+        }
+    }
+
+    return 1;
+}
+
+/*
+    Receive the ID a client sends first, which its stats are kept under
+    Returns 1 on success, 0 if the client left or didn't send it within 'milliseconds',
+    or -1 if a hot restart began while waiting
+*/
+int receiveID(server_t *server, connection_t *connection, int *id, int milliseconds)
+{
+    //Worker processes have no upgrade pipe, poll skips it
+    int ready = waitReadable(connection, server->upgradePipe[0], milliseconds);
+
+    //Woken for the hot restart, or the time ran out
+    if (ready != 1)
+    {
+        return ready == 0 ? -1 : 0;
+    }
+
+    return recvMessage(connection, id, sizeof(int));
+}
+
+/*
+    Prepare the state of every player and start a thread for each of them
+*/
+void startGame(thread_data_t *sharedData)
+{
+    pthread_t tid;
+    pthread_attr_t attributes;
+    int incoming[sharedData->playersExpected];
+    int core;
+
+    //The game goes where the packets of its players arrive
+    for (int i = 0; i < sharedData->playersExpected; i++)
+    {
+        incoming[i] = placement.enabled ? incomingCore(sharedData->players.connections[i].fd) : -1;
+    }
+    core = nextGameCore(&placement, incoming, sharedData->playersExpected);
+
+    //Counted, so a hot restart waits until the game was handed over
+    lockMutex(&sharedData->server->handoffMutex);
+    sharedData->server->activeGames++;
+    unlockMutex(&sharedData->server->handoffMutex);
+
+    //A game resumed after a hot restart is timed from here
+    sharedData->startTime = microseconds(CLOCK_REALTIME);
+    sharedData->startClock = microseconds(CLOCK_MONOTONIC);
+
+    //Start the rules, with space for one color to begin with
+    if (!sharedData->resumed)
+    {
+        int capacity;
+        int *sequence = newSequence(sharedData, &capacity);
+
+        fredStart(&sharedData->game, sharedData->playersExpected, malloc(sharedData->playersExpected * sizeof(int)),
+            malloc(FRED_ALIVE_WORDS(sharedData->playersExpected) * sizeof(uint64_t)), sequence, capacity);
+        sharedData->gameState = GACTIVE;
+    }
+
+    //Prepare data for first send()
+    for (int i = 0; i < sharedData->playersExpected && !sharedData->resumed; i++)
+    {
+        //Allocate the structure to send to the client
+        sharedData->players.clientData[i].playersExpected = sharedData->playersExpected;
+        sharedData->players.clientData[i].playerState = sharedData->game.playerStates[i];
+        sharedData->players.clientData[i].gameState = GACTIVE;
+        sharedData->players.clientData[i].newColor = 0;
+        sharedData->players.clientData[i].color = 0;
+        sharedData->players.clientData[i].wrongColor = 0;
+        sharedData->players.clientData[i].newRound = 0;
+    }
+
+    //All the players of the game on the same core
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+    pinThreads(&attributes, core);
+
+    //Nobody waits for the threads, the last one to finish ends the game
+    sharedData->threadsRunning = sharedData->playersExpected;
+    for (int i = 0; i < sharedData->playersExpected; i++)
+    {
+        if (pthread_create(&tid, &attributes, &attendClient, sharedData) != 0)
+        {
+            fprintf(stderr, "ERROR: pthread_create\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    pthread_attr_destroy(&attributes);
+}
+
+/*
+    Thread with game logic
+*/
+void *attendClient(void *arg)
+{
+    thread_data_t *sharedData = (thread_data_t *)arg;
+
+    //Assign an individual client to the thread
+    lockMutex(&sharedData->mutex1);
+    int playerID = sharedData->playerID;
+    sharedData->playerID++;
+    unlockMutex(&sharedData->mutex1);
+
+    //Entries of this player in the table
+    connection_t *connection = &sharedData->players.connections[playerID];
+    socketCommunication_t *clientData = &sharedData->players.clientData[playerID];
+    delta_baseline_t *baseline = &sharedData->players.baselines[playerID];
+    //Summary of the player for the analytics, and when it was last sent an update
+    analytics_player_t summary;
+    int64_t updateSent = microseconds(CLOCK_MONOTONIC);
+
+    memset(&summary, 0, sizeof summary);
+    summary.seat = playerID;
+
+    //Initial sending, the game begins
+    //A game resumed after a hot restart goes on where it was, without the players that are out
+    if (!sharedData->resumed)
+    {
+        sendUpdate(connection, baseline, clientData);
+        updateSent = microseconds(CLOCK_MONOTONIC);
+    }
+    else if (sharedData->game.playerStates[playerID] == LOSER)
+    {
+        leaveGame(sharedData);
+        pthread_exit(NULL);
+    }
+
+    //Round of updates this thread is taking part in
+    int broadcastRound;
+    //Player state as it was sent in the last update
+    //The shared state may already say PACTIVE before the update announcing the turn went out
+    int sentState = clientData->playerState;
+
+    //START GAME LOOP
+    //Every player gets the update that put it out or made it the winner before leaving
+    while (sentState != LOSER && sentState != WINNER)
+    {
+        //For the active player
+        if (sentState == PACTIVE)
+        {   
+            //Safe point for a hot restart, nothing of this turn has been received yet
+            if (!waitForInput(sharedData, playerID))
+            {
+                handOffGame(sharedData);
+                break;
+            }
+
+            //The rules decide what happens with the color
+            playColor(sharedData, playerID);
+            if (sharedData->server->analyticsQueue != NULL)
+            {
+                int64_t reaction = microseconds(CLOCK_MONOTONIC) - updateSent;
+
+                summary.colors++;
+                summary.reactionTotal += reaction;
+                if (reaction > summary.reactionMax)
+                {
+                    summary.reactionMax = reaction;
+                }
+            }
+
+            //Now ready to prepare the results of this round
+            lockMutex(&sharedData->mutex2);
+            FRED_PROBE3(broadcast_start, sharedData->gameID, sharedData->broadcastRound, sharedData->game.index);
+            sharedData->gameState = sharedData->game.gameState;
+            sharedData->sentTo = 0;
+            //Send signal to waiting clients
+            broadcastCond(&sharedData->cond);
+            unlockMutex(&sharedData->mutex2);
+        }
+
+        //Make clients wait for the readiness of the data to be sent
+        lockMutex(&sharedData->mutex2);
+        while (sharedData->sentTo < 0 && !sharedData->handedOff)
+        {
+            //Block while until signal comes from active player thread
+            waitCond(&sharedData->cond, &sharedData->mutex2);
+        }
+        if (sharedData->handedOff)
+        {
+            unlockMutex(&sharedData->mutex2);
+            break;
+        }
+        broadcastRound = sharedData->broadcastRound;
+        
+        //Prepare data for the client
+        clientData->color = sharedData->update.color;
+        clientData->wrongColor = sharedData->update.wrongColor;
+        clientData->newColor = sharedData->update.newColor;
+        clientData->newRound = sharedData->update.newRound;
+        clientData->playerState = sharedData->game.playerStates[playerID];
+        sentState = clientData->playerState;
+        //Only one player is out with every color, the counter is its place
+        summary.elimination = sentState == LOSER ? sharedData->game.losers : 0;
+        unlockMutex(&sharedData->mutex2);
+
+        //Check if player is Winner!
+        if (clientData->playerState == WINNER)
+        {
+            clientData->gameState = END;
+            if (logging(sharedData->server, LOG_DEBUG))
+            {
+                printf("Nr %d: WIN!\n", playerID);
+            }
+        }
+
+        //In a tournament the players that go on wait for their next match
+        if (sharedData->tournament != NULL && (clientData->playerState == LOSER || clientData->playerState == WINNER))
+        {
+            clientData->gameState = matchResult(sharedData, playerID) ? GWAIT : END;
+        }
+
+        //The result of the player goes to the stats, without waiting for them
+        if (sharedData->server->statsQueue != NULL && (clientData->playerState == LOSER || clientData->playerState == WINNER))
+        {
+            sendStats(sharedData, playerID);
+        }
+        if (sharedData->server->analyticsQueue != NULL && (clientData->playerState == LOSER || clientData->playerState == WINNER))
+        {
+            sendPlayerSummary(sharedData, &summary);
+        }
+
+        //Data is sent to all clients, only what changed for each of them
+        sendUpdate(connection, baseline, clientData);
+        updateSent = microseconds(CLOCK_MONOTONIC);
+        
+        //sentTo variable controls that everyone has got an update
+        lockMutex(&sharedData->mutex2);
+        if (clientData->playerState == LOSER)
+        {
+            //Kick out the loser, the other players don't wait for it anymore
+            sharedData->playersConnected--;
+        }
+        else
+        {
+            sharedData->sentTo++;
+        }
+
+        if (logging(sharedData->server, LOG_DEBUG))
+        {
+            printf("Update sent to player %d , sentTo = %d\n", playerID, sharedData->sentTo);
+        }
+
+        //Last thread updates the checking variable and informs other threads to go on
+        if (sharedData->sentTo == sharedData->playersConnected)
+        {
+            FRED_PROBE3(broadcast_end, sharedData->gameID, sharedData->broadcastRound, sharedData->game.index);
+            //Reset synchronization variable
+            sharedData->sentTo = -1;
+            sharedData->broadcastRound++;
+            //Signal to all threads that the synchronization variable has been changed
+            broadcastCond(&sharedData->cond);
+
+            if (logging(sharedData->server, LOG_DEBUG))
+            {
+                printf("sentTo resettet!\n");
+            }
+        }
+
+        //Check if sentTo variable was resetted and if threads can go on with the playing loop
+        //The round counter is checked instead of sentTo, which the next active player may have set again
+        while (sharedData->broadcastRound == broadcastRound && clientData->playerState != LOSER)
+        {
+            //Block thread until signal was received from last thread
+            waitCond(&sharedData->cond, &sharedData->mutex2);
+        }
+        unlockMutex(&sharedData->mutex2);
+    }
+
+    leaveGame(sharedData);
+    pthread_exit(NULL);
+}
+
+/*
+    Count out the thread of a player, the last one ends the game
+    The game can be freed right after, so nothing of it may be used afterwards
+*/
+void leaveGame(thread_data_t *sharedData)
+{
+    if (__atomic_sub_fetch(&sharedData->threadsRunning, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        endGame(sharedData);
+    }
+}
+
+/*
+    End of a game, run once when all its threads have finished
+    Shows the result and gives back the connections and the memory of the game
+*/
+void endGame(thread_data_t *sharedData)
+{
+    server_t *server = sharedData->server;
+    tournament_data_t *tournament = sharedData->tournament;
+    int players = sharedData->playersExpected;
+
+    if (sharedData->handedOff)
+    {
+        printf("Game handed over to the new server\n");
+    }
+    else if (logging(server, LOG_INFO) && sharedData->game.winner != -1)
+    {
+        printf("Game ended! Winner: player %d after %d turns, %d colors\n", sharedData->game.winner, sharedData->game.turnCounter, sharedData->game.sequenceSize);
+    }
+    else if (logging(server, LOG_INFO))
+    {
+        printf("Game ended without a winner after %d turns\n", sharedData->game.turnCounter);
+    }
+    fflush(stdout);
+    FRED_PROBE4(game_end, sharedData->gameID, sharedData->game.winner, sharedData->game.turnCounter, sharedData->game.sequenceSize);
+    if (server->analyticsQueue != NULL && !sharedData->handedOff)
+    {
+        sendGameSummary(sharedData);
+    }
+
+    //Free Memory
+    freeAll(sharedData);
+
+    //The players of a tournament are reported when it ends
+    if (server->supervisor_fd != -1 && tournament == NULL)
+    {
+        reportToSupervisor(server->supervisor_fd, REPORT_FINISHED, players);
+    }
+
+    lockMutex(&server->handoffMutex);
+    server->activeGames--;
+    broadcastCond(&server->handoffCond);
+    unlockMutex(&server->handoffMutex);
+
+    if (tournament != NULL)
+    {
+        matchEnded(tournament);
+    }
+}
+
+/*
+    Wait until a player has sent something
+    Returns 1 when the message can be received, or 0 if a hot restart has begun
+*/
+int waitForInput(thread_data_t *sharedData, int playerID)
+{
+    //Worker processes don't restart
+    if (sharedData->server->upgradePipe[0] == -1)
+    {
+        return 1;
+    }
+
+    return waitReadable(&sharedData->players.connections[playerID], sharedData->server->upgradePipe[0], -1);
+}
+
+/*
+    Communication with first client to setup the number of players
+    Returns 1 on success, 0 if the client left or sent an invalid number,
+    or -1 if a hot restart began while waiting for the answer
+*/
+int setupGame(thread_data_t *sharedData)
+{
+    socketCommunication_t clientData;
+    bzero(&clientData, sizeof clientData);
+    clientData.playerState = FIRST;
+    clientData.gameState = GWAIT;
+
+    //The old server already asked, in a game resumed after a hot restart
+    if (!sharedData->resumed)
+    {
+        sendUpdate(&sharedData->players.connections[0], &sharedData->players.baselines[0], &clientData);
+    }
+
+    if (!waitForInput(sharedData, 0))
+    {
+        return -1;
+    }
+
+    if (!recvMessage(&sharedData->players.connections[0], &clientData, sizeof(socketCommunication_t)) || clientData.playersExpected < 1)
+    {
+        return 0;
+    }
+    sharedData->playersExpected = clientData.playersExpected;
+
+    return 1;
+}
+
+/*
+    Receive the color of the active player and apply the rules to it
+*/
+void playColor(thread_data_t *sharedData, int playerID)
+{
+    fred_game_t *game = &sharedData->game;
+
+    recvMessage(&sharedData->players.connections[playerID], &sharedData->players.clientData[playerID], sizeof(socketCommunication_t));
+    FRED_PROBE4(recv, sharedData->gameID, playerID, game->index, sharedData->players.clientData[playerID].color);
+
+    //Make more space for the colors when the sequence is full
+    while (fredPlay(&sharedData->game, sharedData->players.clientData[playerID].color, &sharedData->update) == FRED_FULL)
+    {
+        //A file grows by one chunk, the sequence stays where it is
+        if (sharedData->sequenceStore != NULL && extendSequence(sharedData->sequenceStore))
+        {
+            sharedData->game.capacity = sharedData->sequenceStore->capacity;
+        }
+        else
+        {
+            //Only this game leaves its file, when it is as long as it can be or the disk is full
+            if (sharedData->sequenceStore != NULL)
+            {
+                sequenceToHeap(sharedData);
+            }
+
+            sharedData->game.capacity *= 2;
+            sharedData->game.sequence = realloc(sharedData->game.sequence, sharedData->game.capacity * sizeof(int));
+        }
+    }
+    //Only the part of the file being verified stays in memory
+    if (sharedData->sequenceStore != NULL)
+    {
+        followSequence(sharedData->sequenceStore, game->index);
+    }
+    FRED_PROBE5(check, sharedData->gameID, playerID, game->index, sharedData->update.wrongColor, sharedData->update.newColor);
+
+    if (game->gameState == GACTIVE && game->playerTurn != playerID)
+    {
+        FRED_PROBE4(turn, sharedData->gameID, game->playerTurn, game->turnCounter, game->index);
+    }
+}
+
+/*
+    Free structs
+*/
+void freeAll(thread_data_t *sharedData)
+{
+    for(int i = 0; i < sharedData->playersExpected; i++)
+    {
+        //The new server has the connections of a game handed over in a hot restart
+        if (sharedData->handedOff)
+        {
+            releaseConnection(&sharedData->players.connections[i]);
+        }
+        //The tournament keeps the connections of the players that go on
+        else if (sharedData->tournament != NULL && tournamentGoesOn(&sharedData->tournament->tournament, sharedData->firstSeat + i))
+        {
+            sharedData->tournament->connections[sharedData->tournament->tournament.roster[sharedData->firstSeat + i].id] = sharedData->players.connections[i];
+        }
+        else
+        {
+            shutConnection(&sharedData->players.connections[i]);
+        }
+    }
+    
+    freePlayerTable(&sharedData->players);
+    if (sharedData->sequenceStore != NULL)
+    {
+        closeSequence(sharedData->sequenceStore);
+        free(sharedData->sequenceStore);
+    }
+    else
+    {
+        free(sharedData->game.sequence);
+    }
+    free(sharedData->game.playerStates);
+    free(sharedData->game.alive);
+
+    destroyMutex(&sharedData->mutex1);
+    destroyMutex(&sharedData->mutex2);
+    destroyCond(&sharedData->cond);
+
+    free(sharedData);
+}
+
+/*
+    Storage for the color sequence of a new game, a file in endurance mode
+    Returns the sequence, with the colors it has space for stored in 'capacity'
+*/
+int *newSequence(thread_data_t *sharedData, int *capacity)
+{
+    if (enduranceDirectory != NULL)
+    {
+        sharedData->sequenceStore = malloc(sizeof(sequence_store_t));
+        if (openSequence(sharedData->sequenceStore, enduranceDirectory))
+        {
+            *capacity = sharedData->sequenceStore->capacity;
+            return sharedData->sequenceStore->colors;
+        }
+
+        //The game is played anyway, with the sequence on the heap
+        fprintf(stderr, "ERROR: can't keep a sequence in %s\n", enduranceDirectory);
+        free(sharedData->sequenceStore);
+        sharedData->sequenceStore = NULL;
     }
+
+    *capacity = 1;
+    return malloc(sizeof(int));
 }
 
 /*
-    Free structs
+    Move the color sequence of a game from its file to the heap, when the file can't grow
+    The game goes on with the whole sequence in memory
 */
-void freeAll(thread_data_t *sharedData)
+void sequenceToHeap(thread_data_t *sharedData)
 {
-    for(int i = 0; i < sharedData->playersExpected; i++)
+    sequence_store_t *store = sharedData->sequenceStore;
+    int *sequence = malloc((size_t)store->capacity * sizeof(int));
+
+    if (sequence == NULL)
     {
-        free(sharedData->playerArray[i]->clientData);
+        fatalError("ERROR: malloc");
     }
-    
-    free(sharedData->colorSequence);
+    fprintf(stderr, "ERROR: the sequence file of game %d can't grow, it goes on in memory\n", sharedData->gameID);
+
+    //Read back from the file the chunks that were let go
+    memcpy(sequence, store->colors, (size_t)store->capacity * sizeof(int));
+    closeSequence(store);
+    free(store);
+    sharedData->sequenceStore = NULL;
+    sharedData->game.sequence = sequence;
+}
 
-    free(sharedData);
-}
\ No newline at end of file
+/*
+    Start a tournament with the players of a roster formed like a game
+*/
+void startTournament(thread_data_t *sharedData)
+{
+    tournament_data_t *tournament = malloc(sizeof(tournament_data_t));
+    int entrants = sharedData->playersExpected;
+
+    tournament->server = sharedData->server;
+    initMutex(&tournament->mutex, "tournament");
+    tournamentStart(&tournament->tournament, tournamentFormat, malloc(entrants * sizeof(entrant_t)), entrants, playersPerMatch);
+
+    //The connections belong to the tournament now, the roster is not played as a game
+    tournament->connections = malloc(entrants * sizeof(connection_t));
+    memcpy(tournament->connections, sharedData->players.connections, entrants * sizeof(connection_t));
+    tournament->ids = malloc(entrants * sizeof(int));
+    memcpy(tournament->ids, sharedData->players.ids, entrants * sizeof(int));
+    sharedData->playersExpected = 0;
+    freeAll(sharedData);
+
+    printf("Tournament of %d players, %d per match\n", entrants, playersPerMatch);
+    startRound(tournament);
+}
+
+/*
+    Start all the matches of the next round at the same time, or end the tournament
+*/
+void startRound(tournament_data_t *tournament)
+{
+    tournament_t *rules = &tournament->tournament;
+    thread_data_t *sharedData;
+    int matches = tournamentRound(rules);
+    int players;
+    int first;
+
+    if (matches == 0)
+    {
+        endTournament(tournament);
+        return;
+    }
+
+    //Byes win at once, and are not counted as running
+    tournament->matchesRunning = 0;
+    for (int i = 0; i < matches; i++)
+    {
+        if (tournamentMatch(rules, i, &first) == 1)
+        {
+            tournamentResult(rules, first, 0, 1);
+        }
+        else
+        {
+            tournament->matchesRunning++;
+        }
+    }
+    printf("Tournament round %d: %d matches\n", rules->round, matches);
+
+    //Counted before, a match may end while the next ones are still starting
+    for (int i = 0; i < matches; i++)
+    {
+        players = tournamentMatch(rules, i, &first);
+        if (players == 1)
+        {
+            continue;
+        }
+
+        sharedData = newGame(tournament->server);
+        sharedData->tournament = tournament;
+        sharedData->firstSeat = first;
+        sharedData->playersExpected = players;
+        sharedData->playersConnected = players;
+        growPlayerTable(&sharedData->players, players);
+        for (int j = 0; j < players; j++)
+        {
+            //A player that lost with colors typed ahead already sent them, they don't belong to this match
+            discardInput(&tournament->connections[rules->roster[first + j].id]);
+            sharedData->players.connections[j] = tournament->connections[rules->roster[first + j].id];
+            sharedData->players.ids[j] = tournament->ids[rules->roster[first + j].id];
+        }
+
+        startGame(sharedData);
+    }
+}
+
+/*
+    Record the result of a player at the end of its match
+    Returns 1 if the tournament goes on for the player
+*/
+int matchResult(thread_data_t *sharedData, int playerID)
+{
+    tournament_data_t *tournament = sharedData->tournament;
+    int winner = sharedData->game.playerStates[playerID] == WINNER;
+    //Only one player is out with every update, so the ones out before are all the others
+    int beaten = winner ? sharedData->game.losers : sharedData->game.losers - 1;
+    int goesOn;
+
+    lockMutex(&tournament->mutex);
+    tournamentResult(&tournament->tournament, sharedData->firstSeat + playerID, beaten, winner);
+    goesOn = tournamentGoesOn(&tournament->tournament, sharedData->firstSeat + playerID);
+    unlockMutex(&tournament->mutex);
+
+    return goesOn;
+}
+
+/*
+    Count out a match of the current round, the last one starts the next round
+*/
+void matchEnded(tournament_data_t *tournament)
+{
+    int last;
+
+    lockMutex(&tournament->mutex);
+    tournament->matchesRunning--;
+    last = tournament->matchesRunning == 0;
+    unlockMutex(&tournament->mutex);
+
+    if (last)
+    {
+        startRound(tournament);
+    }
+}
+
+/*
+    Send the final result to every player still waiting and free the tournament
+    The first entrant of the roster is the champion
+*/
+void endTournament(tournament_data_t *tournament)
+{
+    tournament_t *rules = &tournament->tournament;
+    server_t *server = tournament->server;
+    socketCommunication_t clientData;
+    delta_baseline_t baseline;
+    connection_t *connection;
+
+    printf("Tournament ended after %d rounds! Champion: player %d, %d players beaten\n", rules->round, rules->roster[0].id, rules->roster[0].score);
+    fflush(stdout);
+
+    bzero(&clientData, sizeof clientData);
+    clientData.playersExpected = rules->entrants;
+    clientData.gameState = END;
+    for (int i = 0; i < rules->entrants; i++)
+    {
+        if (tournamentGoesOn(rules, i))
+        {
+            connection = &tournament->connections[rules->roster[i].id];
+            clientData.playerState = i == 0 ? WINNER : LOSER;
+            //The players come from different matches, they all get a keyframe
+            bzero(&baseline, sizeof baseline);
+            sendUpdate(connection, &baseline, &clientData);
+            shutConnection(connection);
+        }
+    }
+
+    if (server->supervisor_fd != -1)
+    {
+        reportToSupervisor(server->supervisor_fd, REPORT_FINISHED, rules->entrants);
+    }
+
+    free(rules->roster);
+    free(tournament->connections);
+    free(tournament->ids);
+    destroyMutex(&tournament->mutex);
+    free(tournament);
+}
+
+/*
+    Start the thread that accepts the clients from the listeners
+*/
+void startAdmission(server_t *server)
+{
+    if (pthread_create(&server->admissionThread, NULL, &admissionThread, server) != 0)
+    {
+        fprintf(stderr, "ERROR: pthread_create\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+    Thread that keeps the listeners drained, so a burst of clients doesn't fill their backlog
+    while formGame waits for a player to choose the size of a game
+    Every client waiting is accepted at once, then checked against the limits and queued or refused
+    Ends when a hot restart begins, the clients still queued are handed over
+*/
+void *admissionThread(void *arg)
+{
+    server_t *server = (server_t *)arg;
+    int clients[ADMISSION_BATCH];
+    int listener;
+    int accepted;
+    int refused;
+    const server_config_t *config;
+
+    while (1)
+    {
+        listener = waitForClient(server->server_fds, server->numServers, server->upgradePipe[0]);
+        if (listener == -1)
+        {
+            closePending(&server->pending);
+            return NULL;
+        }
+
+        //The limits may have been changed by a command
+        config = readConfig(&server->config);
+        if (config->rate != server->admission.global.rate || config->addressRate != server->admission.addressRate)
+        {
+            setLimits(&server->admission, config->rate, config->addressRate);
+        }
+
+        accepted = acceptBatch(server->server_fds[listener], clients, ADMISSION_BATCH);
+        refused = 0;
+        for (int i = 0; i < accepted; i++)
+        {
+            //A draining server takes no more players
+            if (config->draining || !admitClient(&server->admission, clients[i]) || !pushClient(&server->pending, clients[i], server->transports[listener]))
+            {
+                refuseClient(&server->admission, clients[i], server->transports[listener]);
+                refused++;
+            }
+        }
+
+        if (!logging(server, LOG_INFO))
+        {
+            continue;
+        }
+        if (refused > 0)
+        {
+            printf("Received %d incomming connections, %d refused (server full)\n", accepted, refused);
+        }
+        else if (accepted > 0)
+        {
+            printf("Received %d incomming connections\n", accepted);
+        }
+    }
+}
+
+/*
+    Settings of a server that was just started, before the options
+*/
+void defaultConfig(server_config_t *config)
+{
+    config->maxGames = 0;
+    config->backlog = MAX_QUEUE;
+    config->rate = ADMISSION_RATE;
+    config->addressRate = ADMISSION_ADDRESS_RATE;
+    config->handshakeTimeout = TLS_HANDSHAKE_TIMEOUT;
+    config->logLevel = LOG_DEBUG;
+    config->draining = 0;
+}
+
+/*
+    Check if the messages of a level are printed
+*/
+int logging(server_t *server, int level)
+{
+    return readConfig(&server->config)->logLevel >= level;
+}
+
+/*
+    Thread that serves the control socket, one admin at a time
+    Ends when a hot restart begins, the control socket goes to the new server
+*/
+void *adminThread(void *arg)
+{
+    server_t *server = (server_t *)arg;
+    admin_client_t client;
+    char line[ADMIN_LINE];
+    int received;
+
+    while (waitForClient(&server->admin_fd, 1, server->upgradePipe[0]) != -1)
+    {
+        client.fd = accept4(server->admin_fd, NULL, NULL, SOCK_CLOEXEC);
+        client.length = 0;
+        if (client.fd == -1)
+        {
+            continue;
+        }
+
+        while ((received = nextCommand(&client, line, server->upgradePipe[0])) == 1)
+        {
+            runCommand(server, client.fd, line);
+        }
+        close(client.fd);
+
+        if (received == -1)
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+    Run one command of the control socket and answer it
+*/
+void runCommand(server_t *server, int client_fd, char *line)
+{
+    server_config_t config = *readConfig(&server->config);
+    char command[16];
+    char name[32];
+    char value[32];
+    int words = sscanf(line, "%15s %31s %31s", command, name, value);
+    int games;
+
+    if (words < 1)
+    {
+        return;
+    }
+
+    lockMutex(&server->handoffMutex);
+    games = server->activeGames;
+    unlockMutex(&server->handoffMutex);
+
+    if (strcmp(command, "status") == 0 && words == 1)
+    {
+        lockMutex(&server->pending.mutex);
+        dprintf(client_fd, "games %d\nwaiting %d\n", games, server->pending.count);
+        unlockMutex(&server->pending.mutex);
+        dprintf(client_fd, "admitted %ld\nrefused %ld\n", __atomic_load_n(&server->admission.admitted, __ATOMIC_RELAXED), __atomic_load_n(&server->admission.refused, __ATOMIC_RELAXED));
+        writeConfig(client_fd, &config);
+    }
+    else if (strcmp(command, "set") == 0 && words == 3)
+    {
+        if (!setConfig(&config, name, value))
+        {
+            dprintf(client_fd, "ERROR: unknown setting or value not valid\n");
+            return;
+        }
+        changeConfig(server, &config);
+    }
+    else if ((strcmp(command, "drain") == 0 || strcmp(command, "resume") == 0) && words == 1)
+    {
+        config.draining = strcmp(command, "drain") == 0;
+        changeConfig(server, &config);
+        dprintf(client_fd, "games %d\n", games);
+    }
+    else
+    {
+        dprintf(client_fd, "ERROR: commands are status, set <setting> <value>, drain and resume\n");
+        return;
+    }
+
+    dprintf(client_fd, "OK\n");
+}
+
+/*
+    Make a new version of the settings current, and apply what the games don't read by themselves
+    Called by one thread at a time: the control socket, or the main thread before it starts
+*/
+void changeConfig(server_t *server, const server_config_t *config)
+{
+    const server_config_t *old = readConfig(&server->config);
+    int clients[MAX_PASSED_FDS];
+    int transports[MAX_PASSED_FDS];
+    int numClients;
+
+    //A listening socket takes a new backlog when listen is called again
+    if (config->backlog != old->backlog)
+    {
+        for (int i = 0; i < server->numServers; i++)
+        {
+            listen(server->server_fds[i], config->backlog);
+        }
+    }
+    if (config->handshakeTimeout != old->handshakeTimeout)
+    {
+        tlsSetTimeout(config->handshakeTimeout);
+    }
+    publishConfig(&server->config, config);
+
+    //The game being formed lets its players go, and the clients waiting are turned away
+    pausePending(&server->pending, config->draining);
+    while (config->draining && (numClients = drainClients(&server->pending, clients, transports, MAX_PASSED_FDS)) > 0)
+    {
+        for (int i = 0; i < numClients; i++)
+        {
+            refuseClient(&server->admission, clients[i], transports[i]);
+        }
+    }
+
+    //The main thread may be waiting to form a game
+    lockMutex(&server->handoffMutex);
+    broadcastCond(&server->handoffCond);
+    unlockMutex(&server->handoffMutex);
+}
+
+/*
+    Open the stats of the players and start the thread that writes them
+*/
+void startStats(server_t *server)
+{
+    if (!openStats(&server->stats, server->statsPath))
+    {
+        fprintf(stderr, "ERROR: %s is not a stats file\n", server->statsPath);
+        exit(EXIT_FAILURE);
+    }
+    server->statsClosing = 0;
+
+    if (pthread_create(&server->statsThread, NULL, &statsThread, server) != 0)
+    {
+        fprintf(stderr, "ERROR: pthread_create\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+    Thread that takes the results of the players from the queue and adds them to the stats
+    Ends when the stats are closed and the queue is empty
+*/
+void *statsThread(void *arg)
+{
+    server_t *server = (server_t *)arg;
+    stats_result_t result;
+
+    while (1)
+    {
+        if (popItem(server->statsQueue, &result, 1000))
+        {
+            recordResult(&server->stats, &result);
+            if (result.winner)
+            {
+                printf("Stats: player %d has %d wins, rank %d\n", result.id, findPlayer(&server->stats, result.id)->wins, playerRank(&server->stats, result.id));
+            }
+        }
+        else if (__atomic_load_n(&server->statsClosing, __ATOMIC_ACQUIRE))
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+    Write the results still queued and close the stats
+    No game may send results anymore
+*/
+void stopStats(server_t *server)
+{
+    __atomic_store_n(&server->statsClosing, 1, __ATOMIC_RELEASE);
+    wakeMpscQueue(server->statsQueue);
+    pthread_join(server->statsThread, NULL);
+
+    closeStats(&server->stats);
+    if (server->statsQueue->dropped > 0)
+    {
+        printf("Stats: %u results dropped, the queue was full\n", server->statsQueue->dropped);
+    }
+}
+
+/*
+    Queue the result of a player whose last update of the game is going out
+*/
+void sendStats(thread_data_t *sharedData, int playerID)
+{
+    stats_result_t result;
+
+    result.id = sharedData->players.ids[playerID];
+    result.winner = sharedData->game.playerStates[playerID] == WINNER;
+    result.sequence = sharedData->game.sequenceSize;
+    result.turns = sharedData->game.turnCounter;
+
+    pushItem(sharedData->server->statsQueue, &result);
+}
+
+/*
+    Check the directory of the analytics and start the thread that writes the batches
+*/
+void startAnalytics(server_t *server)
+{
+    if (!openAnalytics(&server->analytics, server->analyticsPath))
+    {
+        fprintf(stderr, "ERROR: can't write analytics to %s\n", server->analyticsPath);
+        exit(EXIT_FAILURE);
+    }
+    server->analyticsClosing = 0;
+
+    if (pthread_create(&server->analyticsThread, NULL, &analyticsThread, server) != 0)
+    {
+        fprintf(stderr, "ERROR: pthread_create\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+    Thread that takes the summaries from the queue and adds them to the batches
+    Ends when the analytics are closed and the queue is empty
+*/
+void *analyticsThread(void *arg)
+{
+    server_t *server = (server_t *)arg;
+    analytics_record_t record;
+
+    while (1)
+    {
+        if (popItem(server->analyticsQueue, &record, 1000))
+        {
+            addRecord(&server->analytics, &record);
+        }
+        else if (__atomic_load_n(&server->analyticsClosing, __ATOMIC_ACQUIRE))
+        {
+            break;
+        }
+
+        //The deadline of the batches is checked every time, a busy server never waits for a pause
+        flushAnalytics(&server->analytics);
+    }
+
+    return NULL;
+}
+
+/*
+    Write the summaries still queued and the batches not full yet
+    No game may send summaries anymore
+*/
+void stopAnalytics(server_t *server)
+{
+    __atomic_store_n(&server->analyticsClosing, 1, __ATOMIC_RELEASE);
+    wakeMpscQueue(server->analyticsQueue);
+    pthread_join(server->analyticsThread, NULL);
+
+    closeAnalytics(&server->analytics);
+    if (server->analyticsQueue->dropped > 0)
+    {
+        printf("Analytics: %u summaries dropped, the queue was full\n", server->analyticsQueue->dropped);
+    }
+}
+
+/*
+    Unique number of a game in the analytics
+*/
+int64_t analyticsGame(thread_data_t *sharedData)
+{
+    return ((int64_t)getpid() << 32) | (uint32_t)sharedData->gameID;
+}
+
+/*
+    Put the summary of a player that is out or has won in the queue of the analytics
+*/
+void sendPlayerSummary(thread_data_t *sharedData, analytics_player_t *summary)
+{
+    analytics_record_t record;
+
+    summary->game = analyticsGame(sharedData);
+    summary->id = sharedData->players.ids[summary->seat];
+    record.table = ANALYTICS_PLAYERS;
+    record.row.player = *summary;
+
+    pushItem(sharedData->server->analyticsQueue, &record);
+}
+
+/*
+    Put the summary of a game that ended in the queue of the analytics
+*/
+void sendGameSummary(thread_data_t *sharedData)
+{
+    analytics_record_t record;
+
+    record.table = ANALYTICS_GAMES;
+    record.row.game.game = analyticsGame(sharedData);
+    record.row.game.start = sharedData->startTime;
+    record.row.game.duration = microseconds(CLOCK_MONOTONIC) - sharedData->startClock;
+    record.row.game.longestSequence = sharedData->game.sequenceSize;
+    record.row.game.players = sharedData->playersExpected;
+    record.row.game.turns = sharedData->game.turnCounter;
+    record.row.game.winner = sharedData->game.winner;
+    record.row.game.resumed = sharedData->resumed;
+
+    pushItem(sharedData->server->analyticsQueue, &record);
+}
@@ -0,0 +1,323 @@
+/*
+    Batch simulator for Fabulous Fred
+    Plays synthetic games with the rules of the server (libfred), without sockets,
+    spread over all the cores, for balance analysis and regression testing
+    Every game only depends on its number and the seed, so the results and the
+    checksum are the same with any number of threads
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+//Thread library
+#include <pthread.h>
+// Custom libraries
+#include "fred_game.h"
+
+#define COLORNUM 7
+//Most players in a simulated game, enough for mass elimination events
+#define MAX_SIM_PLAYERS 16384
+//Games with more players only show a summary of the wins by position
+#define MAX_SHOWN_PLAYERS 16
+//Longest sequence in a simulated game, longer games are counted as unfinished
+#define MAX_SIM_SEQUENCE 4096
+#define MAX_SIM_THREADS 256
+
+// Parameters of the simulation, the same for every thread
+typedef struct simulation_struct
+{
+    long games;
+    int players;
+    //Probability that a player forgets a color of the sequence
+    double mistakeRate;
+    uint64_t seed;
+    int numThreads;
+} simulation_t;
+
+// Results of the games played by one thread
+typedef struct results_struct
+{
+    long games;
+    long moves;
+    //Games won from every position in the turn order, one for every player
+    long *wins;
+    //Games where everybody lost
+    long noWinner;
+    //Games that reached MAX_SIM_SEQUENCE colors
+    long unfinished;
+    long totalSequence;
+    int maxSequence;
+    uint64_t checksum;
+} results_t;
+
+// Data for every simulation thread
+typedef struct thread_data_struct
+{
+    simulation_t *simulation;
+    //Index of the thread, it plays every numThreads-th game starting from this one
+    int first;
+    results_t results;
+} thread_data_t;
+
+///// FUNCTION DECLARATIONS
+void usage(char *program);
+void *simulate(void *arg);
+void playGame(simulation_t *simulation, long number, results_t *results);
+uint64_t nextRandom(uint64_t *state);
+void addResults(results_t *total, results_t *results, int players);
+void printResults(simulation_t *simulation, results_t *total, double seconds);
+void printWinSummary(simulation_t *simulation, results_t *total);
+
+///// MAIN FUNCTION
+int main(int argc, char *argv[])
+{
+    simulation_t simulation;
+    thread_data_t threads[MAX_SIM_THREADS];
+    pthread_t tid[MAX_SIM_THREADS];
+    results_t total;
+    struct timespec start;
+    struct timespec end;
+
+    // Check the correct arguments
+    if (argc < 3 || argc > 6)
+    {
+        usage(argv[0]);
+    }
+
+    simulation.games = atol(argv[1]);
+    simulation.players = atoi(argv[2]);
+    simulation.mistakeRate = argc > 3 ? atof(argv[3]) : 0.05;
+    simulation.numThreads = argc > 4 ? atoi(argv[4]) : sysconf(_SC_NPROCESSORS_ONLN);
+    simulation.seed = argc > 5 ? strtoull(argv[5], NULL, 0) : 1;
+
+    if (simulation.games < 1 || simulation.players < 1 || simulation.players > MAX_SIM_PLAYERS
+        || simulation.mistakeRate < 0 || simulation.mistakeRate > 1
+        || simulation.numThreads < 1 || simulation.numThreads > MAX_SIM_THREADS)
+    {
+        usage(argv[0]);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (int i = 0; i < simulation.numThreads; i++)
+    {
+        threads[i].simulation = &simulation;
+        threads[i].first = i;
+        if (pthread_create(&tid[i], NULL, &simulate, &threads[i]) != 0)
+        {
+            fprintf(stderr, "ERROR: pthread_create\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    bzero(&total, sizeof total);
+    total.wins = calloc(simulation.players, sizeof(long));
+    for (int i = 0; i < simulation.numThreads; i++)
+    {
+        pthread_join(tid[i], NULL);
+        addResults(&total, &threads[i].results, simulation.players);
+        free(threads[i].results.wins);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    printResults(&simulation, &total, (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+
+    return 0;
+}
+
+///// FUNCTION DEFINITIONS
+
+/*
+    Explanation to the user of the parameters required to run the program
+*/
+void usage(char *program)
+{
+    printf("Usage:\n");
+    printf("\t%s {games} {players} [mistake_rate] [threads] [seed]\n", program);
+    printf("\tmistake_rate: probability of forgetting a color, 0.05 by default\n");
+    printf("\tthreads: one per core by default\n");
+    exit(EXIT_FAILURE);
+}
+
+/*
+    Thread that plays its share of the games
+*/
+void *simulate(void *arg)
+{
+    thread_data_t *data = (thread_data_t *)arg;
+    simulation_t *simulation = data->simulation;
+    //Counted locally, the results of the threads share cache lines
+    results_t results;
+
+    bzero(&results, sizeof results);
+    results.wins = calloc(simulation->players, sizeof(long));
+
+    for (long number = data->first; number < simulation->games; number += simulation->numThreads)
+    {
+        playGame(simulation, number, &results);
+    }
+
+    data->results = results;
+
+    return NULL;
+}
+
+/*
+    Play one game, with players that remember the sequence except for random mistakes
+*/
+void playGame(simulation_t *simulation, long number, results_t *results)
+{
+    fred_game_t game;
+    fred_update_t update;
+    int playerStates[MAX_SIM_PLAYERS];
+    uint64_t alive[FRED_ALIVE_WORDS(MAX_SIM_PLAYERS)];
+    int sequence[MAX_SIM_SEQUENCE];
+    uint64_t random = simulation->seed ^ ((uint64_t)number * 0x9E3779B97F4A7C15ULL);
+    uint64_t outcome;
+    int color;
+    int result = FRED_PLAYED;
+    int winner;
+    long moves = 0;
+
+    fredStart(&game, simulation->players, playerStates, alive, sequence, MAX_SIM_SEQUENCE);
+
+    while (result == FRED_PLAYED && game.gameState == GACTIVE)
+    {
+        //A new color is chosen at random
+        if (game.index == game.sequenceSize)
+        {
+            color = nextRandom(&random) % COLORNUM + 1;
+        }
+        //Forget the color, playing the next one instead
+        else if ((nextRandom(&random) >> 11) * (1.0 / 9007199254740992.0) < simulation->mistakeRate)
+        {
+            color = game.sequence[game.index] % COLORNUM + 1;
+        }
+        else
+        {
+            color = game.sequence[game.index];
+        }
+
+        result = fredPlay(&game, color, &update);
+        moves++;
+    }
+
+    winner = game.winner;
+    results->games++;
+    results->moves += moves;
+    results->totalSequence += game.sequenceSize;
+    if (game.sequenceSize > results->maxSequence)
+    {
+        results->maxSequence = game.sequenceSize;
+    }
+    if (result == FRED_FULL)
+    {
+        results->unfinished++;
+    }
+    else if (winner == -1)
+    {
+        results->noWinner++;
+    }
+    else
+    {
+        results->wins[winner]++;
+    }
+
+    //Added up, so the order in which the games are played doesn't matter
+    outcome = ((uint64_t)number << 32) ^ ((uint64_t)(winner + 1) << 24) ^ ((uint64_t)game.sequenceSize << 8) ^ (uint64_t)moves;
+    results->checksum += nextRandom(&outcome);
+}
+
+/*
+    Random number generator (xorshift64*), small and fast enough to not get in the way
+*/
+uint64_t nextRandom(uint64_t *state)
+{
+    uint64_t x = *state ? *state : 0x2545F4914F6CDD1DULL;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+/*
+    Add the results of one thread to the total
+*/
+void addResults(results_t *total, results_t *results, int players)
+{
+    total->games += results->games;
+    total->moves += results->moves;
+    for (int i = 0; i < players; i++)
+    {
+        total->wins[i] += results->wins[i];
+    }
+    total->noWinner += results->noWinner;
+    total->unfinished += results->unfinished;
+    total->totalSequence += results->totalSequence;
+    if (results->maxSequence > total->maxSequence)
+    {
+        total->maxSequence = results->maxSequence;
+    }
+    total->checksum += results->checksum;
+}
+
+/*
+    Show the statistics of the simulation
+*/
+void printResults(simulation_t *simulation, results_t *total, double seconds)
+{
+    printf("Games: %ld with %d players, mistake rate %.4f, %d threads\n", total->games, simulation->players, simulation->mistakeRate, simulation->numThreads);
+    printf("Time: %.3f s, %.0f games/s, %.0f moves/s\n", seconds, total->games / seconds, total->moves / seconds);
+    printf("Moves per game: %.2f\n", (double)total->moves / total->games);
+    printf("Sequence length: %.2f average, %d longest\n", (double)total->totalSequence / total->games, total->maxSequence);
+    if (simulation->players <= MAX_SHOWN_PLAYERS)
+    {
+        printf("Wins by position in the turn order:\n");
+        for (int i = 0; i < simulation->players; i++)
+        {
+            printf("\t%2d: %10ld  %6.2f%%\n", i + 1, total->wins[i], 100.0 * total->wins[i] / total->games);
+        }
+    }
+    else
+    {
+        printWinSummary(simulation, total);
+    }
+    printf("No winner: %ld\n", total->noWinner);
+    printf("Unfinished (%d colors): %ld\n", MAX_SIM_SEQUENCE, total->unfinished);
+    printf("Checksum: %016llx\n", (unsigned long long)total->checksum);
+}
+
+/*
+    Show how even the wins by position are, for games with many players
+*/
+void printWinSummary(simulation_t *simulation, results_t *total)
+{
+    int least = 0;
+    int most = 0;
+    long won = 0;
+
+    for (int i = 0; i < simulation->players; i++)
+    {
+        won += total->wins[i];
+        if (total->wins[i] < total->wins[least])
+        {
+            least = i;
+        }
+        if (total->wins[i] > total->wins[most])
+        {
+            most = i;
+        }
+    }
+
+    printf("Wins by position in the turn order: %.2f average\n", (double)won / simulation->players);
+    printf("\tfewest: position %d with %ld\n", least + 1, total->wins[least]);
+    printf("\tmost: position %d with %ld\n", most + 1, total->wins[most]);
+    printf("\tfirst: %ld, last: %ld\n", total->wins[0], total->wins[simulation->players - 1]);
+}
@@ -0,0 +1,123 @@
+/*
+    Queries on the stats of the players kept by the server (FFServer -s)
+    Shows the leaderboard, or the stats and the rank of one player,
+    with the time the query took once the store is open
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+// Custom libraries
+#include "stats_store.h"
+
+// Players shown by default in the leaderboard
+#define DEFAULT_TOP 10
+
+///// FUNCTION DECLARATIONS
+void usage(char *program);
+void printPlayer(player_stats_t *player, int rank);
+double elapsed(struct timespec *start);
+
+///// MAIN FUNCTION
+int main(int argc, char *argv[])
+{
+    stats_store_t store;
+    player_stats_t **top;
+    player_stats_t *player;
+    struct timespec start;
+    double micros;
+    int k;
+    int count;
+    int rank;
+
+    // Check the correct arguments
+    if (argc < 3 || argc > 4 || (strcmp(argv[2], "top") != 0 && strcmp(argv[2], "player") != 0)
+        || (strcmp(argv[2], "player") == 0 && argc != 4))
+    {
+        usage(argv[0]);
+    }
+
+    if (!readStats(&store, argv[1]))
+    {
+        fprintf(stderr, "ERROR: %s is not a stats file\n", argv[1]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (strcmp(argv[2], "top") == 0)
+    {
+        k = argc == 4 ? atoi(argv[3]) : DEFAULT_TOP;
+        if (k < 1)
+        {
+            usage(argv[0]);
+        }
+        top = malloc(k * sizeof(player_stats_t *));
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        count = topPlayers(&store, top, k);
+        micros = elapsed(&start);
+
+        printf("%6s  %10s  %8s  %8s  %8s  %12s\n", "rank", "player", "games", "wins", "longest", "turns");
+        for (int i = 0; i < count; i++)
+        {
+            printPlayer(top[i], playerRank(&store, top[i]->id));
+        }
+        printf("Top %d players in %.2f us\n", count, micros);
+        free(top);
+    }
+    else
+    {
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        player = findPlayer(&store, atoi(argv[3]));
+        rank = playerRank(&store, atoi(argv[3]));
+        micros = elapsed(&start);
+
+        if (player == NULL)
+        {
+            printf("Player %s has no stats\n", argv[3]);
+        }
+        else
+        {
+            printf("%6s  %10s  %8s  %8s  %8s  %12s\n", "rank", "player", "games", "wins", "longest", "turns");
+            printPlayer(player, rank);
+        }
+        printf("Query in %.2f us\n", micros);
+    }
+
+    closeStats(&store);
+
+    return 0;
+}
+
+///// FUNCTION DEFINITIONS
+
+/*
+    Explanation to the user of the parameters required to run the program
+*/
+void usage(char *program)
+{
+    printf("Usage:\n");
+    printf("\t%s {stats_file} top [players]\n", program);
+    printf("\t%s {stats_file} player {player_id}\n", program);
+    exit(EXIT_FAILURE);
+}
+
+/*
+    One line of the leaderboard
+*/
+void printPlayer(player_stats_t *player, int rank)
+{
+    printf("%6d  %10d  %8d  %8d  %8d  %12lld\n", rank, player->id, player->games, player->wins, player->longestSequence, (long long)player->turnsSurvived);
+}
+
+/*
+    Microseconds since 'start'
+*/
+double elapsed(struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    return (end.tv_sec - start->tv_sec) * 1e6 + (end.tv_nsec - start->tv_nsec) / 1e3;
+}
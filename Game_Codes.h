@@ -1,5 +1,10 @@
+#ifndef GAME_CODES_H
+#define GAME_CODES_H
+
 //The different types of game states
 typedef enum gameState {GWAIT, GACTIVE, END} gameState_t;
 
 //The different types of player states
 typedef enum playerState {FIRST, PWAIT, PACTIVE, LOSER, WINNER, EXIT} playerState_t;
+
+#endif  /* NOT GAME_CODES_H */
@@ -0,0 +1,220 @@
+/*
+    Settings of the server that can be changed while it runs, and its control socket
+    See admin.h for the description
+*/
+
+// Needed for dprintf
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+
+#include "admin.h"
+#include "clock_time.h"
+#include "fatal_error.h"
+
+static const char *logLevels[] = {"quiet", "info", "debug"};
+
+/*
+    Start with a copy of 'config' as the first version, nothing retired yet
+*/
+void initConfig(live_config_t *live, const server_config_t *config)
+{
+    live->current = malloc(sizeof(config_version_t));
+    live->current->config = *config;
+    live->retired = NULL;
+}
+
+/*
+    Current version of the settings, loaded with acquire so its fields are seen whole
+*/
+const server_config_t *readConfig(live_config_t *live)
+{
+    return &__atomic_load_n(&live->current, __ATOMIC_ACQUIRE)->config;
+}
+
+/*
+    Swap a copy of 'config' in as the current version, retire the one it replaces,
+    and free the retired versions older than CONFIG_GRACE_SECONDS
+*/
+void publishConfig(live_config_t *live, const server_config_t *config)
+{
+    config_version_t *version = malloc(sizeof(config_version_t));
+    config_version_t **link = &live->retired;
+    double now = seconds();
+
+    version->config = *config;
+    version = __atomic_exchange_n(&live->current, version, __ATOMIC_ACQ_REL);
+
+    //The version replaced waits for the readers that may still have it
+    version->retired = now;
+    version->next = live->retired;
+    live->retired = version;
+
+    //The list is in the order they were replaced, the oldest at the end
+    while (*link != NULL && now - (*link)->retired < CONFIG_GRACE_SECONDS)
+    {
+        link = &(*link)->next;
+    }
+    while (*link != NULL)
+    {
+        version = *link;
+        *link = version->next;
+        free(version);
+    }
+}
+
+/*
+    Read a whole number that is at least 'minimum'
+    Returns 1 on success, or 0 otherwise
+*/
+static int readInteger(const char *value, int minimum, int *result)
+{
+    char *end;
+    long number = strtol(value, &end, 10);
+
+    if (end == value || *end != '\0' || number < minimum || number > 1000000000)
+    {
+        return 0;
+    }
+    *result = number;
+
+    return 1;
+}
+
+/*
+    Read a rate in connections per second, 0 or more
+    Returns 1 on success, or 0 if the text is not one
+*/
+static int readRate(const char *value, double *result)
+{
+    char *end;
+    double number = strtod(value, &end);
+
+    if (end == value || *end != '\0' || !(number >= 0))
+    {
+        return 0;
+    }
+    *result = number;
+
+    return 1;
+}
+
+/*
+    Change a setting by its name, from the text of its value, checking its range
+    Returns 1 on success, or 0 if the setting or the value is not valid
+*/
+int setConfig(server_config_t *config, const char *name, const char *value)
+{
+    if (strcmp(name, "max_games") == 0)
+    {
+        return readInteger(value, 0, &config->maxGames);
+    }
+    if (strcmp(name, "backlog") == 0)
+    {
+        return readInteger(value, 1, &config->backlog);
+    }
+    if (strcmp(name, "rate") == 0)
+    {
+        return readRate(value, &config->rate);
+    }
+    if (strcmp(name, "address_rate") == 0)
+    {
+        return readRate(value, &config->addressRate);
+    }
+    if (strcmp(name, "handshake_timeout") == 0)
+    {
+        return readInteger(value, 1, &config->handshakeTimeout);
+    }
+    if (strcmp(name, "log_level") == 0)
+    {
+        //By name or by number
+        for (int level = LOG_QUIET; level <= LOG_DEBUG; level++)
+        {
+            if (strcmp(value, logLevels[level]) == 0)
+            {
+                config->logLevel = level;
+                return 1;
+            }
+        }
+        return readInteger(value, LOG_QUIET, &config->logLevel) && config->logLevel <= LOG_DEBUG;
+    }
+
+    return 0;
+}
+
+/*
+    Write every setting to a client, one per line, with the names "set" takes
+*/
+void writeConfig(int fd, const server_config_t *config)
+{
+    dprintf(fd, "max_games %d\n", config->maxGames);
+    dprintf(fd, "backlog %d\n", config->backlog);
+    dprintf(fd, "rate %g\n", config->rate);
+    dprintf(fd, "address_rate %g\n", config->addressRate);
+    dprintf(fd, "handshake_timeout %d\n", config->handshakeTimeout);
+    dprintf(fd, "log_level %s\n", logLevels[config->logLevel]);
+    dprintf(fd, "draining %d\n", config->draining);
+}
+
+/*
+    Wait for the next whole line of a client, keeping what comes after it for the next call
+    Returns 1 with a command, 0 if the client left or sent a line too long, or -1 if woken by 'wake_fd'
+*/
+int nextCommand(admin_client_t *client, char *line, int wake_fd)
+{
+    struct pollfd events[2];
+    char *end;
+    ssize_t received;
+
+    while ((end = memchr(client->buffer, '\n', client->length)) == NULL)
+    {
+        if (client->length == ADMIN_LINE)
+        {
+            return 0;
+        }
+
+        events[0].fd = client->fd;
+        events[0].events = POLLIN;
+        events[0].revents = 0;
+        events[1].fd = wake_fd;
+        events[1].events = POLLIN;
+        events[1].revents = 0;
+        if (poll(events, 2, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fatalError("ERROR: poll");
+        }
+        if (events[1].revents)
+        {
+            return -1;
+        }
+
+        received = recv(client->fd, client->buffer + client->length, ADMIN_LINE - client->length, 0);
+        if (received <= 0)
+        {
+            return 0;
+        }
+        client->length += received;
+    }
+
+    //The line goes without its end, and without the carriage return of a terminal
+    *end = '\0';
+    if (end > client->buffer && end[-1] == '\r')
+    {
+        end[-1] = '\0';
+    }
+    strcpy(line, client->buffer);
+    client->length -= end + 1 - client->buffer;
+    memmove(client->buffer, end + 1, client->length);
+
+    return 1;
+}
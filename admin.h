@@ -0,0 +1,104 @@
+/*
+    Settings of the server that can be changed while it runs, and its control socket
+    - The games read the settings without any lock: a reader loads the pointer to the current
+      version, and the admin thread publishes a changed copy by swapping the pointer (RCU style)
+    - A replaced version is freed CONFIG_GRACE_SECONDS later. Readers never keep the pointer
+      across a wait, they load it again, so nobody can still be using it by then
+    - The control socket is a Unix endpoint ("-c unix:@fred-admin") that takes commands
+      as lines of text, and answers every one with lines ending in "OK" or "ERROR: ..."
+        status                  games running, clients waiting and the settings
+        set <setting> <value>   max_games, backlog, rate, address_rate, handshake_timeout, log_level
+        drain                   no new games: new clients are refused, the games running finish
+        resume                  form new games again
+*/
+
+#ifndef ADMIN_H
+#define ADMIN_H
+
+// Seconds a replaced version of the settings is kept before it is freed
+#define CONFIG_GRACE_SECONDS 5
+// Longest command line
+#define ADMIN_LINE 256
+
+// What the server prints
+typedef enum logLevel {LOG_QUIET, LOG_INFO, LOG_DEBUG} logLevel_t;
+
+// Settings that can be changed while the server runs
+typedef struct server_config_struct
+{
+    //Most games running at the same time, 0 for no limit
+    int maxGames;
+    //Backlog of the listeners
+    int backlog;
+    //New connections per second for everybody and for every address, 0 for no limit
+    double rate;
+    double addressRate;
+    //Seconds a TLS client has for every step of its handshake
+    int handshakeTimeout;
+    //LOG_QUIET only prints errors, LOG_INFO the games and the clients, LOG_DEBUG every update
+    int logLevel;
+    //Set while no new games are formed
+    int draining;
+} server_config_t;
+
+// One version of the settings
+typedef struct config_version_struct
+{
+    server_config_t config;
+    //Seconds when it was replaced
+    double retired;
+    struct config_version_struct *next;
+} config_version_t;
+
+// Settings of a server: the current version, and the replaced ones not freed yet
+typedef struct live_config_struct
+{
+    config_version_t *current;
+    config_version_t *retired;
+} live_config_t;
+
+// A client of the control socket, with what it sent that is not a whole line yet
+typedef struct admin_client_struct
+{
+    int fd;
+    char buffer[ADMIN_LINE];
+    int length;
+} admin_client_t;
+
+/*
+    Start with the first version of the settings
+*/
+void initConfig(live_config_t *live, const server_config_t *config);
+
+/*
+    Current version of the settings, without taking any lock
+    The pointer must not be kept across a wait
+*/
+const server_config_t *readConfig(live_config_t *live);
+
+/*
+    Make a copy of 'config' the current version, and free the versions replaced long enough ago
+    Only one thread may publish
+*/
+void publishConfig(live_config_t *live, const server_config_t *config);
+
+/*
+    Change a setting by its name, from the text of its value
+    Returns 1 on success, or 0 if the setting or the value is not valid
+*/
+int setConfig(server_config_t *config, const char *name, const char *value);
+
+/*
+    Write every setting to a client, one per line
+*/
+void writeConfig(int fd, const server_config_t *config);
+
+/*
+    Wait for the next command of a client of the control socket
+    The line is stored in 'line' without its end, with space for ADMIN_LINE characters
+    The wait also ends when 'wake_fd' becomes readable
+    Returns 1 with a command, 0 if the client left or sent a line too long, or -1 if woken by 'wake_fd'
+*/
+int nextCommand(admin_client_t *client, char *line, int wake_fd);
+
+#endif  /* NOT ADMIN_H */
@@ -0,0 +1,347 @@
+/*
+    Admission of new clients
+    See admission.h for the description
+*/
+
+// Needed for accept4
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "admission.h"
+#include "clock_time.h"
+#include "connection.h"
+#include "delta_update.h"
+#include "Game_Codes.h"
+
+/*
+    Fill a bucket with a second of tokens at 'rate' per second
+*/
+static void initBucket(token_bucket_t *bucket, double rate, double now)
+{
+    bucket->rate = rate;
+    bucket->tokens = rate;
+    bucket->last = now;
+}
+
+/*
+    Take a token from a bucket, after adding the ones earned since the last time
+    Returns 1 if there was one, or 0 otherwise. A bucket with no rate always has one
+*/
+static int takeToken(token_bucket_t *bucket, double now)
+{
+    if (bucket->rate <= 0)
+    {
+        return 1;
+    }
+
+    //Up to a second of tokens, and at least one so a low rate still lets a client in
+    double most = bucket->rate > 1 ? bucket->rate : 1;
+
+    bucket->tokens += (now - bucket->last) * bucket->rate;
+    bucket->last = now;
+    if (bucket->tokens > most)
+    {
+        bucket->tokens = most;
+    }
+    if (bucket->tokens < 1)
+    {
+        return 0;
+    }
+    bucket->tokens--;
+
+    return 1;
+}
+
+/*
+    Key of the address of a TCP client
+    Returns 1 with the key stored, or 0 for clients that don't have a limit of their own
+*/
+static int addressKey(int fd, uint64_t *key)
+{
+    struct sockaddr_storage address;
+    socklen_t size = sizeof address;
+
+    if (getpeername(fd, (struct sockaddr *)&address, &size) == -1)
+    {
+        return 0;
+    }
+
+    if (address.ss_family == AF_INET)
+    {
+        uint32_t ip = ntohl(((struct sockaddr_in *)&address)->sin_addr.s_addr);
+
+        *key = ip;
+        return (ip >> 24) != 127;
+    }
+    if (address.ss_family == AF_INET6)
+    {
+        struct in6_addr *ip = &((struct sockaddr_in6 *)&address)->sin6_addr;
+        //FNV-1a of the 16 bytes
+        uint64_t hash = 0xCBF29CE484222325ULL;
+
+        if (IN6_IS_ADDR_LOOPBACK(ip))
+        {
+            return 0;
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            hash = (hash ^ ip->s6_addr[i]) * 0x100000001B3ULL;
+        }
+        *key = hash;
+        return 1;
+    }
+
+    //Unix domain sockets
+    return 0;
+}
+
+/*
+    Set the limits in connections per second, 0 for no limit, with every bucket full
+*/
+void initAdmission(admission_t *admission, double rate, double addressRate)
+{
+    double now = seconds();
+
+    memset(admission, 0, sizeof *admission);
+    initBucket(&admission->global, rate, now);
+    admission->addressRate = addressRate;
+}
+
+/*
+    Change the limits, keeping the counts and the tokens saved
+*/
+void setLimits(admission_t *admission, double rate, double addressRate)
+{
+    admission->global.rate = rate;
+    //The buckets of the addresses start again with the new rate when used
+    admission->addressRate = addressRate;
+}
+
+/*
+    Read the limits from an option like "2000:50" (everybody : every address)
+    Returns 1 on success, or 0 if the option is not valid
+*/
+int parseAdmission(admission_t *admission, const char *option)
+{
+    double rate;
+    double addressRate;
+
+    if (sscanf(option, "%lf:%lf", &rate, &addressRate) != 2 || rate < 0 || addressRate < 0)
+    {
+        return 0;
+    }
+    initAdmission(admission, rate, addressRate);
+
+    return 1;
+}
+
+/*
+    Accept the clients waiting on a listener, up to 'max', without blocking
+    Returns the number of clients stored in 'fds'
+*/
+int acceptBatch(int listen_fd, int *fds, int max)
+{
+    int count = 0;
+
+    if (!(fcntl(listen_fd, F_GETFL) & O_NONBLOCK))
+    {
+        fcntl(listen_fd, F_SETFL, fcntl(listen_fd, F_GETFL) | O_NONBLOCK);
+    }
+
+    while (count < max)
+    {
+        // Clients are not inherited by programs started with exec, they are passed explicitly
+        int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+
+        if (fd == -1)
+        {
+            //Out of descriptors: the clients wait in the backlog until games end, without spinning
+            if (errno == EMFILE || errno == ENFILE)
+            {
+                usleep(1000);
+            }
+            break;
+        }
+        fds[count] = fd;
+        count++;
+    }
+
+    return count;
+}
+
+/*
+    Take a token for a client from the bucket of its address, then from the global one
+    Returns 1 if the client can come in, or 0 if it must be refused
+*/
+int admitClient(admission_t *admission, int fd)
+{
+    double now = seconds();
+    uint64_t key;
+
+    //The address is checked first, so a single address can't use up the global tokens
+    if (admission->addressRate > 0 && addressKey(fd, &key))
+    {
+        address_bucket_t *slot = &admission->addresses[key % ADMISSION_ADDRESSES];
+
+        if (slot->address != key || slot->bucket.rate != admission->addressRate)
+        {
+            slot->address = key;
+            initBucket(&slot->bucket, admission->addressRate, now);
+        }
+        if (!takeToken(&slot->bucket, now))
+        {
+            return 0;
+        }
+    }
+
+    if (!takeToken(&admission->global, now))
+    {
+        return 0;
+    }
+    __atomic_fetch_add(&admission->admitted, 1, __ATOMIC_RELAXED);
+
+    return 1;
+}
+
+/*
+    Send the update "server full" to a socket client and close it, other transports are only closed
+*/
+void refuseClient(admission_t *admission, int fd, int transport)
+{
+    connection_t connection;
+    delta_baseline_t baseline;
+    socketCommunication_t full;
+
+    __atomic_fetch_add(&admission->refused, 1, __ATOMIC_RELAXED);
+
+    if (transport == TRANSPORT_SOCKET)
+    {
+        openConnection(&connection, fd, TRANSPORT_SOCKET);
+        //What the client sent so far (its ID) is read, or the close would reset the connection
+        //before the client reads the answer
+        discardInput(&connection);
+        memset(&baseline, 0, sizeof baseline);
+        memset(&full, 0, sizeof full);
+        full.playerState = EXIT;
+        full.gameState = END;
+        //A new socket has room for it, the accepting thread never waits here
+        sendUpdate(&connection, &baseline, &full);
+        shutdown(fd, SHUT_WR);
+    }
+
+    close(fd);
+}
+
+/*
+    Prepare an empty queue of clients, open and not paused
+*/
+void initPending(pending_clients_t *pending)
+{
+    pending->first = 0;
+    pending->count = 0;
+    pending->closed = 0;
+    pending->paused = 0;
+    initMutex(&pending->mutex, "admission");
+    initCond(&pending->cond, "admissionCond");
+}
+
+/*
+    Add a client to the end of the queue and wake who waits for one
+    Returns 1 on success, or 0 if the queue is full or closed
+*/
+int pushClient(pending_clients_t *pending, int fd, int transport)
+{
+    int added = 0;
+
+    lockMutex(&pending->mutex);
+    if (!pending->closed && pending->count < ADMISSION_PENDING)
+    {
+        int last = (pending->first + pending->count) % ADMISSION_PENDING;
+
+        pending->fds[last] = fd;
+        pending->transports[last] = transport;
+        pending->count++;
+        added = 1;
+        signalCond(&pending->cond);
+    }
+    unlockMutex(&pending->mutex);
+
+    return added;
+}
+
+/*
+    Wait for the first client of the queue and take it
+    Returns its socket and stores its transport, or -1 once the queue is closed or while it is paused
+*/
+int popClient(pending_clients_t *pending, int *transport)
+{
+    int fd = -1;
+
+    lockMutex(&pending->mutex);
+    while (!pending->closed && !pending->paused && pending->count == 0)
+    {
+        waitCond(&pending->cond, &pending->mutex);
+    }
+    if (!pending->closed && !pending->paused)
+    {
+        fd = pending->fds[pending->first];
+        *transport = pending->transports[pending->first];
+        pending->first = (pending->first + 1) % ADMISSION_PENDING;
+        pending->count--;
+    }
+    unlockMutex(&pending->mutex);
+
+    return fd;
+}
+
+/*
+    Pause or resume the queue, and wake who waits for a client so it sees the change
+*/
+void pausePending(pending_clients_t *pending, int paused)
+{
+    lockMutex(&pending->mutex);
+    pending->paused = paused;
+    broadcastCond(&pending->cond);
+    unlockMutex(&pending->mutex);
+}
+
+/*
+    Close the queue and wake who waits for a client
+*/
+void closePending(pending_clients_t *pending)
+{
+    lockMutex(&pending->mutex);
+    pending->closed = 1;
+    broadcastCond(&pending->cond);
+    unlockMutex(&pending->mutex);
+}
+
+/*
+    Take up to 'max' clients from the front of the queue without waiting
+    Returns the number of clients stored
+*/
+int drainClients(pending_clients_t *pending, int *fds, int *transports, int max)
+{
+    int count = 0;
+
+    lockMutex(&pending->mutex);
+    while (count < max && pending->count > 0)
+    {
+        fds[count] = pending->fds[pending->first];
+        transports[count] = pending->transports[pending->first];
+        pending->first = (pending->first + 1) % ADMISSION_PENDING;
+        pending->count--;
+        count++;
+    }
+    unlockMutex(&pending->mutex);
+
+    return count;
+}
@@ -0,0 +1,140 @@
+/*
+    Admission of new clients, so a burst of connections never leaves clients hanging
+    - The listeners are drained all the time by one thread (the supervisor loop with -w),
+      which accepts every client waiting at once, not one per wakeup
+    - Token buckets limit the connections per second of everybody together and of every
+      address. Clients on loopback and Unix sockets only count for the global limit,
+      so local bots are not taken for an attack
+    - Clients accepted wait in a bounded queue until formGame takes them
+    - A client over the limits or with the queue full gets an update with the state EXIT
+      ("server full") and is closed. Shared memory and TLS clients are only closed,
+      they can't be sent anything before their setup
+*/
+
+#ifndef ADMISSION_H
+#define ADMISSION_H
+
+#include <stdint.h>
+
+#include "lock_profile.h"
+
+// Clients accepted and waiting to join a game, more are turned away
+#define ADMISSION_PENDING 1024
+// Clients accepted from a listener in one go
+#define ADMISSION_BATCH 64
+// Addresses with their own bucket, an address that falls on a used slot takes it over
+#define ADMISSION_ADDRESSES 4096
+// Default connections per second for everybody and for every address
+#define ADMISSION_RATE 2000
+#define ADMISSION_ADDRESS_RATE 50
+
+// Token bucket: 'rate' tokens per second, up to a second of them saved
+typedef struct token_bucket_struct
+{
+    double tokens;
+    double rate;
+    //Seconds of the last refill
+    double last;
+} token_bucket_t;
+
+typedef struct address_bucket_struct
+{
+    uint64_t address;
+    token_bucket_t bucket;
+} address_bucket_t;
+
+// Limits and their buckets, only used by the thread that accepts (the refused clients are counted by others too)
+typedef struct admission_struct
+{
+    token_bucket_t global;
+    double addressRate;
+    address_bucket_t addresses[ADMISSION_ADDRESSES];
+    //Atomic counters, the admin socket reads them from another thread
+    long admitted;
+    long refused;
+} admission_t;
+
+// Clients accepted and waiting for formGame
+typedef struct pending_clients_struct
+{
+    int fds[ADMISSION_PENDING];
+    int transports[ADMISSION_PENDING];
+    int first;
+    int count;
+    //Set when no more clients must be taken (a hot restart)
+    int closed;
+    //Set while nobody must wait for clients (the server is draining)
+    int paused;
+    profiled_mutex_t mutex;
+    profiled_cond_t cond;
+} pending_clients_t;
+
+/*
+    Set the limits in connections per second, 0 for no limit
+*/
+void initAdmission(admission_t *admission, double rate, double addressRate);
+
+/*
+    Change the limits, keeping the counts and the tokens saved
+*/
+void setLimits(admission_t *admission, double rate, double addressRate);
+
+/*
+    Read the limits from an option like "2000:50" (everybody : every address)
+    Returns 1 on success, or 0 if the option is not valid
+*/
+int parseAdmission(admission_t *admission, const char *option);
+
+/*
+    Accept the clients waiting on a listener, up to 'max', without blocking
+    The listener is made non blocking the first time
+    Returns the number of clients stored in 'fds'
+*/
+int acceptBatch(int listen_fd, int *fds, int max);
+
+/*
+    Check a client that was just accepted against the limits, and take its tokens
+    Returns 1 if the client can come in, or 0 if it must be refused
+*/
+int admitClient(admission_t *admission, int fd);
+
+/*
+    Tell a client the server is full, and close it
+*/
+void refuseClient(admission_t *admission, int fd, int transport);
+
+/*
+    Prepare an empty queue of clients
+*/
+void initPending(pending_clients_t *pending);
+
+/*
+    Add a client to the queue
+    Returns 1 on success, or 0 if the queue is full or closed
+*/
+int pushClient(pending_clients_t *pending, int fd, int transport);
+
+/*
+    Wait for the next client in the queue
+    Returns its socket and stores its transport, or -1 once the queue is closed or while it is paused
+*/
+int popClient(pending_clients_t *pending, int *transport);
+
+/*
+    Make popClient return -1 at once while the queue is paused (1), or wait again (0)
+*/
+void pausePending(pending_clients_t *pending, int paused);
+
+/*
+    Close the queue, nobody waits for clients any more
+    The clients still in it can be taken with drainClients
+*/
+void closePending(pending_clients_t *pending);
+
+/*
+    Take up to 'max' clients out of the queue without waiting
+    Returns the number of clients stored
+*/
+int drainClients(pending_clients_t *pending, int *fds, int *transports, int max);
+
+#endif  /* NOT ADMISSION_H */
@@ -0,0 +1,163 @@
+/*
+    Summaries of the games for analytics
+    See analytics.h for the description
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "analytics.h"
+#include "clock_time.h"
+
+// Longest name of a batch file
+#define ANALYTICS_PATH 4096
+
+// Names of the tables and of their columns, in the order of the fields of the rows
+static const char *tableNames[ANALYTICS_TABLES] = {"games", "players"};
+static const char *gameColumns[] = {"game", "start", "duration", "max_sequence", "players", "turns", "winner", "resumed"};
+static const char *playerColumns[] = {"game", "seat", "id", "elimination", "colors", "reaction_total", "reaction_max"};
+static const char **columnNames[ANALYTICS_TABLES] = {gameColumns, playerColumns};
+
+/*
+    Prepare empty batches written to 'directory'
+    Returns 1 on success, or 0 if the directory can't be written
+*/
+int openAnalytics(analytics_t *analytics, const char *directory)
+{
+    int columns[ANALYTICS_TABLES] = {sizeof(analytics_game_t) / sizeof(int64_t), sizeof(analytics_player_t) / sizeof(int64_t)};
+
+    if (access(directory, W_OK | X_OK) == -1)
+    {
+        return 0;
+    }
+
+    analytics->directory = directory;
+    analytics->files = 0;
+    for (int table = 0; table < ANALYTICS_TABLES; table++)
+    {
+        analytics->batches[table].values = malloc(columns[table] * ANALYTICS_BATCH * sizeof(int64_t));
+        analytics->batches[table].columns = columns[table];
+        analytics->batches[table].rows = 0;
+    }
+
+    return 1;
+}
+
+/*
+    Write the rows of a batch to a new file and empty it
+    A batch that can't be written is lost, the games go on
+*/
+static void writeBatch(analytics_t *analytics, int table)
+{
+    analytics_batch_t *batch = &analytics->batches[table];
+    analytics_header_t header;
+    char name[ANALYTICS_NAME];
+    char temporary[ANALYTICS_PATH];
+    char path[ANALYTICS_PATH];
+    FILE *file;
+    int written;
+
+    snprintf(temporary, sizeof temporary, "%s/%s-%d.tmp", analytics->directory, tableNames[table], getpid());
+
+    memcpy(header.magic, ANALYTICS_MAGIC, sizeof header.magic);
+    header.table = table;
+    header.columns = batch->columns;
+    header.rows = batch->rows;
+
+    file = fopen(temporary, "wb");
+    written = file != NULL && fwrite(&header, sizeof header, 1, file) == 1;
+    for (int column = 0; written && column < batch->columns; column++)
+    {
+        memset(name, 0, sizeof name);
+        strncpy(name, columnNames[table][column], sizeof name - 1);
+        written = fwrite(name, sizeof name, 1, file) == 1;
+    }
+    //Only the rows in use of every column
+    for (int column = 0; written && column < batch->columns; column++)
+    {
+        written = fwrite(&batch->values[column * ANALYTICS_BATCH], sizeof(int64_t), batch->rows, file) == (size_t)batch->rows;
+    }
+    if (file != NULL && fclose(file) != 0)
+    {
+        written = 0;
+    }
+
+    //Unlike rename, link never replaces a file: the batches of an earlier process with the
+    //same PID are kept, and this one takes the next free number
+    while (written)
+    {
+        snprintf(path, sizeof path, "%s/%s-%d-%d.ffa", analytics->directory, tableNames[table], getpid(), analytics->files);
+        analytics->files++;
+        if (link(temporary, path) == 0)
+        {
+            break;
+        }
+        written = errno == EEXIST;
+    }
+
+    if (!written)
+    {
+        fprintf(stderr, "ERROR: can't write a batch of %s to %s\n", tableNames[table], analytics->directory);
+    }
+    unlink(temporary);
+    batch->rows = 0;
+}
+
+/*
+    Add a row to the columns of the batch of its table, and write the batch if it is full
+*/
+void addRecord(analytics_t *analytics, analytics_record_t *record)
+{
+    analytics_batch_t *batch = &analytics->batches[record->table];
+    //The fields of the rows are the columns, all of them int64_t
+    const int64_t *values = record->table == ANALYTICS_GAMES ? (const int64_t *)&record->row.game : (const int64_t *)&record->row.player;
+
+    if (batch->rows == 0)
+    {
+        batch->first = seconds();
+    }
+    for (int column = 0; column < batch->columns; column++)
+    {
+        batch->values[column * ANALYTICS_BATCH + batch->rows] = values[column];
+    }
+    batch->rows++;
+
+    if (batch->rows == ANALYTICS_BATCH)
+    {
+        writeBatch(analytics, record->table);
+    }
+}
+
+/*
+    Write the batches whose first row waited ANALYTICS_FLUSH_SECONDS
+*/
+void flushAnalytics(analytics_t *analytics)
+{
+    double now = seconds();
+
+    for (int table = 0; table < ANALYTICS_TABLES; table++)
+    {
+        if (analytics->batches[table].rows > 0 && now - analytics->batches[table].first >= ANALYTICS_FLUSH_SECONDS)
+        {
+            writeBatch(analytics, table);
+        }
+    }
+}
+
+/*
+    Write the batches that have any row and free them
+*/
+void closeAnalytics(analytics_t *analytics)
+{
+    for (int table = 0; table < ANALYTICS_TABLES; table++)
+    {
+        if (analytics->batches[table].rows > 0)
+        {
+            writeBatch(analytics, table);
+        }
+        free(analytics->batches[table].values);
+    }
+}
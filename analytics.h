@@ -0,0 +1,135 @@
+/*
+    Summaries of the games for analytics, written as batches of columns to a directory
+    - Every game that ends gives one row of the games table, and every player that was out
+      or won gives one row of the players table when it leaves
+    - The game threads only put the rows in a lock-free queue with many producers and one
+      consumer (mpsc_queue.h), like the results of the stats, and a full queue drops the row
+      instead of making a game wait. The thread that takes them out adds every row to the
+      columns of a batch
+    - A batch is written to a file of its own when it has ANALYTICS_BATCH rows, or when its
+      first row is ANALYTICS_FLUSH_SECONDS old so a quiet server still exports. A file is
+      written with a temporary name and linked to its own, so readers never see a batch half
+      written and a file is never replaced
+    - Batch file, in the byte order of the server:
+        analytics_header_t
+        name of every column, ANALYTICS_NAME bytes each, ended by zeros
+        the values of every column, one int64_t for each row, one column after the other
+      Named "<table>-<pid>-<number>.ffa", tables "games" and "players". The numbers a
+      process with the same PID left are skipped
+    - The times are in microseconds. A game resumed after a hot restart counts from the
+      restart, and the players have no reaction times from before it
+*/
+
+#ifndef ANALYTICS_H
+#define ANALYTICS_H
+
+#include <stdint.h>
+
+// Rows that can wait in the queue, a power of 2
+#define ANALYTICS_QUEUE_SIZE 4096
+// Rows of a full batch
+#define ANALYTICS_BATCH 1024
+// Seconds the first row of a batch waits at most before the batch is written
+#define ANALYTICS_FLUSH_SECONDS 60
+// Bytes of a column name in the files
+#define ANALYTICS_NAME 16
+// First bytes of a batch file
+#define ANALYTICS_MAGIC "FFA1"
+
+// Tables of the rows
+typedef enum analyticsTable {ANALYTICS_GAMES, ANALYTICS_PLAYERS, ANALYTICS_TABLES} analyticsTable_t;
+
+// Row of the games table, every field is a column in this order
+typedef struct analytics_game_struct
+{
+    //Unique for every game: process ID and number of the game in the process
+    int64_t game;
+    //Wall clock time when the game started, and how long it was played
+    int64_t start;
+    int64_t duration;
+    //Colors of the sequence at the end
+    int64_t longestSequence;
+    int64_t players;
+    int64_t turns;
+    //Seat of the winner, -1 if everybody lost
+    int64_t winner;
+    //Set if the game came from the old server in a hot restart
+    int64_t resumed;
+} analytics_game_t;
+
+// Row of the players table, every field is a column in this order
+typedef struct analytics_player_struct
+{
+    int64_t game;
+    int64_t seat;
+    //ID the player gave when it connected
+    int64_t id;
+    //Order in which the player was out, from 1, or 0 for the winner
+    int64_t elimination;
+    //Colors played, and the time between the update that asked for every one and its arrival
+    int64_t colors;
+    int64_t reactionTotal;
+    int64_t reactionMax;
+} analytics_player_t;
+
+// Row on its way to the batches
+typedef struct analytics_record_struct
+{
+    int table;
+    union
+    {
+        analytics_game_t game;
+        analytics_player_t player;
+    } row;
+} analytics_record_t;
+
+// File header of a batch
+typedef struct analytics_header_struct
+{
+    char magic[4];
+    uint32_t table;
+    uint32_t columns;
+    uint32_t rows;
+} analytics_header_t;
+
+// Batch of one table being filled, a column after the other
+typedef struct analytics_batch_struct
+{
+    int64_t *values;
+    int columns;
+    int rows;
+    //Seconds when the first row was added
+    double first;
+} analytics_batch_t;
+
+// Batches of all the tables, only used by one thread at a time
+typedef struct analytics_struct
+{
+    const char *directory;
+    analytics_batch_t batches[ANALYTICS_TABLES];
+    //Number of the next batch file, skipping the ones already taken
+    int files;
+} analytics_t;
+
+/*
+    Prepare empty batches written to 'directory'
+    Returns 1 on success, or 0 if the directory can't be written
+*/
+int openAnalytics(analytics_t *analytics, const char *directory);
+
+/*
+    Add a row to the batch of its table, and write the batch if it is full
+*/
+void addRecord(analytics_t *analytics, analytics_record_t *record);
+
+/*
+    Write the batches whose first row waited ANALYTICS_FLUSH_SECONDS
+*/
+void flushAnalytics(analytics_t *analytics);
+
+/*
+    Write the batches that have any row and free them
+*/
+void closeAnalytics(analytics_t *analytics);
+
+#endif  /* NOT ANALYTICS_H */
@@ -0,0 +1,32 @@
+/*
+    Readings of the clocks
+    See clock_time.h for the description
+*/
+
+#include <time.h>
+
+#include "clock_time.h"
+
+/*
+    Seconds of the monotonic clock, for rates and deadlines
+*/
+double seconds(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/*
+    Microseconds of a clock, CLOCK_MONOTONIC for durations or CLOCK_REALTIME for dates
+*/
+int64_t microseconds(int clock)
+{
+    struct timespec now;
+
+    clock_gettime(clock, &now);
+
+    return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
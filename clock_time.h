@@ -0,0 +1,20 @@
+/*
+    Readings of the clocks, in the units the modules of the server work with
+*/
+
+#ifndef CLOCK_TIME_H
+#define CLOCK_TIME_H
+
+#include <stdint.h>
+
+/*
+    Seconds of the monotonic clock, for rates and deadlines
+*/
+double seconds(void);
+
+/*
+    Microseconds of a clock, CLOCK_MONOTONIC for durations or CLOCK_REALTIME for dates
+*/
+int64_t microseconds(int clock);
+
+#endif  /* NOT CLOCK_TIME_H */
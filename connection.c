@@ -0,0 +1,383 @@
+/*
+    Connection abstraction used for every client of the game
+    The same calls work for TCP / Unix domain sockets and for the shared memory transport
+*/
+
+#include <errno.h>
+#include <poll.h>
+
+#include "connection.h"
+#include "ktls.h"
+#include "clock_time.h"
+
+// Prefix that marks an endpoint as a shared memory transport
+#define SHM_PREFIX "shm:"
+// Prefix that marks an endpoint as an encrypted TCP transport
+#define TLS_PREFIX "tls:"
+
+/*
+    Check if an endpoint string names a shared memory transport
+    Returns 1 for "shm:/path" or "shm:@name", or 0 otherwise
+*/
+int isShmEndpoint(const char *endpoint)
+{
+    return endpoint != NULL && strncmp(endpoint, SHM_PREFIX, strlen(SHM_PREFIX)) == 0;
+}
+
+/*
+    Check if an endpoint string names an encrypted TCP transport
+    Returns 1 for "tls:port" or "tls:address", or 0 otherwise
+*/
+int isTlsEndpoint(const char *endpoint)
+{
+    return endpoint != NULL && strncmp(endpoint, TLS_PREFIX, strlen(TLS_PREFIX)) == 0;
+}
+
+/*
+    Find the transport used by the clients of an endpoint
+    Returns one of the values of transport_t
+*/
+int endpointTransport(const char *endpoint)
+{
+    if (isShmEndpoint(endpoint))
+    {
+        return TRANSPORT_SHM;
+    }
+    if (isTlsEndpoint(endpoint))
+    {
+        return TRANSPORT_TLS;
+    }
+
+    return TRANSPORT_SOCKET;
+}
+
+/*
+    Translate a shared memory endpoint into the Unix socket used to set it up
+*/
+static void setupEndpoint(const char *endpoint, char *buffer, int size)
+{
+    snprintf(buffer, size, "unix:%s", endpoint + strlen(SHM_PREFIX));
+}
+
+/*
+    Prepare and open the listening socket for any kind of endpoint
+    Shared memory endpoints listen on the Unix domain socket with the same name,
+    and encrypted ones on their TCP port
+    Returns the file descriptor for the socket
+*/
+int listenEndpoint(char *endpoint, int max_queue)
+{
+    char unixEndpoint[BUFSIZ];
+
+    if (isShmEndpoint(endpoint))
+    {
+        setupEndpoint(endpoint, unixEndpoint, sizeof unixEndpoint);
+        return initServer(unixEndpoint, max_queue);
+    }
+    if (isTlsEndpoint(endpoint))
+    {
+        // The certificate is loaded now, so a missing file is found before any client comes
+        tlsSetup(1);
+        return initServer(endpoint + strlen(TLS_PREFIX), max_queue);
+    }
+
+    return initServer(endpoint, max_queue);
+}
+
+/*
+    Wrap a socket that was just accepted, in storage given by the caller
+    With TRANSPORT_SHM the client is expected to pass its shared memory region first,
+    and with TRANSPORT_TLS to make the handshake
+    Returns 1 on success, or 0 if the client left or failed during the setup
+*/
+int openConnection(connection_t *connection, int fd, int transport)
+{
+    connection->fd = fd;
+    connection->shm = NULL;
+
+    if (transport == TRANSPORT_TLS && !tlsAccept(fd))
+    {
+        close(fd);
+        return 0;
+    }
+    if (transport == TRANSPORT_SHM)
+    {
+        connection->shm = shmAttach(fd);
+        if (connection->shm == NULL)
+        {
+            close(fd);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+    Wrap a connection received from another server process during a hot restart
+    'memory_fd' is the shared memory region of the client, or -1 for plain sockets
+    Returns 1 on success, or 0 if the region could not be mapped
+*/
+int adoptConnection(connection_t *connection, int fd, int memory_fd)
+{
+    connection->fd = fd;
+    connection->shm = NULL;
+
+    if (memory_fd != -1)
+    {
+        connection->shm = shmAdopt(memory_fd, fd);
+        if (connection->shm == NULL)
+        {
+            close(memory_fd);
+            close(fd);
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+    Connect to the server on any kind of endpoint
+    The port is ignored for Unix domain socket and shared memory endpoints
+    Returns the new connection
+*/
+connection_t *connectServer(char *address, char *port)
+{
+    char unixEndpoint[BUFSIZ];
+    connection_t *connection = malloc(sizeof(connection_t));
+
+    if (isTlsEndpoint(address))
+    {
+        address += strlen(TLS_PREFIX);
+        openConnection(connection, connectSocket(address, port), TRANSPORT_SOCKET);
+        if (!tlsConnect(connection->fd, address))
+        {
+            exit(EXIT_FAILURE);
+        }
+        return connection;
+    }
+    if (!isShmEndpoint(address))
+    {
+        openConnection(connection, connectSocket(address, port), TRANSPORT_SOCKET);
+        return connection;
+    }
+
+    setupEndpoint(address, unixEndpoint, sizeof unixEndpoint);
+    openConnection(connection, connectSocket(unixEndpoint, NULL), TRANSPORT_SOCKET);
+
+    connection->shm = shmCreate(connection->fd);
+    if (connection->shm == NULL)
+    {
+        fatalError("ERROR: shared memory");
+    }
+
+    return connection;
+}
+
+/*
+    Connect to a server running in this process, through shared memory rings and no socket
+    The side of the server is stored in 'server', in storage given by the caller
+    Returns the new connection of the client
+*/
+connection_t *connectLocal(connection_t *server)
+{
+    connection_t *connection = malloc(sizeof(connection_t));
+
+    connection->fd = -1;
+    connection->shm = shmLocal(&server->shm);
+    if (connection->shm == NULL)
+    {
+        fatalError("ERROR: shared memory");
+    }
+    server->fd = -1;
+
+    return connection;
+}
+
+/*
+    Send a whole message
+    Returns 1 on success, or 0 if the connection has finished
+*/
+int sendMessage(connection_t *connection, const void *buffer, size_t size)
+{
+    size_t sent = 0;
+    ssize_t chars_sent;
+
+    if (connection->shm != NULL)
+    {
+        return shmSend(connection->shm, buffer, size);
+    }
+
+    // A stream socket may take only part of the message
+    while (sent < size)
+    {
+        chars_sent = send(connection->fd, (const char *)buffer + sent, size - sent, MSG_NOSIGNAL);
+        if (chars_sent == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // The client went away or its path broke (EPIPE, ECONNRESET, ETIMEDOUT, EHOSTUNREACH...),
+            // only this connection is finished
+            return 0;
+        }
+        sent += chars_sent;
+    }
+
+    return 1;
+}
+
+/*
+    Wait until a message can be received without blocking, or the connection finished
+    The wait also ends when 'wake_fd' becomes readable, or after 'milliseconds' (-1 for no limit)
+    Returns 1 when the connection is readable, 0 if woken by 'wake_fd', or -1 if the time ran out
+*/
+int waitReadable(connection_t *connection, int wake_fd, int milliseconds)
+{
+    double deadline = seconds() + milliseconds / 1000.0;
+    struct pollfd events[2];
+    int timeout = milliseconds;
+    int ready;
+
+    if (connection->shm != NULL)
+    {
+        return shmWaitReadable(connection->shm, wake_fd, milliseconds);
+    }
+
+    events[0].fd = connection->fd;
+    events[0].events = POLLIN;
+    events[1].fd = wake_fd;
+    events[1].events = POLLIN;
+
+    while (1)
+    {
+        events[0].revents = 0;
+        events[1].revents = 0;
+        ready = poll(events, 2, timeout);
+        if (ready == -1)
+        {
+            if (errno == EINTR)
+            {
+                //Only the time left
+                if (milliseconds >= 0)
+                {
+                    timeout = (deadline - seconds()) * 1000;
+                    timeout = timeout < 0 ? 0 : timeout;
+                }
+                continue;
+            }
+            fatalError("ERROR: poll");
+        }
+        if (ready == 0)
+        {
+            return -1;
+        }
+
+        // Data that already arrived goes first
+        if (events[0].revents)
+        {
+            return 1;
+        }
+        if (events[1].revents)
+        {
+            return 0;
+        }
+    }
+}
+
+/*
+    Receive a whole message of the given size
+    Returns 1 on successful receipt, or 0 if the connection has finished
+*/
+int recvMessage(connection_t *connection, void *buffer, size_t size)
+{
+    size_t received = 0;
+    ssize_t chars_read;
+
+    if (connection->shm != NULL)
+    {
+        return shmRecv(connection->shm, buffer, size);
+    }
+
+    while (received < size)
+    {
+        chars_read = recv(connection->fd, (char *)buffer + received, size - received, 0);
+        if (chars_read == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            // A reset, a broken path, or with kTLS a record that is not data (an alert) or can't
+            // be decrypted: only this connection is finished
+            return 0;
+        }
+        // Connection finished
+        if (chars_read == 0)
+        {
+            return 0;
+        }
+        received += chars_read;
+    }
+
+    return 1;
+}
+
+/*
+    Drop whatever the peer sent that was not received yet, without waiting for more
+*/
+void discardInput(connection_t *connection)
+{
+    char buffer[256];
+
+    if (connection->shm != NULL)
+    {
+        shmDiscard(connection->shm);
+        return;
+    }
+
+    while (recv(connection->fd, buffer, sizeof buffer, MSG_DONTWAIT) > 0)
+    {
+    }
+}
+
+/*
+    Close a connection kept in storage of the caller
+*/
+void shutConnection(connection_t *connection)
+{
+    if (connection->shm != NULL)
+    {
+        shmClose(connection->shm);
+    }
+
+    if (connection->fd != -1)
+    {
+        close(connection->fd);
+    }
+}
+
+/*
+    Close a connection from connectServer and free its memory
+*/
+void closeConnection(connection_t *connection)
+{
+    shutConnection(connection);
+    free(connection);
+}
+
+/*
+    Free the local resources of a connection that another process has taken over
+    The client does not notice anything, the storage still belongs to the caller
+*/
+void releaseConnection(connection_t *connection)
+{
+    if (connection->shm != NULL)
+    {
+        shmRelease(connection->shm);
+    }
+
+    close(connection->fd);
+}
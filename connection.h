@@ -0,0 +1,125 @@
+/*
+    Connection abstraction used for every client of the game
+    The same calls work for TCP / Unix domain sockets and for the shared memory transport
+    - Shared memory endpoints are written "shm:/path" or "shm:@name",
+      and are set up over a Unix domain socket with the same name
+    - Encrypted TCP endpoints are written "tls:port" in the server and "tls:address" in the client,
+      after the handshake they are plain sockets (see ktls.h)
+*/
+
+#ifndef CONNECTION_H
+#define CONNECTION_H
+
+#include <stddef.h>
+
+#include "sockets.h"
+#include "shm_ring.h"
+
+// Transport used by the clients of a listener
+typedef enum transport {TRANSPORT_SOCKET, TRANSPORT_SHM, TRANSPORT_TLS} transport_t;
+
+typedef struct connection_struct
+{
+    //Socket to the peer. With shared memory it is only used for setup and to detect hangups,
+    //and it is -1 for a server in the same process
+    int fd;
+    //Shared memory rings, NULL for plain sockets
+    shm_link_t *shm;
+} connection_t;
+
+/*
+    Check if an endpoint string names a shared memory transport
+    Returns 1 for "shm:/path" or "shm:@name", or 0 otherwise
+*/
+int isShmEndpoint(const char *endpoint);
+
+/*
+    Check if an endpoint string names an encrypted TCP transport
+    Returns 1 for "tls:port" or "tls:address", or 0 otherwise
+*/
+int isTlsEndpoint(const char *endpoint);
+
+/*
+    Find the transport used by the clients of an endpoint
+    Returns one of the values of transport_t
+*/
+int endpointTransport(const char *endpoint);
+
+/*
+    Prepare and open the listening socket for any kind of endpoint
+    Shared memory endpoints listen on the Unix domain socket with the same name,
+    and encrypted ones on their TCP port
+    Returns the file descriptor for the socket
+*/
+int listenEndpoint(char *endpoint, int max_queue);
+
+/*
+    Wrap a socket that was just accepted, in storage given by the caller
+    With TRANSPORT_SHM the client is expected to pass its shared memory region first,
+    and with TRANSPORT_TLS to make the handshake
+    Returns 1 on success, or 0 if the client left or failed during the setup
+*/
+int openConnection(connection_t *connection, int fd, int transport);
+
+/*
+    Wrap a connection received from another server process during a hot restart
+    'memory_fd' is the shared memory region of the client, or -1 for plain sockets
+    Returns 1 on success, or 0 if the region could not be mapped
+*/
+int adoptConnection(connection_t *connection, int fd, int memory_fd);
+
+/*
+    Connect to the server on any kind of endpoint
+    The port is ignored for Unix domain socket and shared memory endpoints
+    Returns the new connection
+*/
+connection_t *connectServer(char *address, char *port);
+
+/*
+    Connect to a server running in this process, through shared memory rings and no socket
+    The side of the server is stored in 'server', in storage given by the caller
+    Returns the new connection of the client
+*/
+connection_t *connectLocal(connection_t *server);
+
+/*
+    Send a whole message
+    Returns 1 on success, or 0 if the connection has finished
+*/
+int sendMessage(connection_t *connection, const void *buffer, size_t size);
+
+/*
+    Wait until a message can be received without blocking, or the connection finished
+    The wait also ends when 'wake_fd' becomes readable, or after 'milliseconds' (-1 for no limit)
+    Returns 1 when the connection is readable, 0 if woken by 'wake_fd', or -1 if the time ran out
+*/
+int waitReadable(connection_t *connection, int wake_fd, int milliseconds);
+
+/*
+    Receive a whole message of the given size
+    Returns 1 on successful receipt, or 0 if the connection has finished
+*/
+int recvMessage(connection_t *connection, void *buffer, size_t size);
+
+/*
+    Drop whatever the peer sent that was not received yet, without waiting for more
+*/
+void discardInput(connection_t *connection);
+
+/*
+    Close a connection kept in storage of the caller
+*/
+void shutConnection(connection_t *connection);
+
+/*
+    Close a connection from connectServer and free its memory
+*/
+void closeConnection(connection_t *connection);
+
+/*
+    Free the local resources of a connection that another process has taken over
+    The client does not notice anything, the storage still belongs to the caller
+*/
+void releaseConnection(connection_t *connection);
+
+#endif  /* NOT CONNECTION_H */
@@ -0,0 +1,130 @@
+/*
+    Updates of the game from the server to a client, sent as the changes to what the client has
+    See delta_update.h for the description
+*/
+
+#include <stddef.h>
+
+#include "delta_update.h"
+
+// Position of every field in the struct, in the order of the bits of the mask
+static const size_t fieldOffsets[DELTA_FIELDS] =
+{
+    offsetof(socketCommunication_t, playersExpected),
+    offsetof(socketCommunication_t, playerState),
+    offsetof(socketCommunication_t, gameState),
+    offsetof(socketCommunication_t, color),
+    offsetof(socketCommunication_t, wrongColor),
+    offsetof(socketCommunication_t, newColor),
+    offsetof(socketCommunication_t, newRound)
+};
+
+/*
+    Field number 'i' of a state, to change it
+*/
+static int *field(socketCommunication_t *state, int i)
+{
+    return (int *)((char *)state + fieldOffsets[i]);
+}
+
+/*
+    Value of the field number 'i' of a state
+*/
+static int fieldValue(const socketCommunication_t *state, int i)
+{
+    return *(const int *)((const char *)state + fieldOffsets[i]);
+}
+
+/*
+    Send the fields of 'state' that changed since the baseline, or all of them in a keyframe,
+    and keep 'state' as the new baseline
+    Returns 1 on success, or 0 if the connection has finished
+*/
+int sendUpdate(connection_t *connection, delta_baseline_t *baseline, const socketCommunication_t *state)
+{
+    //The mask and at most every field
+    int32_t message[DELTA_FIELDS + 1];
+    int32_t mask = 0;
+    int values = 0;
+    int keyframe = baseline->toKeyframe == 0;
+
+    for (int i = 0; i < DELTA_FIELDS; i++)
+    {
+        int value = fieldValue(state, i);
+
+        if (keyframe || value != fieldValue(&baseline->state, i))
+        {
+            mask |= 1 << i;
+            values++;
+            message[values] = value;
+        }
+    }
+
+    if (keyframe)
+    {
+        mask |= DELTA_KEYFRAME;
+        baseline->toKeyframe = DELTA_KEYFRAME_INTERVAL;
+    }
+    baseline->toKeyframe--;
+    baseline->state = *state;
+    message[0] = mask;
+
+    return sendMessage(connection, message, (values + 1) * sizeof(int32_t));
+}
+
+/*
+    Bytes of an update with the fields of 'mask', the mask included
+*/
+size_t updateSize(int32_t mask)
+{
+    int values = 0;
+
+    for (int i = 0; i < DELTA_FIELDS; i++)
+    {
+        values += (mask >> i) & 1;
+    }
+
+    return (values + 1) * sizeof(int32_t);
+}
+
+/*
+    Copy the values of an update to the fields of 'state' its mask has
+*/
+void applyUpdate(const int32_t *message, socketCommunication_t *state)
+{
+    int values = 1;
+
+    for (int i = 0; i < DELTA_FIELDS; i++)
+    {
+        if (message[0] & (1 << i))
+        {
+            *field(state, i) = message[values];
+            values++;
+        }
+    }
+}
+
+/*
+    Receive the mask of an update and then the values it announces, and apply them to 'state'
+    Returns 1 on success, or 0 if the connection has finished
+*/
+int recvUpdate(connection_t *connection, socketCommunication_t *state)
+{
+    //The mask and at most every field
+    int32_t message[DELTA_FIELDS + 1];
+    size_t size;
+
+    if (!recvMessage(connection, &message[0], sizeof(int32_t)))
+    {
+        return 0;
+    }
+
+    size = updateSize(message[0]);
+    if (size > sizeof(int32_t) && !recvMessage(connection, &message[1], size - sizeof(int32_t)))
+    {
+        return 0;
+    }
+    applyUpdate(message, state);
+
+    return 1;
+}
@@ -0,0 +1,70 @@
+/*
+    Updates of the game from the server to a client, sent as the changes to what the client has
+    - Every update is a mask with one bit per field of socketCommunication_t that changed,
+      followed by the new values of those fields only, in the order of the struct
+    - The server keeps for every connection the state the client was last sent (its baseline).
+      The transports deliver everything in order, so the client has the baseline as soon as
+      it was sent and no acknowledgement is needed
+    - A keyframe has every field: the first update on a connection, after a hot restart
+      or a new tournament match (the baseline is lost and the client resyncs),
+      and every DELTA_KEYFRAME_INTERVAL updates anyway
+    - The messages from the client to the server are still the whole struct
+*/
+
+#ifndef DELTA_UPDATE_H
+#define DELTA_UPDATE_H
+
+#include <stdint.h>
+
+#include "connection.h"
+
+// Fields of socketCommunication_t
+#define DELTA_FIELDS 7
+// Bit of the mask set in a keyframe
+#define DELTA_KEYFRAME (1 << DELTA_FIELDS)
+// Updates after which a keyframe is sent even if the client is in sync
+#define DELTA_KEYFRAME_INTERVAL 64
+
+//The struct to be sent to the client
+typedef struct socket_Communication
+{
+    int playersExpected;
+    int playerState;
+    int gameState;
+    int color;
+    int wrongColor;
+    int newColor;
+    int newRound;
+} socketCommunication_t;
+
+// What a client has of the state, as the server knows it
+typedef struct delta_baseline_struct
+{
+    socketCommunication_t state;
+    //Updates left until the next keyframe, a baseline filled with zeros gets a keyframe first
+    int toKeyframe;
+} delta_baseline_t;
+
+/*
+    Server side: send 'state' to a client as the changes from its baseline, which is updated
+    Returns 1 on success, or 0 if the connection has finished
+*/
+int sendUpdate(connection_t *connection, delta_baseline_t *baseline, const socketCommunication_t *state);
+
+/*
+    Client side: receive an update and apply it to 'state', the last state received
+    Returns 1 on success, or 0 if the connection has finished
+*/
+int recvUpdate(connection_t *connection, socketCommunication_t *state);
+
+/*
+    Bytes of a whole update, the mask included, for programs that read the updates themselves
+*/
+size_t updateSize(int32_t mask);
+
+/*
+    Apply a whole update, starting with its mask, to 'state'
+*/
+void applyUpdate(const int32_t *message, socketCommunication_t *state);
+
+#endif  /* NOT DELTA_UPDATE_H */
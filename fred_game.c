@@ -0,0 +1,276 @@
+/*
+    Rules of Fabulous Fred as a state machine
+    See fred_game.h for the description
+*/
+
+#include <string.h>
+
+#include "fred_game.h"
+
+/*
+    Words of one bit per player
+*/
+static inline int aliveCount(int players)
+{
+    return (players + 63) / 64;
+}
+
+/*
+    Take a player out of the bitset, and its word out of the summary when it is the last one
+*/
+static inline void removePlayer(fred_game_t *game, int player)
+{
+    int word = player / 64;
+
+    game->alive[word] &= ~(1ULL << (player % 64));
+    if (game->alive[word] == 0)
+    {
+        game->aliveWords[word / 64] &= ~(1ULL << (word % 64));
+    }
+}
+
+/*
+    First word of players at or after 'word' that still has somebody in the game
+    Returns the word, or -1 if there is none
+*/
+static int nextWord(fred_game_t *game, int word)
+{
+    int words = aliveCount(game->players);
+    int summary = word / 64;
+    uint64_t bits;
+
+    if (word >= words)
+    {
+        return -1;
+    }
+
+    bits = game->aliveWords[summary] & (~0ULL << (word % 64));
+    while (bits == 0)
+    {
+        summary++;
+        if (summary * 64 >= words)
+        {
+            return -1;
+        }
+        bits = game->aliveWords[summary];
+    }
+
+    return summary * 64 + __builtin_ctzll(bits);
+}
+
+/*
+    First player at or after 'player' that is still in the game
+    Returns the player, or -1 if there is none
+*/
+static int nextAlive(fred_game_t *game, int player)
+{
+    int word = player / 64;
+    uint64_t bits;
+
+    if (player >= game->players)
+    {
+        return -1;
+    }
+
+    bits = game->alive[word] & (~0ULL << (player % 64));
+    if (bits == 0)
+    {
+        word = nextWord(game, word + 1);
+        if (word == -1)
+        {
+            return -1;
+        }
+        bits = game->alive[word];
+    }
+
+    return word * 64 + __builtin_ctzll(bits);
+}
+
+/*
+    Set the first 'count' bits of a bitset and clear the rest of its last word
+*/
+static void fillBits(uint64_t *bits, int count)
+{
+    for (int i = 0; i < count / 64; i++)
+    {
+        bits[i] = ~0ULL;
+    }
+    if (count % 64 != 0)
+    {
+        bits[count / 64] = (1ULL << (count % 64)) - 1;
+    }
+}
+
+/*
+    Give the turn to the next player still in the game
+    The player that had the turn waits, unless it is the only one left
+    Every player skipped still counts as a turn taken
+*/
+static void nextTurn(fred_game_t *game, int active)
+{
+    int next = (game->turnCounter + 1) % game->players;
+    int turns = 1;
+
+    //Usually the next player is still there, otherwise the bitset finds the one after the gap
+    if (game->playerStates[next] == LOSER)
+    {
+        next = nextAlive(game, next);
+        //Start again from the first player
+        if (next == -1)
+        {
+            next = nextAlive(game, 0);
+        }
+        if (next == -1)
+        {
+            return;
+        }
+        turns = next > game->playerTurn ? next - game->playerTurn : next + game->players - game->playerTurn;
+    }
+
+    game->turnCounter += turns;
+    game->playerTurn = next;
+    game->playerStates[active] = PWAIT;
+    game->playerStates[next] = PACTIVE;
+}
+
+/*
+    End the game when only one player is left, who is the winner,
+    or when nobody is left. A player alone can't win
+*/
+static void checkEnd(fred_game_t *game)
+{
+    if (game->players != 1 && game->players - game->losers == 1)
+    {
+        game->winner = nextAlive(game, 0);
+        game->playerStates[game->winner] = WINNER;
+        game->gameState = END;
+    }
+    else if (game->losers == game->players)
+    {
+        game->gameState = END;
+    }
+}
+
+/*
+    Start a game where the first player has the turn
+    'playerStates' must have space for 'players' states
+    'alive' must have space for FRED_ALIVE_WORDS(players) words
+    'sequence' must have space for 'capacity' colors
+*/
+void fredStart(fred_game_t *game, int players, int *playerStates, uint64_t *alive, int *sequence, int capacity)
+{
+    game->players = players;
+    game->playerStates = playerStates;
+    for (int i = 0; i < players; i++)
+    {
+        playerStates[i] = PWAIT;
+    }
+    playerStates[0] = PACTIVE;
+
+    //Everybody is in the game, whole words at once
+    game->alive = alive;
+    game->aliveWords = alive + aliveCount(players);
+    fillBits(game->alive, players);
+    fillBits(game->aliveWords, aliveCount(players));
+    game->winner = -1;
+    game->gameState = GACTIVE;
+    game->playerTurn = 0;
+    game->turnCounter = 0;
+    game->losers = 0;
+    game->sequence = sequence;
+    game->sequenceSize = 0;
+    game->capacity = capacity;
+    game->index = 0;
+}
+
+/*
+    Rebuild the players still in the game from their states,
+    after the rest of the game was restored from a copy
+    'alive' must have space for FRED_ALIVE_WORDS(players) words
+*/
+void fredRestore(fred_game_t *game, uint64_t *alive)
+{
+    int words = aliveCount(game->players);
+
+    game->alive = alive;
+    game->aliveWords = alive + words;
+    memset(alive, 0, FRED_ALIVE_WORDS(game->players) * sizeof(uint64_t));
+
+    for (int i = 0; i < game->players; i++)
+    {
+        if (game->playerStates[i] != LOSER)
+        {
+            game->alive[i / 64] |= 1ULL << (i % 64);
+        }
+    }
+    for (int word = 0; word < words; word++)
+    {
+        if (game->alive[word] != 0)
+        {
+            game->aliveWords[word / 64] |= 1ULL << (word % 64);
+        }
+    }
+}
+
+/*
+    Play a color for the active player and store the result in 'update'
+    Returns FRED_PLAYED,
+    FRED_FULL if the color had to be added but the sequence has no space (nothing is changed,
+    the caller can copy the sequence to a larger storage and update 'sequence' and 'capacity'),
+    or FRED_OVER if the game has already ended
+*/
+fredResult_t fredPlay(fred_game_t *game, int color, fred_update_t *update)
+{
+    int active = game->playerTurn;
+
+    if (game->gameState != GACTIVE)
+    {
+        return FRED_OVER;
+    }
+
+    update->color = color;
+
+    //The whole sequence was repeated, the color is a new one
+    if (game->index == game->sequenceSize)
+    {
+        if (game->sequenceSize == game->capacity)
+        {
+            return FRED_FULL;
+        }
+
+        game->sequence[game->sequenceSize] = color;
+        game->sequenceSize++;
+
+        //Now it's another player's turn, who starts from the beginning
+        nextTurn(game, active);
+        game->index = 0;
+        update->wrongColor = 0;
+        update->newColor = 0;
+        update->newRound = 1;
+    }
+    //The color has to match the sequence
+    else if (color == game->sequence[game->index])
+    {
+        game->index++;
+        update->wrongColor = 0;
+        //Check if the player has to add a new color next
+        update->newColor = game->index == game->sequenceSize;
+        update->newRound = 0;
+    }
+    //Wrong color, the player is out and the next one starts from the beginning
+    else
+    {
+        nextTurn(game, active);
+        game->playerStates[active] = LOSER;
+        removePlayer(game, active);
+        game->losers++;
+        game->index = 0;
+        update->wrongColor = 1;
+        update->newColor = 0;
+        update->newRound = 1;
+    }
+
+    checkEnd(game);
+
+    return FRED_PLAYED;
+}
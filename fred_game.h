@@ -0,0 +1,90 @@
+/*
+    Rules of Fabulous Fred as a state machine (libfred)
+    - No input / output, no threads and no memory allocation:
+      the caller gives the storage and feeds the colors played one by one
+    - Every color played produces one update, which the server sends to every player
+    - Used by the server for the real games and by the simulator for offline games
+    - The players still in the game are kept in a two level bitset, so passing the turn,
+      kicking out a loser and finding the winner take constant time even with
+      thousands of players (mass elimination games)
+*/
+
+#ifndef FRED_GAME_H
+#define FRED_GAME_H
+
+#include <stdint.h>
+
+#include "Game_Codes.h"
+
+// Words of storage needed for the players still in a game
+// One bit per player, plus one bit per word of players telling if any of them is left
+#define FRED_ALIVE_WORDS(players) (((players) + 63) / 64 + ((players) + 4095) / 4096)
+
+// Results of playing a color
+typedef enum fredResult {FRED_PLAYED, FRED_FULL, FRED_OVER} fredResult_t;
+
+// State of one game
+typedef struct fred_game_struct
+{
+    int players;
+    //State of every player: PWAIT, PACTIVE, LOSER or WINNER
+    int *playerStates;
+    //Bit set for every player still in the game, in storage given by the caller
+    uint64_t *alive;
+    //Bit set for every word of 'alive' that is not zero, stored after it
+    uint64_t *aliveWords;
+    //Winner of the game, -1 while there is none
+    int winner;
+    //GACTIVE while playing, END when there is a winner or everybody lost
+    int gameState;
+    //Player whose turn it is
+    int playerTurn;
+    //Turns taken since the beginning of the game
+    int turnCounter;
+    int losers;
+    //Colors to remember, in storage given by the caller
+    int *sequence;
+    int sequenceSize;
+    int capacity;
+    //Position in the sequence of the active player
+    int index;
+} fred_game_t;
+
+// Result of a color played, as seen by every player
+typedef struct fred_update_struct
+{
+    //Color played
+    int color;
+    //Set if the color did not match the sequence
+    int wrongColor;
+    //Set if the active player has to add a new color next
+    int newColor;
+    //Set if the next color played starts a round from the beginning of the sequence
+    int newRound;
+} fred_update_t;
+
+/*
+    Start a game where the first player has the turn
+    'playerStates' must have space for 'players' states
+    'alive' must have space for FRED_ALIVE_WORDS(players) words
+    'sequence' must have space for 'capacity' colors
+*/
+void fredStart(fred_game_t *game, int players, int *playerStates, uint64_t *alive, int *sequence, int capacity);
+
+/*
+    Rebuild the players still in the game from their states,
+    after the rest of the game was restored from a copy
+    'alive' must have space for FRED_ALIVE_WORDS(players) words
+*/
+void fredRestore(fred_game_t *game, uint64_t *alive);
+
+/*
+    Play a color for the active player and store the result in 'update'
+    Returns FRED_PLAYED,
+    FRED_FULL if the color had to be added but the sequence has no space (nothing is changed,
+    the caller can copy the sequence to a larger storage and update 'sequence' and 'capacity'),
+    or FRED_OVER if the game has already ended
+*/
+fredResult_t fredPlay(fred_game_t *game, int color, fred_update_t *update);
+
+#endif  /* NOT FRED_GAME_H */
@@ -0,0 +1,47 @@
+/*
+    Static tracepoints (USDT) of the server and the client, provider "fred"
+    - With <sys/sdt.h> (package systemtap-sdt-dev) every probe is one nop in the code and a note
+      in the program file, so it costs nothing until a tracer like bpftrace attaches to it
+    - Without that header, or built with NO_PROBES, the probes are left out
+    - See bpftrace/ for scripts using them
+
+    Server probes, 'game' is a number given to every game by its process:
+        accept(fd, id)                          a client connected and sent its player ID
+        recv(game, player, index, color)        the color of the active player arrived
+        check(game, player, index, wrong, new)  the rules judged the color
+        turn(game, player, turns, index)        the turn passed to another player
+        broadcast_start(game, round, index)     the update is ready for every player
+        broadcast_end(game, round, index)       every player still in the game got the update
+        game_end(game, winner, turns, colors)   the game ended, 'winner' is -1 if nobody won
+    Client probes, 'id' is the player ID sent to the server:
+        send_color(id, color)                   the color picked was sent
+        recv_update(id, color, wrong, state)    an update of the game arrived
+*/
+
+#ifndef FRED_PROBES_H
+#define FRED_PROBES_H
+
+#if !defined(NO_PROBES) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define FRED_PROBES
+#endif
+#endif
+
+#ifdef FRED_PROBES
+
+#define FRED_PROBE2(name, a, b) DTRACE_PROBE2(fred, name, a, b)
+#define FRED_PROBE3(name, a, b, c) DTRACE_PROBE3(fred, name, a, b, c)
+#define FRED_PROBE4(name, a, b, c, d) DTRACE_PROBE4(fred, name, a, b, c, d)
+#define FRED_PROBE5(name, a, b, c, d, e) DTRACE_PROBE5(fred, name, a, b, c, d, e)
+
+#else
+
+#define FRED_PROBE2(name, a, b) ((void)0)
+#define FRED_PROBE3(name, a, b, c) ((void)0)
+#define FRED_PROBE4(name, a, b, c, d) ((void)0)
+#define FRED_PROBE5(name, a, b, c, d, e) ((void)0)
+
+#endif  /* FRED_PROBES */
+
+#endif  /* NOT FRED_PROBES_H */
@@ -0,0 +1,112 @@
+/*
+    Hot restart of the server
+    See hot_restart.h for the description
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+
+#include "hot_restart.h"
+#include "sockets.h"
+#include "fatal_error.h"
+
+/*
+    Start the new server program, with the resume option in front of the arguments
+    The options and endpoints are passed again, so the new server can restart itself later
+    Returns the socket to send the state through
+*/
+int startNewServer(char *program, char **arguments, int numArguments)
+{
+    int channel[2];
+    char channelText[16];
+    char *newArguments[numArguments + 4];
+    pid_t pid;
+
+    // Both ends are closed on exec, the child clears the flag on its own end
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, channel) == -1)
+    {
+        fatalError("ERROR: socketpair");
+    }
+
+    fflush(stdout);
+
+    pid = fork();
+    if (pid == -1)
+    {
+        fatalError("ERROR: fork");
+    }
+
+    if (pid == 0)
+    {
+        fcntl(channel[1], F_SETFD, 0);
+        sprintf(channelText, "%d", channel[1]);
+
+        newArguments[0] = program;
+        newArguments[1] = RESUME_OPTION;
+        newArguments[2] = channelText;
+        for (int i = 0; i < numArguments; i++)
+        {
+            newArguments[i + 3] = arguments[i];
+        }
+        newArguments[numArguments + 3] = NULL;
+
+        execvp(program, newArguments);
+        fatalError("ERROR: execvp");
+    }
+
+    close(channel[1]);
+
+    return channel[0];
+}
+
+/*
+    Send one record with its data and file descriptors
+*/
+void sendHandoff(int channel_fd, handoffType_t type, const void *data, int size, int *fds, int numFds)
+{
+    handoff_header_t header;
+
+    header.type = type;
+    header.size = size;
+    header.numFds = numFds;
+
+    if (!sendFds(channel_fd, &header, sizeof header, fds, numFds))
+    {
+        fatalError("ERROR: new server is gone");
+    }
+
+    if (size > 0 && send(channel_fd, data, size, MSG_NOSIGNAL) != size)
+    {
+        fatalError("ERROR: send");
+    }
+}
+
+/*
+    Receive one record
+    The data is allocated with malloc and stored in 'data', it must be freed by the caller
+    The file descriptors are stored in 'fds', which must have space for MAX_PASSED_FDS
+    Returns 1 on success, or 0 if the old server is gone
+*/
+int recvHandoff(int channel_fd, handoff_header_t *header, void **data, int *fds)
+{
+    int received;
+
+    received = recvFds(channel_fd, header, sizeof *header, fds, MAX_PASSED_FDS);
+    if (received == -1 || received != header->numFds || header->size < 0)
+    {
+        return 0;
+    }
+
+    *data = malloc(header->size > 0 ? header->size : 1);
+    if (header->size > 0 && recv(channel_fd, *data, header->size, MSG_WAITALL) != header->size)
+    {
+        free(*data);
+        return 0;
+    }
+
+    return 1;
+}
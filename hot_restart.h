@@ -0,0 +1,52 @@
+/*
+    Hot restart of the server
+    - On SIGUSR2 the running server starts a new copy of its program,
+      connected to it through a Unix socket pair
+    - The old server hands every game over at its next safe point, while the
+      active player is being waited for, including the sockets of the players.
+      The color sequence follows the game a chunk at a time, however long it is
+    - Then the clients accepted that were not in a game yet, the settings with the
+      control socket and the listening sockets follow, and the old server exits
+    - The new server resumes the games where they were, the clients do not notice
+*/
+
+#ifndef HOT_RESTART_H
+#define HOT_RESTART_H
+
+// Command line option that tells the new server where to receive the state from
+#define RESUME_OPTION "--resume"
+
+// Types of records sent from the old server to the new one, new types go last so older servers can still hand over
+typedef enum handoffType {HANDOFF_GAME, HANDOFF_PLAYER, HANDOFF_LISTENERS, HANDOFF_END, HANDOFF_CLIENTS, HANDOFF_ADMIN, HANDOFF_SEQUENCE} handoffType_t;
+
+// Header that goes in front of every record
+typedef struct handoff_header_struct
+{
+    int type;
+    //Bytes of data after the header
+    int size;
+    //File descriptors passed with the header
+    int numFds;
+} handoff_header_t;
+
+/*
+    Start the new server program, with the resume option in front of the arguments
+    The options and endpoints are passed again, so the new server can restart itself later
+    Returns the socket to send the state through
+*/
+int startNewServer(char *program, char **arguments, int numArguments);
+
+/*
+    Send one record with its data and file descriptors
+*/
+void sendHandoff(int channel_fd, handoffType_t type, const void *data, int size, int *fds, int numFds);
+
+/*
+    Receive one record
+    The data is allocated with malloc and stored in 'data', it must be freed by the caller
+    The file descriptors are stored in 'fds', which must have space for MAX_PASSED_FDS
+    Returns 1 on success, or 0 if the old server is gone
+*/
+int recvHandoff(int channel_fd, handoff_header_t *header, void **data, int *fds);
+
+#endif  /* NOT HOT_RESTART_H */
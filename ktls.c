@@ -0,0 +1,344 @@
+/*
+    Encrypted transport with the records done by the kernel (kTLS)
+    See ktls.h for the description
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "ktls.h"
+#include "fatal_error.h"
+
+// Seconds, changed by the admin socket while handshakes may be running
+static int handshakeTimeout = TLS_HANDSHAKE_TIMEOUT;
+
+/*
+    Change the longest wait for a step of the handshake, read by every new handshake
+*/
+void tlsSetTimeout(int seconds)
+{
+    __atomic_store_n(&handshakeTimeout, seconds, __ATOMIC_RELAXED);
+}
+
+#ifdef FRED_TLS
+
+#include <netinet/tcp.h>
+#include <linux/tls.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+#include <openssl/hmac.h>
+#include <openssl/x509v3.h>
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+
+// Length of the traffic secrets of TLS_AES_128_GCM_SHA256
+#define SECRET_LENGTH 32
+
+// Traffic secrets of a handshake, taken from the key log of OpenSSL
+typedef struct tls_secrets_struct
+{
+    unsigned char client[SECRET_LENGTH];
+    unsigned char server[SECRET_LENGTH];
+    //One bit for each secret found
+    int found;
+} tls_secrets_t;
+
+static SSL_CTX *contexts[2];
+static pthread_once_t setupOnce[2] = {PTHREAD_ONCE_INIT, PTHREAD_ONCE_INIT};
+// Whether the client checks the name of the server, only against the certificates of the system
+static int checkHost;
+
+/*
+    Keep the traffic secrets of the application data when OpenSSL logs them
+*/
+static void keepSecret(const SSL *ssl, const char *line)
+{
+    tls_secrets_t *secrets = SSL_get_app_data(ssl);
+    char label[32];
+    char hex[SECRET_LENGTH * 2 + 1];
+    unsigned char *secret;
+    int bit;
+
+    if (sscanf(line, "%31s %*s %64s", label, hex) != 2 || strlen(hex) != SECRET_LENGTH * 2)
+    {
+        return;
+    }
+    if (strcmp(label, "CLIENT_TRAFFIC_SECRET_0") == 0)
+    {
+        secret = secrets->client;
+        bit = 1;
+    }
+    else if (strcmp(label, "SERVER_TRAFFIC_SECRET_0") == 0)
+    {
+        secret = secrets->server;
+        bit = 2;
+    }
+    else
+    {
+        return;
+    }
+
+    for (int i = 0; i < SECRET_LENGTH; i++)
+    {
+        sscanf(hex + i * 2, "%2hhx", &secret[i]);
+    }
+    secrets->found |= bit;
+    OPENSSL_cleanse(hex, sizeof hex);
+}
+
+/*
+    HKDF-Expand-Label of TLS 1.3 with SHA-256 and no context, for up to 32 bytes
+*/
+static void expandLabel(const unsigned char *secret, const char *label, unsigned char *out, int length)
+{
+    unsigned char info[64];
+    unsigned char block[SECRET_LENGTH];
+    unsigned int blockLength;
+    int labelLength = strlen("tls13 ") + strlen(label);
+    int size = 0;
+
+    info[size++] = 0;
+    info[size++] = length;
+    info[size++] = labelLength;
+    memcpy(info + size, "tls13 ", 6);
+    memcpy(info + size + 6, label, strlen(label));
+    size += labelLength;
+    info[size++] = 0;
+    //The first block of HKDF-Expand is enough
+    info[size++] = 1;
+
+    HMAC(EVP_sha256(), secret, SECRET_LENGTH, info, size, block, &blockLength);
+    memcpy(out, block, length);
+    OPENSSL_cleanse(block, sizeof block);
+}
+
+/*
+    Give the kernel the key of one direction of the socket (TLS_TX or TLS_RX)
+    Returns 1 on success, or 0 otherwise
+*/
+static int setKey(int fd, int direction, const unsigned char *secret)
+{
+    struct tls12_crypto_info_aes_gcm_128 info;
+    unsigned char iv[TLS_CIPHER_AES_GCM_128_SALT_SIZE + TLS_CIPHER_AES_GCM_128_IV_SIZE];
+    int result;
+
+    memset(&info, 0, sizeof info);
+    info.info.version = TLS_1_3_VERSION;
+    info.info.cipher_type = TLS_CIPHER_AES_GCM_128;
+    expandLabel(secret, "key", info.key, TLS_CIPHER_AES_GCM_128_KEY_SIZE);
+    //The 12 bytes of the IV of TLS 1.3 are split into the salt and the rest
+    expandLabel(secret, "iv", iv, sizeof iv);
+    memcpy(info.salt, iv, TLS_CIPHER_AES_GCM_128_SALT_SIZE);
+    memcpy(info.iv, iv + TLS_CIPHER_AES_GCM_128_SALT_SIZE, TLS_CIPHER_AES_GCM_128_IV_SIZE);
+    //The records of the application start at 0 in TLS 1.3
+
+    result = setsockopt(fd, SOL_TLS, direction, &info, sizeof info);
+    OPENSSL_cleanse(&info, sizeof info);
+
+    return result == 0;
+}
+
+/*
+    Context of OpenSSL for TLS 1.3 with the only cipher kTLS is given, logging the secrets
+    Returns the context, or NULL on error
+*/
+static SSL_CTX *newContext(const SSL_METHOD *method)
+{
+    SSL_CTX *context = SSL_CTX_new(method);
+
+    if (context == NULL)
+    {
+        return NULL;
+    }
+    SSL_CTX_set_min_proto_version(context, TLS1_3_VERSION);
+    SSL_CTX_set_max_proto_version(context, TLS1_3_VERSION);
+    SSL_CTX_set_ciphersuites(context, "TLS_AES_128_GCM_SHA256");
+    SSL_CTX_set_keylog_callback(context, keepSecret);
+
+    return context;
+}
+
+/*
+    Context of the server, with its certificate and key, without session tickets
+    Exits with a message if they can't be read
+*/
+static void setupServer()
+{
+    const char *certificate = getenv(TLS_CERT_VARIABLE) != NULL ? getenv(TLS_CERT_VARIABLE) : "fred.crt";
+    const char *key = getenv(TLS_KEY_VARIABLE) != NULL ? getenv(TLS_KEY_VARIABLE) : "fred.key";
+    SSL_CTX *context = newContext(TLS_server_method());
+
+    //No session tickets: a record sent after the handshake would reach the kernel of the client as if it were data
+    if (context == NULL || SSL_CTX_set_num_tickets(context, 0) != 1
+        || SSL_CTX_use_certificate_chain_file(context, certificate) != 1
+        || SSL_CTX_use_PrivateKey_file(context, key, SSL_FILETYPE_PEM) != 1)
+    {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "ERROR: TLS certificate %s or key %s\n", certificate, key);
+        exit(EXIT_FAILURE);
+    }
+    contexts[1] = context;
+}
+
+/*
+    Context of the client, checking the server against FRED_TLS_CA or the certificates of the system
+    Exits with a message if they can't be read
+*/
+static void setupClient()
+{
+    const char *authority = getenv(TLS_CA_VARIABLE);
+    SSL_CTX *context = newContext(TLS_client_method());
+
+    if (context == NULL)
+    {
+        ERR_print_errors_fp(stderr);
+        exit(EXIT_FAILURE);
+    }
+    SSL_CTX_set_verify(context, SSL_VERIFY_PEER, NULL);
+    //A certificate given by the user is trusted for any name, the ones of the system only for their own
+    if (authority != NULL ? SSL_CTX_load_verify_locations(context, authority, NULL) != 1 : SSL_CTX_set_default_verify_paths(context) != 1)
+    {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "ERROR: TLS certificates %s\n", authority != NULL ? authority : "of the system");
+        exit(EXIT_FAILURE);
+    }
+    checkHost = authority == NULL;
+    contexts[0] = context;
+}
+
+/*
+    Make the handshake and move both directions of the socket to the kernel
+    Returns 1 on success, or 0 otherwise
+*/
+static int handshake(int fd, int server, const char *host)
+{
+    tls_secrets_t secrets;
+    struct timeval timeout = {__atomic_load_n(&handshakeTimeout, __ATOMIC_RELAXED), 0};
+    struct timeval noTimeout = {0, 0};
+    SSL *ssl;
+    int done;
+
+    pthread_once(&setupOnce[server], server ? setupServer : setupClient);
+    memset(&secrets, 0, sizeof secrets);
+    ssl = SSL_new(contexts[server]);
+    if (ssl == NULL || !SSL_set_fd(ssl, fd))
+    {
+        ERR_print_errors_fp(stderr);
+        SSL_free(ssl);
+        return 0;
+    }
+    SSL_set_app_data(ssl, &secrets);
+    if (!server && checkHost)
+    {
+        //An address is checked as an IP of the certificate, anything else as its name
+        if (X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), host) != 1)
+        {
+            SSL_set1_host(ssl, host);
+        }
+        SSL_set_tlsext_host_name(ssl, host);
+    }
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout);
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof timeout);
+    done = (server ? SSL_accept(ssl) : SSL_connect(ssl)) == 1;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &noTimeout, sizeof noTimeout);
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &noTimeout, sizeof noTimeout);
+
+    //Anything OpenSSL read past the handshake would be lost to the kernel
+    if (!done || secrets.found != 3 || SSL_has_pending(ssl))
+    {
+        ERR_print_errors_fp(stderr);
+        fprintf(stderr, "ERROR: TLS handshake\n");
+        done = 0;
+    }
+    else if (setsockopt(fd, SOL_TCP, TCP_ULP, "tls", sizeof "tls") == -1)
+    {
+        perror("ERROR: kernel TLS is not available (modprobe tls)");
+        done = 0;
+    }
+    else if (!setKey(fd, TLS_TX, server ? secrets.server : secrets.client) || !setKey(fd, TLS_RX, server ? secrets.client : secrets.server))
+    {
+        perror("ERROR: kernel TLS keys");
+        done = 0;
+    }
+
+    //Only the state of OpenSSL goes away, the socket stays open
+    SSL_free(ssl);
+    OPENSSL_cleanse(&secrets, sizeof secrets);
+
+    return done;
+}
+
+/*
+    Make the handshake of the server on an accepted socket and move it to kTLS
+    Returns 1 on success, or 0 otherwise
+*/
+int tlsAccept(int fd)
+{
+    return handshake(fd, 1, NULL);
+}
+
+/*
+    Make the handshake of the client on a connected socket and move it to kTLS
+    Returns 1 on success, or 0 otherwise
+*/
+int tlsConnect(int fd, const char *host)
+{
+    return handshake(fd, 0, host);
+}
+
+/*
+    Load the certificates of the server or the client, only the first time
+*/
+void tlsSetup(int server)
+{
+    pthread_once(&setupOnce[server], server ? setupServer : setupClient);
+}
+
+#else
+
+/*
+    Tell the user that this build has no TLS
+*/
+static void notBuilt()
+{
+    fprintf(stderr, "ERROR: built without TLS, use \"make TLS=1\"\n");
+}
+
+/*
+    Without TLS no handshake can be made
+    Returns 0
+*/
+int tlsAccept(int fd)
+{
+    notBuilt();
+    return 0;
+}
+
+/*
+    Without TLS no handshake can be made
+    Returns 0
+*/
+int tlsConnect(int fd, const char *host)
+{
+    notBuilt();
+    return 0;
+}
+
+/*
+    Without TLS a tls: endpoint stops the program at once
+*/
+void tlsSetup(int server)
+{
+    notBuilt();
+    exit(EXIT_FAILURE);
+}
+
+#endif  /* FRED_TLS */
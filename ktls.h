@@ -0,0 +1,51 @@
+/*
+    Encrypted transport for TCP endpoints ("tls:port" in the server, "tls:address" in the client)
+    - The TLS 1.3 handshake is made in user space with OpenSSL, then the keys are given to the
+      kernel (kTLS, setsockopt SOL_TLS) for both directions. From then on the socket is used
+      with the plain send / recv of connection.c: the broadcast makes no extra copy and takes
+      no lock of a TLS library, and the socket can still be passed to a worker or in a hot restart
+    - Only the cipher TLS_AES_128_GCM_SHA256, which every kernel with kTLS supports
+    - The server reads its certificate and key from the files in FRED_TLS_CERT and FRED_TLS_KEY
+      (fred.crt and fred.key by default). The client checks the certificate of the server
+      against the file in FRED_TLS_CA, or the certificates of the system if it is not set
+    - Needs the "tls" module of the kernel, and a build with "make TLS=1".
+      Otherwise every tls: connection fails with a message
+*/
+
+#ifndef KTLS_H
+#define KTLS_H
+
+// Variables with the files used by the transport
+#define TLS_CERT_VARIABLE "FRED_TLS_CERT"
+#define TLS_KEY_VARIABLE "FRED_TLS_KEY"
+#define TLS_CA_VARIABLE "FRED_TLS_CA"
+// Longest wait for a step of the handshake, so a silent client doesn't hold the server
+#define TLS_HANDSHAKE_TIMEOUT 5
+
+/*
+    Load the certificates for the server (1) or the client (0), only the first time
+    Called when the endpoint is opened, so a missing file stops the program at once
+    Exits with a message on errors
+*/
+void tlsSetup(int server);
+
+/*
+    Server side: make the handshake on a socket that was just accepted and move it to kTLS
+    Returns 1 on success, or 0 if the handshake or kTLS failed (the socket is left open)
+*/
+int tlsAccept(int fd);
+
+/*
+    Client side: make the handshake on a socket connected to the server and move it to kTLS
+    'host' is the address the client connected to, checked when FRED_TLS_CA is not set
+    Returns 1 on success, or 0 if the handshake or kTLS failed
+*/
+int tlsConnect(int fd, const char *host);
+
+/*
+    Change the longest wait for a step of the handshake, TLS_HANDSHAKE_TIMEOUT seconds by default
+    Takes effect with the next handshake
+*/
+void tlsSetTimeout(int seconds);
+
+#endif  /* NOT KTLS_H */
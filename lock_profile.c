@@ -0,0 +1,335 @@
+/*
+    Profiling of the mutexes and condition variables of the server
+    See lock_profile.h for the description
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "lock_profile.h"
+
+#ifdef LOCK_PROFILE
+
+// Most classes of locks
+#define MAX_LOCK_CLASSES 16
+
+// Classes created so far, never removed
+static lock_class_t lockClasses[MAX_LOCK_CLASSES];
+static int numClasses = 0;
+static pthread_mutex_t classesMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+    Class with a name, created the first time it is asked for
+*/
+static lock_class_t *findClass(const char *name)
+{
+    lock_class_t *lockClass = NULL;
+
+    pthread_mutex_lock(&classesMutex);
+    for (int i = 0; i < numClasses && lockClass == NULL; i++)
+    {
+        if (strcmp(lockClasses[i].name, name) == 0)
+        {
+            lockClass = &lockClasses[i];
+        }
+    }
+    if (lockClass == NULL)
+    {
+        if (numClasses == MAX_LOCK_CLASSES)
+        {
+            fprintf(stderr, "ERROR: too many lock classes\n");
+            exit(EXIT_FAILURE);
+        }
+        lockClass = &lockClasses[numClasses];
+        lockClass->name = name;
+        numClasses++;
+    }
+    pthread_mutex_unlock(&classesMutex);
+
+    return lockClass;
+}
+
+/*
+    Nanoseconds of the monotonic clock
+*/
+static uint64_t now(void)
+{
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+
+    return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+/*
+    Add to a counter shared by all the threads of a class
+*/
+static void count(uint64_t *counter, uint64_t amount)
+{
+    __atomic_fetch_add(counter, amount, __ATOMIC_RELAXED);
+}
+
+/*
+    Add a time to a total and its histogram
+*/
+static void addSample(uint64_t *total, uint64_t *histogram, uint64_t nanoseconds)
+{
+    int bucket = nanoseconds == 0 ? 0 : 64 - __builtin_clzll(nanoseconds);
+
+    if (bucket >= LOCK_BUCKETS)
+    {
+        bucket = LOCK_BUCKETS - 1;
+    }
+    count(total, nanoseconds);
+    count(&histogram[bucket], 1);
+}
+
+/*
+    Prepare a mutex that counts for the class 'name'
+*/
+void initMutex(profiled_mutex_t *mutex, const char *name)
+{
+    pthread_mutex_init(&mutex->mutex, NULL);
+    mutex->lockClass = findClass(name);
+    mutex->lockedAt = 0;
+    mutex->woken = 0;
+}
+
+/*
+    Destroy a mutex, its class keeps the stats
+*/
+void destroyMutex(profiled_mutex_t *mutex)
+{
+    pthread_mutex_destroy(&mutex->mutex);
+}
+
+/*
+    Take a mutex, recording how long the thread waited for it
+*/
+void lockMutex(profiled_mutex_t *mutex)
+{
+    lock_class_t *lockClass = mutex->lockClass;
+    uint64_t start;
+
+    //A free mutex is taken without reading the clock twice
+    if (pthread_mutex_trylock(&mutex->mutex) == 0)
+    {
+        mutex->lockedAt = now();
+        count(&lockClass->acquires, 1);
+        addSample(&lockClass->acquireTotal, lockClass->acquireWait, 0);
+        return;
+    }
+
+    start = now();
+    pthread_mutex_lock(&mutex->mutex);
+    mutex->lockedAt = now();
+    count(&lockClass->acquires, 1);
+    count(&lockClass->contended, 1);
+    addSample(&lockClass->acquireTotal, lockClass->acquireWait, mutex->lockedAt - start);
+}
+
+/*
+    Release a mutex, recording how long it was held
+*/
+void unlockMutex(profiled_mutex_t *mutex)
+{
+    addSample(&mutex->lockClass->holdTotal, mutex->lockClass->hold, now() - mutex->lockedAt);
+    mutex->woken = 0;
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+/*
+    Prepare a condition variable that counts for the class 'name'
+*/
+void initCond(profiled_cond_t *cond, const char *name)
+{
+    pthread_cond_init(&cond->cond, NULL);
+    cond->lockClass = findClass(name);
+}
+
+/*
+    Destroy a condition variable, its class keeps the stats
+*/
+void destroyCond(profiled_cond_t *cond)
+{
+    pthread_cond_destroy(&cond->cond);
+}
+
+/*
+    Wait on a condition variable, recording the wait and if the last wakeup led to no progress
+*/
+void waitCond(profiled_cond_t *cond, profiled_mutex_t *mutex)
+{
+    lock_class_t *lockClass = cond->lockClass;
+    uint64_t start = now();
+
+    //The mutex is released while waiting, that ends its hold
+    addSample(&mutex->lockClass->holdTotal, mutex->lockClass->hold, start - mutex->lockedAt);
+    if (mutex->woken)
+    {
+        count(&lockClass->noProgress, 1);
+    }
+
+    pthread_cond_wait(&cond->cond, &mutex->mutex);
+
+    mutex->lockedAt = now();
+    mutex->woken = 1;
+    count(&lockClass->wakeups, 1);
+    addSample(&lockClass->condWaitTotal, lockClass->condWait, mutex->lockedAt - start);
+}
+
+/*
+    Wake one thread waiting on a condition variable, counting the signal
+*/
+void signalCond(profiled_cond_t *cond)
+{
+    count(&cond->lockClass->signals, 1);
+    pthread_cond_signal(&cond->cond);
+}
+
+/*
+    Wake every thread waiting on a condition variable, counting the signal
+*/
+void broadcastCond(profiled_cond_t *cond)
+{
+    count(&cond->lockClass->signals, 1);
+    pthread_cond_broadcast(&cond->cond);
+}
+
+/*
+    Upper bound of a bucket in readable units
+*/
+static void bucketLimit(int bucket, char *text, int size)
+{
+    uint64_t limit = 1ULL << bucket;
+
+    if (bucket == LOCK_BUCKETS - 1)
+    {
+        snprintf(text, size, "more");
+    }
+    else if (limit < 1000)
+    {
+        snprintf(text, size, "< %llu ns", (unsigned long long)limit);
+    }
+    else if (limit < 1000000)
+    {
+        snprintf(text, size, "< %.1f us", limit / 1e3);
+    }
+    else if (limit < 1000000000)
+    {
+        snprintf(text, size, "< %.1f ms", limit / 1e6);
+    }
+    else
+    {
+        snprintf(text, size, "< %.2f s", limit / 1e9);
+    }
+}
+
+/*
+    Print the stats and histograms of every class used to stderr
+*/
+void printLockReport(void)
+{
+    lock_class_t *lockClass;
+    char limit[32];
+
+    pthread_mutex_lock(&classesMutex);
+    fprintf(stderr, "\n=== LOCK PROFILE OF PROCESS %d ===\n", (int)getpid());
+    for (int i = 0; i < numClasses; i++)
+    {
+        lockClass = &lockClasses[i];
+        if (lockClass->acquires > 0)
+        {
+            fprintf(stderr, "%s: %llu acquires, %llu contended (%.1f%%), waited %.3f ms, held %.3f ms\n", lockClass->name,
+                (unsigned long long)lockClass->acquires, (unsigned long long)lockClass->contended,
+                100.0 * lockClass->contended / lockClass->acquires, lockClass->acquireTotal / 1e6, lockClass->holdTotal / 1e6);
+        }
+        if (lockClass->signals > 0 || lockClass->wakeups > 0)
+        {
+            fprintf(stderr, "%s: %llu signals, %llu wakeups, %llu with no progress (%.1f%%), waited %.3f ms\n", lockClass->name,
+                (unsigned long long)lockClass->signals, (unsigned long long)lockClass->wakeups, (unsigned long long)lockClass->noProgress,
+                lockClass->wakeups > 0 ? 100.0 * lockClass->noProgress / lockClass->wakeups : 0.0, lockClass->condWaitTotal / 1e6);
+        }
+        if (lockClass->acquires == 0 && lockClass->wakeups == 0)
+        {
+            continue;
+        }
+
+        fprintf(stderr, "    %12s  %10s  %10s  %10s\n", "time", "acquire", "hold", "cond wait");
+        for (int bucket = 0; bucket < LOCK_BUCKETS; bucket++)
+        {
+            if (lockClass->acquireWait[bucket] > 0 || lockClass->hold[bucket] > 0 || lockClass->condWait[bucket] > 0)
+            {
+                bucketLimit(bucket, limit, sizeof limit);
+                fprintf(stderr, "    %12s  %10llu  %10llu  %10llu\n", limit, (unsigned long long)lockClass->acquireWait[bucket],
+                    (unsigned long long)lockClass->hold[bucket], (unsigned long long)lockClass->condWait[bucket]);
+            }
+        }
+    }
+    pthread_mutex_unlock(&classesMutex);
+}
+
+/*
+    Thread that prints the report every time SIGUSR1 arrives
+*/
+static void *reportThread(void *arg)
+{
+    sigset_t *signals = (sigset_t *)arg;
+    int signal;
+
+    while (sigwait(signals, &signal) == 0)
+    {
+        printLockReport();
+    }
+
+    return NULL;
+}
+
+/*
+    Start the thread that prints the report on SIGUSR1, and print it when the process exits
+*/
+void startLockReport(void)
+{
+    static sigset_t signals;
+    static int registered = 0;
+    sigset_t all;
+    sigset_t previous;
+    pthread_t tid;
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGUSR1);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+    //A forked process keeps the handlers of its parent, but not its threads
+    if (!registered)
+    {
+        atexit(printLockReport);
+        registered = 1;
+    }
+
+    //The thread only takes SIGUSR1 with sigwait, the other signals must go to the threads waiting for them
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &previous);
+    if (pthread_create(&tid, NULL, &reportThread, &signals) != 0)
+    {
+        fprintf(stderr, "ERROR: pthread_create\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_sigmask(SIG_SETMASK, &previous, NULL);
+    pthread_detach(tid);
+}
+
+#else
+
+/*
+    Nothing to report without LOCK_PROFILE
+*/
+void startLockReport(void)
+{
+}
+
+#endif  /* LOCK_PROFILE */
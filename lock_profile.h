@@ -0,0 +1,100 @@
+/*
+    Profiling of the mutexes and condition variables of the server
+    - Built with LOCK_PROFILE defined (make LOCK_PROFILE=1), every lock belongs to a class
+      named when it is initialized, like "mutex2" for the mutex2 of every game,
+      and the class keeps histograms of the time the threads waited to take the mutex,
+      the time they held it and the time they waited on the condition variable
+    - A wakeup from a condition variable that led to no progress is one after which the thread
+      waited again without releasing the mutex: it found nothing to do
+    - The report goes to stderr on SIGUSR1 and when the process exits
+    - Without LOCK_PROFILE the types are the pthread ones and every call is the plain pthread call
+*/
+
+#ifndef LOCK_PROFILE_H
+#define LOCK_PROFILE_H
+
+#include <pthread.h>
+#include <stdint.h>
+
+#ifdef LOCK_PROFILE
+
+// Buckets of the histograms, bucket n counts the times below 2^n nanoseconds
+#define LOCK_BUCKETS 32
+
+// Stats of all the locks of one class
+typedef struct lock_class_struct
+{
+    const char *name;
+    //Times a mutex was taken, and of those the times it was held by another thread
+    uint64_t acquires;
+    uint64_t contended;
+    //Waits on a condition variable that came back, those that led to no progress, and the signals sent
+    uint64_t wakeups;
+    uint64_t noProgress;
+    uint64_t signals;
+    //Totals and histograms, in nanoseconds
+    uint64_t acquireTotal;
+    uint64_t holdTotal;
+    uint64_t condWaitTotal;
+    uint64_t acquireWait[LOCK_BUCKETS];
+    uint64_t hold[LOCK_BUCKETS];
+    uint64_t condWait[LOCK_BUCKETS];
+} lock_class_t;
+
+// Mutex that records its waits and holds
+typedef struct profiled_mutex_struct
+{
+    pthread_mutex_t mutex;
+    lock_class_t *lockClass;
+    //Only used by the thread holding the mutex: when it took it,
+    //and if it came back from a condition variable without releasing it since
+    uint64_t lockedAt;
+    int woken;
+} profiled_mutex_t;
+
+// Condition variable that records its waits and wakeups
+typedef struct profiled_cond_struct
+{
+    pthread_cond_t cond;
+    lock_class_t *lockClass;
+} profiled_cond_t;
+
+void initMutex(profiled_mutex_t *mutex, const char *name);
+void destroyMutex(profiled_mutex_t *mutex);
+void lockMutex(profiled_mutex_t *mutex);
+void unlockMutex(profiled_mutex_t *mutex);
+void initCond(profiled_cond_t *cond, const char *name);
+void destroyCond(profiled_cond_t *cond);
+void waitCond(profiled_cond_t *cond, profiled_mutex_t *mutex);
+void signalCond(profiled_cond_t *cond);
+void broadcastCond(profiled_cond_t *cond);
+
+/*
+    Print the stats of every class to stderr
+*/
+void printLockReport(void);
+
+#else
+
+typedef pthread_mutex_t profiled_mutex_t;
+typedef pthread_cond_t profiled_cond_t;
+
+#define initMutex(mutex, name) pthread_mutex_init((mutex), NULL)
+#define destroyMutex(mutex) pthread_mutex_destroy(mutex)
+#define lockMutex(mutex) pthread_mutex_lock(mutex)
+#define unlockMutex(mutex) pthread_mutex_unlock(mutex)
+#define initCond(cond, name) pthread_cond_init((cond), NULL)
+#define destroyCond(cond) pthread_cond_destroy(cond)
+#define waitCond(cond, mutex) pthread_cond_wait((cond), (mutex))
+#define signalCond(cond) pthread_cond_signal(cond)
+#define broadcastCond(cond) pthread_cond_broadcast(cond)
+
+#endif  /* LOCK_PROFILE */
+
+/*
+    Print the report on SIGUSR1 and when the process exits, does nothing without LOCK_PROFILE
+    Must be called before any other thread is created, and again in a forked process
+*/
+void startLockReport(void);
+
+#endif  /* NOT LOCK_PROFILE_H */
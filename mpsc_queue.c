@@ -0,0 +1,148 @@
+/*
+    Bounded lock-free queue with many producers and one consumer
+    See mpsc_queue.h for the description
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "mpsc_queue.h"
+#include "fatal_error.h"
+
+/*
+    Prepare an empty queue of 'size' slots, a power of 2, for items of 'itemSize' bytes
+*/
+void initMpscQueue(mpsc_queue_t *queue, uint32_t size, size_t itemSize)
+{
+    queue->sequences = malloc(size * sizeof(uint32_t));
+    queue->items = malloc(size * itemSize);
+    if (queue->sequences == NULL || queue->items == NULL)
+    {
+        fatalError("ERROR: malloc");
+    }
+
+    for (uint32_t i = 0; i < size; i++)
+    {
+        queue->sequences[i] = i;
+    }
+    queue->itemSize = itemSize;
+    queue->size = size;
+    queue->head = 0;
+    queue->tail = 0;
+    queue->waiting = 0;
+    queue->wakeups = 0;
+    queue->dropped = 0;
+}
+
+/*
+    Free the slots of a queue nobody uses anymore
+*/
+void freeMpscQueue(mpsc_queue_t *queue)
+{
+    free(queue->sequences);
+    free(queue->items);
+}
+
+/*
+    Copy an item to the queue, from any thread, without ever waiting
+    Returns 1 on success, or 0 if the queue was full and the item was dropped
+*/
+int pushItem(mpsc_queue_t *queue, const void *item)
+{
+    uint32_t position = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+    uint32_t slot;
+    int32_t lap;
+
+    //The slot is free when its sequence is the position, the consumer sets it a lap ahead
+    while (1)
+    {
+        slot = position & (queue->size - 1);
+        lap = (int32_t)(__atomic_load_n(&queue->sequences[slot], __ATOMIC_ACQUIRE) - position);
+        if (lap == 0)
+        {
+            //On failure 'position' gets the slot another producer left
+            if (__atomic_compare_exchange_n(&queue->head, &position, position + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            {
+                break;
+            }
+        }
+        else if (lap < 0)
+        {
+            __atomic_add_fetch(&queue->dropped, 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+        else
+        {
+            position = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    memcpy(queue->items + slot * queue->itemSize, item, queue->itemSize);
+    __atomic_store_n(&queue->sequences[slot], position + 1, __ATOMIC_RELEASE);
+
+    //The consumer announced its sleep before checking the queue for the last time
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&queue->waiting, __ATOMIC_RELAXED))
+    {
+        wakeMpscQueue(queue);
+    }
+
+    return 1;
+}
+
+/*
+    Check if the next slot of the consumer has an item
+*/
+static inline int itemReady(mpsc_queue_t *queue, int order)
+{
+    return __atomic_load_n(&queue->sequences[queue->tail & (queue->size - 1)], order) == queue->tail + 1;
+}
+
+/*
+    Take the next item from the queue, only from the consumer thread
+    Waits up to 'milliseconds' for one to arrive
+    Returns 1 when an item was copied to 'item', or 0 if the queue is still empty
+*/
+int popItem(mpsc_queue_t *queue, void *item, int milliseconds)
+{
+    uint32_t slot = queue->tail & (queue->size - 1);
+    struct timespec timeout = {milliseconds / 1000, (milliseconds % 1000) * 1000000L};
+    uint32_t wakeups;
+
+    if (!itemReady(queue, __ATOMIC_ACQUIRE))
+    {
+        //A producer that publishes after this sees the flag, or is seen by the last check
+        wakeups = __atomic_load_n(&queue->wakeups, __ATOMIC_SEQ_CST);
+        __atomic_store_n(&queue->waiting, 1, __ATOMIC_SEQ_CST);
+        if (!itemReady(queue, __ATOMIC_SEQ_CST))
+        {
+            syscall(SYS_futex, &queue->wakeups, FUTEX_WAIT_PRIVATE, wakeups, &timeout, NULL, 0);
+        }
+        __atomic_store_n(&queue->waiting, 0, __ATOMIC_RELAXED);
+
+        if (!itemReady(queue, __ATOMIC_ACQUIRE))
+        {
+            return 0;
+        }
+    }
+
+    memcpy(item, queue->items + slot * queue->itemSize, queue->itemSize);
+    //Free for the producers again one lap later
+    __atomic_store_n(&queue->sequences[slot], queue->tail + queue->size, __ATOMIC_RELEASE);
+    queue->tail++;
+
+    return 1;
+}
+
+/*
+    Wake the consumer if it is waiting for items
+*/
+void wakeMpscQueue(mpsc_queue_t *queue)
+{
+    __atomic_add_fetch(&queue->wakeups, 1, __ATOMIC_SEQ_CST);
+    syscall(SYS_futex, &queue->wakeups, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
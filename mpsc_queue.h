@@ -0,0 +1,67 @@
+/*
+    Bounded lock-free queue with many producers and one consumer, for items of a fixed size
+    - Used by the game threads to hand results to a thread that writes them somewhere slow
+      (the stats store, the analytics batches) without ever waiting for it
+    - Every slot has a sequence number: it is free for the producer whose position it has,
+      and ready for the consumer when it is one more. The producers take positions with a
+      compare and swap on the head, and a full queue drops the item instead of waiting
+    - The consumer sleeps on a futex when the queue is empty, and the producers only make
+      the system call to wake it when it announced it is sleeping
+*/
+
+#ifndef MPSC_QUEUE_H
+#define MPSC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Queue of items from any thread to a single consumer
+typedef struct mpsc_queue_struct
+{
+    //Sequence of every slot, and the items in the slots
+    uint32_t *sequences;
+    char *items;
+    size_t itemSize;
+    //Slots, a power of 2
+    uint32_t size;
+    //Next slot for a producer, taken with compare and swap
+    uint32_t head;
+    //Next slot for the consumer
+    uint32_t tail;
+    //Set while the consumer sleeps, and the futex word it sleeps on
+    uint32_t waiting;
+    uint32_t wakeups;
+    //Items that didn't fit in the queue
+    uint32_t dropped;
+} mpsc_queue_t;
+
+/*
+    Prepare an empty queue of 'size' slots, a power of 2, for items of 'itemSize' bytes
+    Exits with a message if there is no memory for it
+*/
+void initMpscQueue(mpsc_queue_t *queue, uint32_t size, size_t itemSize);
+
+/*
+    Free the slots of a queue nobody uses anymore
+*/
+void freeMpscQueue(mpsc_queue_t *queue);
+
+/*
+    Copy an item to the queue, from any thread, without ever waiting
+    Returns 1 on success, or 0 if the queue was full and the item was dropped
+*/
+int pushItem(mpsc_queue_t *queue, const void *item);
+
+/*
+    Take the next item from the queue, only from the consumer thread
+    Waits up to 'milliseconds' for one to arrive
+    Returns 1 when an item was copied to 'item', or 0 if the queue is still empty
+*/
+int popItem(mpsc_queue_t *queue, void *item, int milliseconds);
+
+/*
+    Wake the consumer if it is waiting for items
+*/
+void wakeMpscQueue(mpsc_queue_t *queue);
+
+#endif  /* NOT MPSC_QUEUE_H */
@@ -0,0 +1,271 @@
+/*
+    Placement of the threads of the server on the cores and NUMA nodes
+    See placement.h for the description
+*/
+
+// Needed for the CPU sets and the affinity of the threads
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "placement.h"
+
+/*
+    Read a list of cores like "0-3,8,10-11" into 'cores'
+    Returns 1 on success, or 0 if the list is not valid
+*/
+static int parseCoreList(const char *list, cpu_set_t *cores)
+{
+    const char *next = list;
+    char *end;
+    long first;
+    long last;
+
+    CPU_ZERO(cores);
+    while (*next != '\0' && *next != '\n')
+    {
+        first = strtol(next, &end, 10);
+        if (end == next || first < 0)
+        {
+            return 0;
+        }
+        last = first;
+        if (*end == '-')
+        {
+            next = end + 1;
+            last = strtol(next, &end, 10);
+            if (end == next || last < first)
+            {
+                return 0;
+            }
+        }
+        if (last >= CPU_SETSIZE)
+        {
+            return 0;
+        }
+
+        for (long core = first; core <= last; core++)
+        {
+            CPU_SET(core, cores);
+        }
+
+        next = end;
+        if (*next == ',')
+        {
+            next++;
+        }
+        else if (*next != '\0' && *next != '\n')
+        {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+    Read the cores of every NUMA node from /sys, keeping only the allowed ones
+    A machine that doesn't show its nodes counts as one node
+*/
+static void readNodes(placement_t *placement)
+{
+    char path[64];
+    char list[1024];
+    cpu_set_t cores;
+    FILE *file;
+
+    placement->numNodes = 0;
+    for (int node = 0; node < MAX_NODES; node++)
+    {
+        sprintf(path, "/sys/devices/system/node/node%d/cpulist", node);
+        file = fopen(path, "r");
+        //The numbers of the nodes may have gaps
+        if (file == NULL)
+        {
+            continue;
+        }
+
+        if (fgets(list, sizeof list, file) != NULL && parseCoreList(list, &cores))
+        {
+            CPU_AND(&cores, &cores, &placement->cores);
+            if (CPU_COUNT(&cores) > 0)
+            {
+                placement->nodeCores[placement->numNodes] = cores;
+                placement->nodeIDs[placement->numNodes] = node;
+                placement->numNodes++;
+            }
+        }
+        fclose(file);
+    }
+
+    if (placement->numNodes == 0)
+    {
+        placement->nodeCores[0] = placement->cores;
+        placement->nodeIDs[0] = -1;
+        placement->numNodes = 1;
+    }
+}
+
+/*
+    Read the topology and keep the cores in 'coreList', or all of them with "all"
+    Returns 1 on success, or 0 if the list is not valid or has no core of this machine
+*/
+int initPlacement(placement_t *placement, const char *coreList)
+{
+    cpu_set_t allowed;
+
+    placement->enabled = 1;
+    placement->games = 0;
+
+    //Only the cores the server may already run on
+    if (sched_getaffinity(0, sizeof allowed, &allowed) == -1)
+    {
+        return 0;
+    }
+
+    if (strcmp(coreList, "all") == 0)
+    {
+        placement->cores = allowed;
+    }
+    else
+    {
+        if (!parseCoreList(coreList, &placement->cores))
+        {
+            return 0;
+        }
+        CPU_AND(&placement->cores, &placement->cores, &allowed);
+    }
+
+    if (CPU_COUNT(&placement->cores) == 0)
+    {
+        return 0;
+    }
+
+    readNodes(placement);
+
+    return 1;
+}
+
+/*
+    Bind the calling process to the NUMA node of a worker, and keep only the cores of that node
+*/
+void placeWorker(placement_t *placement, int worker)
+{
+    int node = worker % placement->numNodes;
+    unsigned long nodeMask;
+
+    placement->cores = placement->nodeCores[node];
+    if (sched_setaffinity(0, sizeof placement->cores, &placement->cores) == -1)
+    {
+        perror("WARNING: sched_setaffinity");
+    }
+
+    //The memory touched first by this process comes from its node, while the node has some free
+    if (placement->nodeIDs[node] != -1)
+    {
+        nodeMask = 1UL << placement->nodeIDs[node];
+        //The kernel counts one node less than 'maxnode'
+        if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &nodeMask, MAX_NODES + 1) == -1)
+        {
+            perror("WARNING: set_mempolicy");
+        }
+    }
+
+    //The worker only knows its own node from now on
+    placement->nodeCores[0] = placement->nodeCores[node];
+    placement->nodeIDs[0] = placement->nodeIDs[node];
+    placement->numNodes = 1;
+}
+
+/*
+    Core where the kernel processed the last packets received by a socket
+    Returns the core, or -1 if it is not known
+*/
+int incomingCore(int socket_fd)
+{
+    int core = -1;
+    socklen_t size = sizeof core;
+
+    //Updated by the kernel from every packet, only read here
+    if (getsockopt(socket_fd, SOL_SOCKET, SO_INCOMING_CPU, &core, &size) == -1)
+    {
+        return -1;
+    }
+
+    return core;
+}
+
+/*
+    Core for the next game: the allowed core most of its players' packets arrive on,
+    otherwise the next allowed core in turn
+    Returns the core, or -1 if the games are not placed
+*/
+int nextGameCore(placement_t *placement, const int *incoming, int count)
+{
+    int best = -1;
+    int bestVotes = 0;
+    int votes;
+    int game;
+
+    if (!placement->enabled)
+    {
+        return -1;
+    }
+
+    //A handful of players, counting the votes of every one is cheap
+    for (int i = 0; i < count; i++)
+    {
+        if (incoming[i] < 0 || incoming[i] >= CPU_SETSIZE || !CPU_ISSET(incoming[i], &placement->cores))
+        {
+            continue;
+        }
+        votes = 0;
+        for (int j = 0; j < count; j++)
+        {
+            votes += incoming[j] == incoming[i];
+        }
+        if (votes > bestVotes)
+        {
+            best = incoming[i];
+            bestVotes = votes;
+        }
+    }
+    if (best != -1)
+    {
+        return best;
+    }
+
+    game = __atomic_fetch_add(&placement->games, 1, __ATOMIC_RELAXED) % CPU_COUNT(&placement->cores);
+    for (int core = 0; core < CPU_SETSIZE; core++)
+    {
+        if (CPU_ISSET(core, &placement->cores) && game-- == 0)
+        {
+            return core;
+        }
+    }
+
+    return -1;
+}
+
+/*
+    Make the threads created with 'attributes' run on 'core', if it is not -1
+*/
+void pinThreads(pthread_attr_t *attributes, int core)
+{
+    cpu_set_t cores;
+
+    if (core == -1)
+    {
+        return;
+    }
+
+    CPU_ZERO(&cores);
+    CPU_SET(core, &cores);
+    pthread_attr_setaffinity_np(attributes, sizeof cores, &cores);
+}
@@ -0,0 +1,71 @@
+/*
+    Placement of the threads of the server on the cores and NUMA nodes
+    - Every game runs on one core: all its player threads are pinned to it, so the data
+      of the game stays in the caches of that core
+    - A game goes to the core where the kernel processed the last packets of most of its
+      players (SO_INCOMING_CPU, set by the receive queue of the network card), so its
+      packets and its threads meet in the same cache. When that core is not allowed or
+      not known, as for unix: sockets, the games go to the allowed cores in turn. With a
+      single receive queue every packet arrives on one core: leave it out of the list
+    - In supervisor mode every worker process is bound to one NUMA node, the workers going
+      to the nodes in turn, and prefers the memory of that node for everything it allocates,
+      so the games of a worker never reach across to the other socket
+    - The topology is read from /sys, without libnuma
+*/
+
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+// cpu_set_t needs _GNU_SOURCE defined before the first system header
+#include <sched.h>
+#include <pthread.h>
+
+// Most NUMA nodes taken into account
+#define MAX_NODES 64
+
+// Cores and nodes the games can be placed on
+typedef struct placement_struct
+{
+    //Set when the games are placed, otherwise the scheduler moves the threads freely
+    int enabled;
+    //Cores the games can run on
+    cpu_set_t cores;
+    //Cores of every NUMA node, only the allowed ones, and the number of the node
+    cpu_set_t nodeCores[MAX_NODES];
+    int nodeIDs[MAX_NODES];
+    int numNodes;
+    //Games placed so far, shared by all the threads that start games
+    unsigned int games;
+} placement_t;
+
+/*
+    Read the topology and keep the cores in 'coreList' ("0-7,16-23"), or all of them with "all"
+    Returns 1 on success, or 0 if the list is not valid or has no core of this machine
+*/
+int initPlacement(placement_t *placement, const char *coreList);
+
+/*
+    Bind the calling process, which must not have other threads yet, to the NUMA node of a worker
+    Later games are placed on the cores of that node only
+*/
+void placeWorker(placement_t *placement, int worker);
+
+/*
+    Core where the kernel processed the last packets received by a socket
+    Returns the core, or -1 if it is not known
+*/
+int incomingCore(int socket_fd);
+
+/*
+    Core for the next game, from the cores where the packets of its 'count' players arrive
+    ('incoming', -1 when not known)
+    Returns the core, or -1 if the games are not placed
+*/
+int nextGameCore(placement_t *placement, const int *incoming, int count);
+
+/*
+    Make the threads created with 'attributes' run on 'core', if it is not -1
+*/
+void pinThreads(pthread_attr_t *attributes, int core);
+
+#endif  /* NOT PLACEMENT_H */
@@ -0,0 +1,73 @@
+/*
+    Table with the players of one game on the server
+    See player_table.h for the description
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "player_table.h"
+#include "fatal_error.h"
+
+/*
+    Move an array to new memory aligned to a cache line, with space for 'size' bytes
+*/
+static void *growArray(void *array, size_t oldSize, size_t size)
+{
+    void *grown = NULL;
+
+    if (posix_memalign(&grown, CACHE_LINE, size) != 0)
+    {
+        fatalError("ERROR: posix_memalign");
+    }
+    memset(grown, 0, size);
+
+    if (array != NULL)
+    {
+        memcpy(grown, array, oldSize);
+        free(array);
+    }
+
+    return grown;
+}
+
+/*
+    Prepare an empty table
+*/
+void initPlayerTable(player_table_t *table)
+{
+    table->connections = NULL;
+    table->clientData = NULL;
+    table->baselines = NULL;
+    table->ids = NULL;
+    table->capacity = 0;
+}
+
+/*
+    Make space in the table for the given number of players, keeping the ones already there
+*/
+void growPlayerTable(player_table_t *table, int players)
+{
+    if (players <= table->capacity)
+    {
+        return;
+    }
+
+    table->connections = growArray(table->connections, table->capacity * sizeof(connection_t), players * sizeof(connection_t));
+    table->clientData = growArray(table->clientData, table->capacity * sizeof(socketCommunication_t), players * sizeof(socketCommunication_t));
+    table->baselines = growArray(table->baselines, table->capacity * sizeof(delta_baseline_t), players * sizeof(delta_baseline_t));
+    table->ids = growArray(table->ids, table->capacity * sizeof(int), players * sizeof(int));
+    table->capacity = players;
+}
+
+/*
+    Free the arrays of the table, the connections must be closed before
+*/
+void freePlayerTable(player_table_t *table)
+{
+    free(table->connections);
+    free(table->clientData);
+    free(table->baselines);
+    free(table->ids);
+    initPlayerTable(table);
+}
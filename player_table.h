@@ -0,0 +1,50 @@
+/*
+    Table with the players of one game on the server
+    - Struct of arrays: one contiguous array per field, indexed by the player number,
+      instead of a separately allocated structure for every player
+    - Every array starts on its own cache line, so a loop over one field
+      of all the players reads consecutive memory
+    - The states of the players and who is still in the game are kept by the
+      rules (fred_game_t), in the same form
+*/
+
+#ifndef PLAYER_TABLE_H
+#define PLAYER_TABLE_H
+
+#include "connection.h"
+#include "delta_update.h"
+
+// Size of a cache line, the arrays are aligned to it
+#define CACHE_LINE 64
+
+// Players of one game
+typedef struct player_table_struct
+{
+    //Socket or shared memory connection to every client
+    connection_t *connections;
+    //Last message prepared for every client
+    socketCommunication_t *clientData;
+    //What every client was sent last, the updates only carry the changes to it
+    delta_baseline_t *baselines;
+    //ID every client gave when it connected, for its stats
+    int *ids;
+    //Players that fit in the arrays
+    int capacity;
+} player_table_t;
+
+/*
+    Prepare an empty table
+*/
+void initPlayerTable(player_table_t *table);
+
+/*
+    Make space in the table for the given number of players, keeping the ones already there
+*/
+void growPlayerTable(player_table_t *table, int players);
+
+/*
+    Free the arrays of the table, the connections must be closed before
+*/
+void freePlayerTable(player_table_t *table);
+
+#endif  /* NOT PLAYER_TABLE_H */
@@ -0,0 +1,183 @@
+/*
+    Drawing of the board of FFClient, a frame at a time
+    See render.h for the description
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ncurses.h>
+
+#include "render.h"
+
+// What a region shows
+typedef struct region_struct
+{
+    int column;
+    int color;
+    char text[RENDER_TEXT];
+    //Set when it changed since the last frame
+    int dirty;
+} region_t;
+
+// Row of the board of every region: color feedback, notices, messages and keys typed ahead
+static const int regionRows[REGIONS] = {12, 14, 17, 19};
+
+static WINDOW *board = NULL;
+static region_t regions[REGIONS];
+//Set when anything was drawn that the terminal doesn't have yet
+static int pending = 0;
+//Milliseconds of the last frame
+static long lastFrame = 0;
+
+/*
+    Milliseconds of the monotonic clock, to space the frames
+*/
+static long milliseconds()
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+}
+
+/*
+    Create the window of the board over the whole screen, with every region empty
+*/
+void initRender()
+{
+    //stdscr is sent once empty, afterwards reading keys from it refreshes nothing
+    refresh();
+    board = newwin(0, 0, 0, 0);
+    leaveok(board, TRUE);
+    memset(regions, 0, sizeof regions);
+    pending = 1;
+}
+
+/*
+    Draw text that never changes into the window, it goes with the next frame
+*/
+void drawStatic(int row, int column, int color, const char *text)
+{
+    wcolor_set(board, color, NULL);
+    mvwaddstr(board, row, column, text);
+    wcolor_set(board, 0, NULL);
+    pending = 1;
+}
+
+/*
+    Keep the new text of a region, marking it to be drawn only if anything changed
+*/
+void setRegion(int region, int column, int color, const char *text)
+{
+    region_t *shown = &regions[region];
+
+    if (shown->column == column && shown->color == color && strncmp(shown->text, text, RENDER_TEXT - 1) == 0)
+    {
+        return;
+    }
+
+    shown->column = column;
+    shown->color = color;
+    snprintf(shown->text, sizeof shown->text, "%s", text);
+    shown->dirty = 1;
+    pending = 1;
+}
+
+/*
+    Leave a region empty
+*/
+void clearRegion(int region)
+{
+    setRegion(region, 0, 0, "");
+}
+
+/*
+    Draw the regions that changed into the window, and send the window to the terminal
+*/
+static void sendFrame()
+{
+    for (int i = 0; i < REGIONS; i++)
+    {
+        if (!regions[i].dirty)
+        {
+            continue;
+        }
+        wmove(board, regionRows[i], 0);
+        wclrtoeol(board);
+        wcolor_set(board, regions[i].color, NULL);
+        mvwaddstr(board, regionRows[i], regions[i].column, regions[i].text);
+        wcolor_set(board, 0, NULL);
+        regions[i].dirty = 0;
+    }
+
+    wnoutrefresh(board);
+    doupdate();
+    pending = 0;
+    lastFrame = milliseconds();
+}
+
+/*
+    Send what changed to the terminal, unless the last frame was less than RENDER_FRAME_MS ago
+    Returns the milliseconds until the frame held can go, or -1 if nothing is held
+*/
+int renderFrame()
+{
+    long wait;
+
+    if (!pending)
+    {
+        return -1;
+    }
+
+    wait = lastFrame + RENDER_FRAME_MS - milliseconds();
+    if (wait > 0)
+    {
+        return wait;
+    }
+    sendFrame();
+
+    return -1;
+}
+
+/*
+    Send what changed to the terminal at once, ignoring the time of the last frame
+*/
+void flushFrame()
+{
+    if (pending)
+    {
+        sendFrame();
+    }
+}
+
+/*
+    Show a prompt in a region and read a number typed after it, with the cursor shown
+    Returns the number, or 0 if what was typed is not one
+*/
+int promptNumber(int region, int column, const char *prompt)
+{
+    char typed[16];
+    int number = 0;
+
+    setRegion(region, column, 0, prompt);
+    flushFrame();
+
+    //Typed straight into the window, echoed by ncurses
+    curs_set(1);
+    leaveok(board, FALSE);
+    if (mvwgetnstr(board, regionRows[region], column + strlen(prompt), typed, sizeof typed - 1) == ERR || sscanf(typed, "%d", &number) != 1)
+    {
+        number = 0;
+    }
+    leaveok(board, TRUE);
+    curs_set(0);
+
+    //The row has what was typed too, it is drawn again with the next text
+    regions[region].dirty = 1;
+    regions[region].text[0] = '\0';
+
+    return number;
+}
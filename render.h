@@ -0,0 +1,64 @@
+/*
+    Drawing of the board of FFClient, a frame at a time
+    - The rows that change during a game (regions) are kept in a model: a region is only
+      drawn again when its text, column or color changed, and as a whole, without moving
+      the lines around it
+    - Everything goes to a window of its own and reaches the terminal with a single
+      wnoutrefresh and doupdate per frame, and at most one frame every RENDER_FRAME_MS:
+      what changes meanwhile is held and sent together with the next frame. Over a slow
+      link (SSH) the terminal gets a few bytes per update instead of whole screens
+    - The keys are read from stdscr, which is never drawn on, so reading them doesn't
+      refresh anything
+    - Only used by the thread that shows the board
+*/
+
+#ifndef RENDER_H
+#define RENDER_H
+
+// Least milliseconds between two frames
+#define RENDER_FRAME_MS 33
+// Longest text of a region
+#define RENDER_TEXT 160
+
+// Rows of the board that change during a game
+typedef enum renderRegion {REGION_MARK, REGION_NOTICE, REGION_MESSAGE, REGION_TYPED, REGIONS} renderRegion_t;
+
+/*
+    Create the window of the board, once ncurses was started
+*/
+void initRender();
+
+/*
+    Draw text that never changes, like the title, in the color pair 'color'
+    It goes with the next frame
+*/
+void drawStatic(int row, int column, int color, const char *text);
+
+/*
+    Show 'text' in a region from 'column' on, in the color pair 'color', instead of what it had
+*/
+void setRegion(int region, int column, int color, const char *text);
+
+/*
+    Leave a region empty
+*/
+void clearRegion(int region);
+
+/*
+    Send the regions that changed to the terminal, unless the last frame was too recent
+    Returns the milliseconds until the frame held can go, or -1 if nothing is held
+*/
+int renderFrame();
+
+/*
+    Send the regions that changed to the terminal at once, before waiting without drawing
+*/
+void flushFrame();
+
+/*
+    Ask for a number in a region, with the text 'prompt' before it, and wait for it
+    Returns the number, or 0 if what was typed is not one
+*/
+int promptNumber(int region, int column, const char *prompt);
+
+#endif  /* NOT RENDER_H */
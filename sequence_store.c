@@ -0,0 +1,111 @@
+/*
+    Color sequence of a game kept in a file
+    See sequence_store.h for the description
+*/
+
+// Needed for O_TMPFILE
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "sequence_store.h"
+
+#define CHUNK_BYTES ((size_t)SEQUENCE_CHUNK * sizeof(int))
+
+/*
+    Create the file without a name, reserve the addresses of the whole sequence and map the first chunk
+    Returns 1 on success, or 0 if the file or the addresses can't be had
+*/
+int openSequence(sequence_store_t *store, const char *directory)
+{
+    store->fd = open(directory, O_TMPFILE | O_RDWR | O_CLOEXEC, 0600);
+    if (store->fd == -1)
+    {
+        return 0;
+    }
+
+    //Only addresses, nothing is stored there until a chunk is mapped
+    store->colors = mmap(NULL, (size_t)SEQUENCE_MAX_COLORS * sizeof(int), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (store->colors == MAP_FAILED)
+    {
+        close(store->fd);
+        return 0;
+    }
+    store->capacity = 0;
+    store->chunk = 0;
+
+    if (!extendSequence(store))
+    {
+        closeSequence(store);
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+    Grow the file by one chunk, with its blocks reserved, and map it after the last one
+    Returns 1 on success, or 0 if the sequence is as long as it can be or the file can't grow
+*/
+int extendSequence(sequence_store_t *store)
+{
+    size_t offset = (size_t)store->capacity * sizeof(int);
+    void *chunk;
+
+    //A file with holes would raise SIGBUS on the first color written to a full disk, so the
+    //blocks are taken now, when running out of space is only an error
+    if (store->capacity + SEQUENCE_CHUNK > SEQUENCE_MAX_COLORS || posix_fallocate(store->fd, offset, CHUNK_BYTES) != 0)
+    {
+        return 0;
+    }
+
+    //Right after the chunk before, the kernel joins them in one mapping
+    chunk = mmap((char *)store->colors + offset, CHUNK_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, store->fd, offset);
+    if (chunk == MAP_FAILED)
+    {
+        return 0;
+    }
+    madvise(chunk, CHUNK_BYTES, MADV_SEQUENTIAL);
+    store->capacity += SEQUENCE_CHUNK;
+
+    return 1;
+}
+
+/*
+    Give back the memory of the chunk the verification left, unless colors are still added
+    to it, and read ahead the one after the chunk of 'index'
+*/
+void followSequence(sequence_store_t *store, int index)
+{
+    int chunk = index / SEQUENCE_CHUNK;
+    int last = store->capacity / SEQUENCE_CHUNK - 1;
+
+    if (chunk == store->chunk)
+    {
+        return;
+    }
+
+    //The colors stay in the file, only the memory is given back
+    if (store->chunk != last)
+    {
+        madvise(store->colors + (size_t)store->chunk * SEQUENCE_CHUNK, CHUNK_BYTES, MADV_DONTNEED);
+    }
+    if (chunk < last)
+    {
+        madvise(store->colors + (size_t)(chunk + 1) * SEQUENCE_CHUNK, CHUNK_BYTES, MADV_WILLNEED);
+    }
+    store->chunk = chunk;
+}
+
+/*
+    Unmap the addresses of the sequence and close the file, which is removed with its last descriptor
+*/
+void closeSequence(sequence_store_t *store)
+{
+    munmap(store->colors, (size_t)SEQUENCE_MAX_COLORS * sizeof(int));
+    close(store->fd);
+}
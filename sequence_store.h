@@ -0,0 +1,60 @@
+/*
+    Color sequence of a game kept in a file, for endurance games with very long sequences
+    - The sequence is a single array for the rules (fred_game.h): a range of addresses is
+      reserved for SEQUENCE_MAX_COLORS colors, and the file is mapped into it one chunk of
+      SEQUENCE_CHUNK colors at a time as the sequence grows, so the array never moves
+    - The file has no name (O_TMPFILE) and is gone when the game ends
+    - Only the chunks being read are in memory: the verification walks the sequence from
+      the beginning every round, so the chunk it leaves is let go (the kernel writes it to
+      the file if it has to) and the next one is read ahead. A chunk let go is read again
+      from the file the next time it is used
+*/
+
+#ifndef SEQUENCE_STORE_H
+#define SEQUENCE_STORE_H
+
+// Colors of a chunk, a multiple of the colors of a page
+#define SEQUENCE_CHUNK (64 * 1024)
+// Most colors of a sequence, the addresses reserved for every game
+// Reaching it takes about SEQUENCE_MAX_COLORS^2 / 2 colors played
+#define SEQUENCE_MAX_COLORS (256 * 1024 * 1024)
+
+// Sequence of one game, used by one thread at a time
+typedef struct sequence_store_struct
+{
+    int fd;
+    //Beginning of the addresses reserved, where the chunks are mapped
+    int *colors;
+    //Colors of the chunks mapped
+    int capacity;
+    //Chunk the verification is reading
+    int chunk;
+} sequence_store_t;
+
+/*
+    Create an empty sequence in a file without a name in 'directory', with space for one chunk
+    Returns 1 on success, or 0 if the file can't be created
+*/
+int openSequence(sequence_store_t *store, const char *directory);
+
+/*
+    Make space for one more chunk of colors, at the end of the ones there are
+    The blocks of the chunk are taken from the file system at once, so writing the colors
+    never finds it full
+    Returns 1 on success, or 0 if the sequence is as long as it can be or the file can't grow
+*/
+int extendSequence(sequence_store_t *store);
+
+/*
+    The color at 'index' is the next one read: when it is in another chunk than the last one
+    read, that chunk is let go unless colors are still added to it, and the following chunk
+    is read ahead
+*/
+void followSequence(sequence_store_t *store, int index);
+
+/*
+    Unmap the sequence and remove its file
+*/
+void closeSequence(sequence_store_t *store);
+
+#endif  /* NOT SEQUENCE_STORE_H */
@@ -0,0 +1,490 @@
+/*
+    Shared memory transport for clients running on the same machine as the server
+    See shm_ring.h for the description of the protocol
+*/
+
+// Needed for memfd_create and POLLRDHUP
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "shm_ring.h"
+#include "sockets.h"
+#include "clock_time.h"
+
+// Seals that keep the client from resizing the region under the server
+#define SHM_SEALS (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL)
+
+/*
+    Hint to the processor that this is a spin loop
+*/
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    __asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+/*
+    Sleep on a futex word in the shared region while it still holds 'value'
+    The futex is not private, the word is shared with another process
+*/
+static void futexWait(uint32_t *word, uint32_t value, int milliseconds)
+{
+    struct timespec timeout;
+
+    timeout.tv_sec = milliseconds / 1000;
+    timeout.tv_nsec = (milliseconds % 1000) * 1000000L;
+    syscall(SYS_futex, word, FUTEX_WAIT, value, &timeout, NULL, 0);
+}
+
+/*
+    Wake the threads sleeping on a futex word
+*/
+static void futexWake(uint32_t *word, int count)
+{
+    syscall(SYS_futex, word, FUTEX_WAKE, count, NULL, NULL, 0);
+}
+
+/*
+    Check if the transport was closed or the process at the other end died
+*/
+static int peerGone(shm_link_t *link)
+{
+    struct pollfd peer;
+
+    if (__atomic_load_n(&link->region->closed, __ATOMIC_ACQUIRE))
+    {
+        return 1;
+    }
+
+    peer.fd = link->peer_fd;
+    peer.events = POLLRDHUP;
+    peer.revents = 0;
+    if (poll(&peer, 1, 0) == 1 && (peer.revents & (POLLRDHUP | POLLHUP | POLLERR)))
+    {
+        return 1;
+    }
+
+    return 0;
+}
+
+/*
+    Wait until a ring index moves away from the value last seen
+    Spins for a while first, since the peer is usually about to publish,
+    then announces itself in 'waiting' and sleeps on the index
+    Returns 1 when the index changed, or 0 if the connection has finished
+*/
+static int waitForChange(shm_link_t *link, uint32_t *index, uint32_t seen, uint32_t *waiting)
+{
+    for (int i = 0; i < link->spin; i++)
+    {
+        if (__atomic_load_n(index, __ATOMIC_ACQUIRE) != seen)
+        {
+            return 1;
+        }
+        cpuRelax();
+    }
+
+    while (1)
+    {
+        // Announce the sleep before checking for the last time
+        // The peer checks the flag after publishing, so one of the two sees the other
+        __atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(index, __ATOMIC_SEQ_CST) != seen)
+        {
+            __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+            return 1;
+        }
+
+        futexWait(index, seen, SHM_WAIT_MS);
+        __atomic_store_n(waiting, 0, __ATOMIC_RELAXED);
+
+        if (__atomic_load_n(index, __ATOMIC_ACQUIRE) != seen)
+        {
+            return 1;
+        }
+        if (peerGone(link))
+        {
+            return 0;
+        }
+    }
+}
+
+/*
+    Wake the peer if it is sleeping on an index that was just published
+*/
+static void wakePeer(uint32_t *index, uint32_t *waiting)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(waiting, __ATOMIC_RELAXED))
+    {
+        futexWake(index, 1);
+    }
+}
+
+/*
+    Map the region and prepare the local view of it
+*/
+static shm_link_t *mapRegion(int memory_fd, int socket_fd, int isServer)
+{
+    shm_link_t *link = NULL;
+    void *region;
+
+    region = mmap(NULL, sizeof(shm_region_t), PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+    if (region == MAP_FAILED)
+    {
+        return NULL;
+    }
+
+    link = malloc(sizeof(shm_link_t));
+    link->memory_fd = memory_fd;
+    link->peer_fd = socket_fd;
+    link->region = region;
+    link->rx = isServer ? &link->region->toServer : &link->region->toClient;
+    link->tx = isServer ? &link->region->toClient : &link->region->toServer;
+    link->spin = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SHM_SPIN : 0;
+
+    return link;
+}
+
+/*
+    Client side: create the shared region and pass it to the server over the connected socket
+    Returns the link, or NULL if the region could not be created
+*/
+shm_link_t *shmCreate(int socket_fd)
+{
+    shm_link_t *link = NULL;
+    int memory_fd;
+
+    memory_fd = memfd_create("fabulous-fred", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (memory_fd == -1)
+    {
+        return NULL;
+    }
+
+    // The new memory is already filled with zeros, which is an empty ring
+    if (ftruncate(memory_fd, sizeof(shm_region_t)) == -1 || fcntl(memory_fd, F_ADD_SEALS, SHM_SEALS) == -1)
+    {
+        close(memory_fd);
+        return NULL;
+    }
+
+    link = mapRegion(memory_fd, socket_fd, 0);
+    if (link == NULL)
+    {
+        close(memory_fd);
+        return NULL;
+    }
+
+    if (!sendFds(socket_fd, "S", 1, &memory_fd, 1))
+    {
+        munmap(link->region, sizeof(shm_region_t));
+        close(memory_fd);
+        free(link);
+        return NULL;
+    }
+
+    return link;
+}
+
+/*
+    Server side: receive the shared region from a client that just connected
+    Returns the link, or NULL if the client left or sent an invalid region
+*/
+shm_link_t *shmAttach(int socket_fd)
+{
+    shm_link_t *link = NULL;
+    struct stat info;
+    char tag;
+    int memory_fd;
+
+    if (recvFds(socket_fd, &tag, 1, &memory_fd, 1) != 1)
+    {
+        return NULL;
+    }
+
+    // Only accept regions of the right size that the client can no longer resize
+    if (fstat(memory_fd, &info) == -1 || info.st_size != sizeof(shm_region_t)
+        || (fcntl(memory_fd, F_GET_SEALS) & SHM_SEALS) != SHM_SEALS)
+    {
+        close(memory_fd);
+        return NULL;
+    }
+
+    link = mapRegion(memory_fd, socket_fd, 1);
+    if (link == NULL)
+    {
+        close(memory_fd);
+    }
+
+    return link;
+}
+
+/*
+    Create a region for a client and a server running in the same process, without any socket
+    Each side maps it on its own, so either one can close first
+    Returns the link of the client and stores the one of the server in 'server',
+    or NULL if the region could not be created
+*/
+shm_link_t *shmLocal(shm_link_t **server)
+{
+    shm_link_t *link = NULL;
+    int memory_fd;
+    int server_fd;
+
+    memory_fd = memfd_create("fabulous-fred-solo", MFD_CLOEXEC);
+    if (memory_fd == -1)
+    {
+        return NULL;
+    }
+    if (ftruncate(memory_fd, sizeof(shm_region_t)) == -1 || (server_fd = fcntl(memory_fd, F_DUPFD_CLOEXEC, 0)) == -1)
+    {
+        close(memory_fd);
+        return NULL;
+    }
+
+    // No peer socket: poll skips a negative descriptor, so only 'closed' tells that a side left
+    link = mapRegion(memory_fd, -1, 0);
+    *server = mapRegion(server_fd, -1, 1);
+    if (link == NULL || *server == NULL)
+    {
+        if (link != NULL)
+        {
+            shmRelease(link);
+        }
+        else
+        {
+            close(memory_fd);
+        }
+        if (*server != NULL)
+        {
+            shmRelease(*server);
+        }
+        else
+        {
+            close(server_fd);
+        }
+        return NULL;
+    }
+
+    return link;
+}
+
+/*
+    Server side: map a region that was received from another server process
+    Returns the link, or NULL if the region could not be mapped
+*/
+shm_link_t *shmAdopt(int memory_fd, int socket_fd)
+{
+    return mapRegion(memory_fd, socket_fd, 1);
+}
+
+/*
+    Wait until the receive ring has data or the peer is gone
+    The wait also ends when 'wake_fd' becomes readable, or after 'milliseconds' (-1 for no limit)
+    Returns 1 when a receive would not block, 0 if woken by 'wake_fd', or -1 if the time ran out
+*/
+int shmWaitReadable(shm_link_t *link, int wake_fd, int milliseconds)
+{
+    double deadline = seconds() + milliseconds / 1000.0;
+    shm_ring_t *ring = link->rx;
+    struct pollfd wake;
+    uint32_t tail;
+
+    wake.fd = wake_fd;
+    wake.events = POLLIN;
+
+    while (1)
+    {
+        tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+        if (tail != ring->head || peerGone(link))
+        {
+            return 1;
+        }
+
+        wake.revents = 0;
+        if (poll(&wake, 1, 0) == 1)
+        {
+            return 0;
+        }
+        if (milliseconds >= 0 && seconds() >= deadline)
+        {
+            return -1;
+        }
+
+        // Same protocol as waitForChange, with a short sleep to check the wake descriptor often
+        __atomic_store_n(&ring->readerWaiting, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == tail)
+        {
+            futexWait(&ring->tail, tail, SHM_WAKE_CHECK_MS);
+        }
+        __atomic_store_n(&ring->readerWaiting, 0, __ATOMIC_RELAXED);
+    }
+}
+
+/*
+    Copy a message into the transmit ring, waiting for space if it is full
+    Returns 1 when the message was queued, or 0 if the connection has finished
+*/
+int shmSend(shm_link_t *link, const void *buffer, size_t size)
+{
+    shm_ring_t *ring = link->tx;
+    const unsigned char *input = buffer;
+    size_t done = 0;
+
+    while (done < size)
+    {
+        // The tail is only written by this side
+        uint32_t tail = ring->tail;
+        uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        uint32_t space = SHM_RING_SIZE - (tail - head);
+        uint32_t position = tail & (SHM_RING_SIZE - 1);
+        size_t chunk = size - done;
+
+        if (__atomic_load_n(&link->region->closed, __ATOMIC_RELAXED))
+        {
+            return 0;
+        }
+
+        // Ring is full, wait for the reader to make some space
+        if (space == 0 || space > SHM_RING_SIZE)
+        {
+            if (!waitForChange(link, &ring->head, head, &ring->writerWaiting))
+            {
+                return 0;
+            }
+            continue;
+        }
+
+        if (chunk > space)
+        {
+            chunk = space;
+        }
+
+        // Copy in up to two pieces when the message wraps around the end
+        if (position + chunk > SHM_RING_SIZE)
+        {
+            size_t first = SHM_RING_SIZE - position;
+            memcpy(ring->data + position, input + done, first);
+            memcpy(ring->data, input + done + first, chunk - first);
+        }
+        else
+        {
+            memcpy(ring->data + position, input + done, chunk);
+        }
+
+        __atomic_store_n(&ring->tail, tail + chunk, __ATOMIC_RELEASE);
+        wakePeer(&ring->tail, &ring->readerWaiting);
+        done += chunk;
+    }
+
+    return 1;
+}
+
+/*
+    Copy a message out of the receive ring, waiting until all of it has arrived
+    Returns 1 on successful receipt, or 0 if the connection has finished
+*/
+int shmRecv(shm_link_t *link, void *buffer, size_t size)
+{
+    shm_ring_t *ring = link->rx;
+    unsigned char *output = buffer;
+    size_t done = 0;
+
+    while (done < size)
+    {
+        // The head is only written by this side
+        uint32_t head = ring->head;
+        uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+        uint32_t available = tail - head;
+        uint32_t position = head & (SHM_RING_SIZE - 1);
+        size_t chunk = size - done;
+
+        // Ring is empty, wait for the writer to publish more
+        if (available == 0 || available > SHM_RING_SIZE)
+        {
+            if (!waitForChange(link, &ring->tail, tail, &ring->readerWaiting))
+            {
+                return 0;
+            }
+            continue;
+        }
+
+        if (chunk > available)
+        {
+            chunk = available;
+        }
+
+        if (position + chunk > SHM_RING_SIZE)
+        {
+            size_t first = SHM_RING_SIZE - position;
+            memcpy(output + done, ring->data + position, first);
+            memcpy(output + done + first, ring->data, chunk - first);
+        }
+        else
+        {
+            memcpy(output + done, ring->data + position, chunk);
+        }
+
+        __atomic_store_n(&ring->head, head + chunk, __ATOMIC_RELEASE);
+        wakePeer(&ring->head, &ring->writerWaiting);
+        done += chunk;
+    }
+
+    return 1;
+}
+
+/*
+    Drop everything waiting in the receive ring, without waiting for more
+*/
+void shmDiscard(shm_link_t *link)
+{
+    shm_ring_t *ring = link->rx;
+
+    __atomic_store_n(&ring->head, __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    wakePeer(&ring->head, &ring->writerWaiting);
+}
+
+/*
+    Mark the transport as finished, wake the peer and unmap the region
+    The socket is not closed, it belongs to the caller
+*/
+void shmClose(shm_link_t *link)
+{
+    __atomic_store_n(&link->region->closed, 1, __ATOMIC_RELEASE);
+
+    // Anybody still sleeping on the rings has to notice the change
+    futexWake(&link->region->toServer.head, INT_MAX);
+    futexWake(&link->region->toServer.tail, INT_MAX);
+    futexWake(&link->region->toClient.head, INT_MAX);
+    futexWake(&link->region->toClient.tail, INT_MAX);
+
+    munmap(link->region, sizeof(shm_region_t));
+    close(link->memory_fd);
+    free(link);
+}
+
+/*
+    Unmap the region without finishing the transport, which another process has taken over
+*/
+void shmRelease(shm_link_t *link)
+{
+    munmap(link->region, sizeof(shm_region_t));
+    close(link->memory_fd);
+    free(link);
+}
@@ -0,0 +1,127 @@
+/*
+    Shared memory transport for clients running on the same machine as the server
+    - A memfd region holds one single-producer / single-consumer ring per direction
+    - Messages are copied in and out of the rings without any system call
+    - A side only sleeps on a futex when its ring is empty (reader) or full (writer),
+      and the other side only wakes it when it announced that it is sleeping
+    - The region is passed from the client to the server over a Unix socket,
+      which stays open afterwards to detect when the peer goes away
+    - A client and a server in the same process (solo practice) share a region
+      without any socket, see shmLocal
+*/
+
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Bytes of data in each ring, must be a power of two
+#define SHM_RING_SIZE 65536
+// Times to check an empty / full ring before going to sleep on the futex
+// Only used on machines with more than one CPU, otherwise the peer cannot run while spinning
+#define SHM_SPIN 4000
+// Milliseconds to sleep on the futex before checking if the peer is still there
+#define SHM_WAIT_MS 200
+// Milliseconds to sleep on the futex before checking the wake descriptor in shmWaitReadable
+#define SHM_WAKE_CHECK_MS 10
+
+// One direction of the transport
+// The indices run freely and are masked with the size to find the position in 'data'
+typedef struct shm_ring_struct
+{
+    // Written only by the consumer, on its own cache line
+    uint32_t head __attribute__((aligned(64)));
+    uint32_t readerWaiting;
+    // Written only by the producer
+    uint32_t tail __attribute__((aligned(64)));
+    uint32_t writerWaiting;
+    unsigned char data[SHM_RING_SIZE] __attribute__((aligned(64)));
+} shm_ring_t;
+
+// Layout of the shared region
+typedef struct shm_region_struct
+{
+    shm_ring_t toServer;
+    shm_ring_t toClient;
+    // Set by whichever side closes first
+    uint32_t closed __attribute__((aligned(64)));
+} shm_region_t;
+
+// Local view of the region for one side
+typedef struct shm_link_struct
+{
+    int memory_fd;
+    // Socket used for the setup, polled to detect a peer that died
+    int peer_fd;
+    shm_region_t *region;
+    // Ring this side reads from
+    shm_ring_t *rx;
+    // Ring this side writes to
+    shm_ring_t *tx;
+    // Times to spin before sleeping
+    int spin;
+} shm_link_t;
+
+/*
+    Client side: create the shared region and pass it to the server over the connected socket
+    Returns the link, or NULL if the region could not be created
+*/
+shm_link_t *shmCreate(int socket_fd);
+
+/*
+    Server side: receive the shared region from a client that just connected
+    Returns the link, or NULL if the client left or sent an invalid region
+*/
+shm_link_t *shmAttach(int socket_fd);
+
+/*
+    Create a region for a client and a server running in the same process, without any socket
+    Each side maps it on its own, so either one can close first
+    Returns the link of the client and stores the one of the server in 'server',
+    or NULL if the region could not be created
+*/
+shm_link_t *shmLocal(shm_link_t **server);
+
+/*
+    Server side: map a region that was received from another server process
+    Returns the link, or NULL if the region could not be mapped
+*/
+shm_link_t *shmAdopt(int memory_fd, int socket_fd);
+
+/*
+    Wait until the receive ring has data or the peer is gone
+    The wait also ends when 'wake_fd' becomes readable, or after 'milliseconds' (-1 for no limit)
+    Returns 1 when a receive would not block, 0 if woken by 'wake_fd', or -1 if the time ran out
+*/
+int shmWaitReadable(shm_link_t *link, int wake_fd, int milliseconds);
+
+/*
+    Copy a message into the transmit ring, waiting for space if it is full
+    Returns 1 when the message was queued, or 0 if the connection has finished
+*/
+int shmSend(shm_link_t *link, const void *buffer, size_t size);
+
+/*
+    Copy a message out of the receive ring, waiting until all of it has arrived
+    Returns 1 on successful receipt, or 0 if the connection has finished
+*/
+int shmRecv(shm_link_t *link, void *buffer, size_t size);
+
+/*
+    Drop everything waiting in the receive ring, without waiting for more
+*/
+void shmDiscard(shm_link_t *link);
+
+/*
+    Mark the transport as finished, wake the peer and unmap the region
+    The socket is not closed, it belongs to the caller
+*/
+void shmClose(shm_link_t *link);
+
+/*
+    Unmap the region without finishing the transport, which another process has taken over
+*/
+void shmRelease(shm_link_t *link);
+
+#endif  /* NOT SHM_RING_H */
@@ -10,8 +10,17 @@
    
 */
 
+// Needed for accept4
+#define _GNU_SOURCE
+
 #include "sockets.h"
 
+#include <errno.h>
+#include <stddef.h>
+
+// Prefix that marks an endpoint as a Unix domain socket
+#define UNIX_PREFIX "unix:"
+
 /*
 	Show the local IP addresses, to allow testing
 	Based on code from:
@@ -44,10 +53,96 @@ void printLocalIPs()
 	freeifaddrs(addrs);
 }
 
+/*
+    Check if an endpoint string names a Unix domain socket
+    Accepted forms are "unix:/path/to/socket" and "unix:@name" for the abstract namespace
+    Returns 1 for a Unix endpoint, or 0 for a TCP port / address
+*/
+int isUnixEndpoint(const char * endpoint)
+{
+    return endpoint != NULL && strncmp(endpoint, UNIX_PREFIX, strlen(UNIX_PREFIX)) == 0;
+}
+
+/*
+    Fill a Unix socket address from an endpoint string
+    A leading '@' in the name selects the abstract namespace, which has no file on disk
+    Returns the length of the address to use with bind / connect
+*/
+static socklen_t unixAddress(const char * endpoint, struct sockaddr_un * address)
+{
+    const char * name = endpoint + strlen(UNIX_PREFIX);
+    size_t length = strlen(name);
+
+    // The name must fit in sun_path, including the '\0' for paths
+    if (length == 0 || length >= sizeof address->sun_path)
+    {
+        errno = ENAMETOOLONG;
+        fatalError("ERROR: unix socket name");
+    }
+
+    bzero(address, sizeof *address);
+    address->sun_family = AF_UNIX;
+    memcpy(address->sun_path, name, length);
+
+    // Abstract names start with a null byte and are not terminated
+    if (name[0] == '@')
+    {
+        address->sun_path[0] = '\0';
+        return offsetof(struct sockaddr_un, sun_path) + length;
+    }
+
+    return sizeof *address;
+}
+
+/*
+    Prepare and open a listening Unix domain socket
+    Returns the file descriptor for the socket
+*/
+static int initUnixServer(char * endpoint, int max_queue)
+{
+    struct sockaddr_un address;
+    socklen_t address_size;
+    int server_fd;
+
+    address_size = unixAddress(endpoint, &address);
+
+    // SOCKET
+    // Listeners are not inherited by programs started with exec, they are passed explicitly
+    server_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server_fd == -1)
+    {
+        fatalError("ERROR: socket");
+    }
+
+    // Remove the socket file left behind by a server that did not close correctly
+    // This is the equivalent of SO_REUSEADDR for TCP
+    if (address.sun_path[0] != '\0')
+    {
+        unlink(address.sun_path);
+    }
+
+    // BIND
+    if (bind(server_fd, (struct sockaddr *)&address, address_size) == -1)
+    {
+        fatalError("ERROR: bind");
+    }
+
+    // LISTEN
+    if (listen(server_fd, max_queue) == -1)
+    {
+        fatalError("ERROR: listen");
+    }
+
+    printf("Server ready on %s\n", endpoint);
+
+    return server_fd;
+}
+
 /*
     Prepare and open the listening socket
+    The port can also be a Unix endpoint ("unix:/path" or "unix:@name")
     Returns the file descriptor for the socket
-    Remember to close the socket when finished
+    Remember to close the socket with closeServer when finished
 */
 int initServer(char * port, int max_queue)
 {
@@ -56,6 +151,12 @@ int initServer(char * port, int max_queue)
     int server_fd;
     int reuse = 1;
 
+    // Local endpoints skip the TCP/IP stack completely
+    if (isUnixEndpoint(port))
+    {
+        return initUnixServer(port, max_queue);
+    }
+
     // Prepare the hints structure
     // Clear the structure for the server configuration
     bzero(&hints, sizeof hints);
@@ -76,7 +177,8 @@ int initServer(char * port, int max_queue)
 
     // SOCKET
     // Open the socket using the information obtained
-    server_fd = socket(server_info->ai_family, server_info->ai_socktype, server_info->ai_protocol);
+    // Listeners are not inherited by programs started with exec, they are passed explicitly
+    server_fd = socket(server_info->ai_family, server_info->ai_socktype | SOCK_CLOEXEC, server_info->ai_protocol);
     if (server_fd == -1) 
     {
         close(server_fd);
@@ -113,8 +215,157 @@ int initServer(char * port, int max_queue)
     return server_fd;
 }
 
+/*
+    Close a listening socket
+    Removes the socket file for Unix endpoints bound to a path
+*/
+void closeServer(int server_fd)
+{
+    struct sockaddr_un address;
+    socklen_t address_size = sizeof address;
+
+    bzero(&address, sizeof address);
+    if (getsockname(server_fd, (struct sockaddr *)&address, &address_size) == 0
+        && address.sun_family == AF_UNIX && address.sun_path[0] != '\0')
+    {
+        unlink(address.sun_path);
+    }
+
+    close(server_fd);
+}
+
+/*
+    Wait until one of the listening sockets has a pending connection
+    The wait also ends when 'wake_fd' becomes readable, use -1 to wait only for clients
+    Returns the position of the listener, or -1 if woken by 'wake_fd'
+*/
+int waitForClient(int * server_fds, int num_servers, int wake_fd)
+{
+    struct pollfd listeners[num_servers + 1];
+    int ready = -1;
+
+    // POLL
+    // The wake descriptor goes after the listeners
+    while (ready == -1)
+    {
+        for (int i = 0; i < num_servers; i++)
+        {
+            listeners[i].fd = server_fds[i];
+            listeners[i].events = POLLIN;
+            listeners[i].revents = 0;
+        }
+        listeners[num_servers].fd = wake_fd;
+        listeners[num_servers].events = POLLIN;
+        listeners[num_servers].revents = 0;
+
+        if (poll(listeners, num_servers + 1, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fatalError("ERROR: poll");
+        }
+
+        if (listeners[num_servers].revents)
+        {
+            return -1;
+        }
+
+        for (int i = 0; i < num_servers; i++)
+        {
+            if (listeners[i].revents & POLLIN)
+            {
+                ready = i;
+                break;
+            }
+        }
+    }
+
+    return ready;
+}
+
+/*
+    Wait for a connection on any of the listening sockets and accept it
+    Prints the address of the client that connected
+    Stores the position of the listener used in 'listener', unless it is NULL
+    Returns the file descriptor for the new connection
+*/
+int acceptClient(int * server_fds, int num_servers, int * listener)
+{
+    struct sockaddr_storage client_address;
+    socklen_t client_address_size;
+    char client_presentation[INET_ADDRSTRLEN];
+    int ready = 0;
+    int client_fd;
+
+    // With a single listener there is no need to poll, accept blocks by itself
+    if (num_servers > 1)
+    {
+        ready = waitForClient(server_fds, num_servers, -1);
+    }
+
+    // ACCEPT
+    // Clients are not inherited by programs started with exec, they are passed explicitly
+    client_address_size = sizeof client_address;
+    client_fd = accept4(server_fds[ready], (struct sockaddr *)&client_address, &client_address_size, SOCK_CLOEXEC);
+    if (client_fd == -1)
+    {
+        fatalError("ERROR: accept");
+    }
+
+    if (listener != NULL)
+    {
+        *listener = ready;
+    }
+
+    // Get the data from the client
+    if (client_address.ss_family == AF_INET)
+    {
+        struct sockaddr_in * address = (struct sockaddr_in *)&client_address;
+        inet_ntop(AF_INET, &address->sin_addr, client_presentation, sizeof client_presentation);
+        printf("Received incomming connection from %s on port %d\n", client_presentation, ntohs(address->sin_port));
+    }
+    else
+    {
+        printf("Received incomming local connection\n");
+    }
+
+    return client_fd;
+}
+
+/*
+    Open and connect a Unix domain socket to the server
+    Returns the file descriptor for the socket
+*/
+static int connectUnixSocket(char * endpoint)
+{
+    struct sockaddr_un address;
+    socklen_t address_size;
+    int connection_fd;
+
+    address_size = unixAddress(endpoint, &address);
+
+    // SOCKET
+    connection_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection_fd == -1)
+    {
+        fatalError("ERROR: socket");
+    }
+
+    // CONNECT
+    if (connect(connection_fd, (struct sockaddr *)&address, address_size) == -1)
+    {
+        close(connection_fd);
+        fatalError("ERROR: connect");
+    }
+
+    return connection_fd;
+}
+
 /*
     Open and connect the socket to the server
+    The address can also be a Unix endpoint, in which case the port is ignored
     Returns the file descriptor for the socket
     Remember to close the socket when finished
 */
@@ -124,6 +375,12 @@ int connectSocket(char * address, char * port)
     struct addrinfo * server_info = NULL;
     int connection_fd;
 
+    // Co-located clients can skip the TCP/IP stack completely
+    if (isUnixEndpoint(address))
+    {
+        return connectUnixSocket(address);
+    }
+
     // Prepare the hints structure
     // Clear the structure for the server configuration
     bzero(&hints, sizeof hints);
@@ -166,6 +423,229 @@ int connectSocket(char * address, char * port)
     return connection_fd;
 }
 
+/*
+    Start connecting a non blocking socket to the server, without waiting for the connection
+    The address can also be a Unix endpoint, in which case the port is ignored
+    Returns the file descriptor for the socket, or -1 if the connection failed already
+    The socket becomes writable when the connection ends, check it with finishConnect
+*/
+int startConnect(char * address, char * port)
+{
+    struct addrinfo hints;
+    struct addrinfo * server_info = NULL;
+    struct sockaddr_un unix_address;
+    struct sockaddr * server_address;
+    socklen_t address_size;
+    int connection_fd;
+
+    // Prepare the address of the server, Unix or IPv4
+    if (isUnixEndpoint(address))
+    {
+        address_size = unixAddress(address, &unix_address);
+        server_address = (struct sockaddr *)&unix_address;
+        connection_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    }
+    else
+    {
+        bzero(&hints, sizeof hints);
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        if (getaddrinfo(address, port, &hints, &server_info) != 0)
+        {
+            return -1;
+        }
+        address_size = server_info->ai_addrlen;
+        server_address = server_info->ai_addr;
+        connection_fd = socket(server_info->ai_family, server_info->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, server_info->ai_protocol);
+    }
+
+    // CONNECT
+    // A TCP connection goes on in the background, a refused one fails at once
+    if (connection_fd != -1 && connect(connection_fd, server_address, address_size) == -1 && errno != EINPROGRESS)
+    {
+        close(connection_fd);
+        connection_fd = -1;
+    }
+
+    if (server_info != NULL)
+    {
+        freeaddrinfo(server_info);
+    }
+
+    return connection_fd;
+}
+
+/*
+    Check how the connection started with startConnect ended, once the socket is writable
+    Returns 1 if it is connected, or 0 if it failed
+*/
+int finishConnect(int connection_fd)
+{
+    int error = 0;
+    socklen_t size = sizeof error;
+
+    if (getsockopt(connection_fd, SOL_SOCKET, SO_ERROR, &error, &size) == -1 || error != 0)
+    {
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+    Wait up to 'milliseconds' until a socket has something to receive, or was closed
+    Returns 1 when a receive would not block, or 0 if the time ran out
+*/
+int waitSocket(int connection_fd, int milliseconds)
+{
+    struct pollfd event;
+    int ready;
+
+    event.fd = connection_fd;
+    event.events = POLLIN;
+
+    while ((ready = poll(&event, 1, milliseconds)) == -1)
+    {
+        if (errno != EINTR)
+        {
+            fatalError("ERROR: poll");
+        }
+    }
+
+    return ready > 0;
+}
+
+/*
+    Send file descriptors to another process over a Unix domain socket
+    The data bytes travel together with the descriptors, at least one byte is required
+    Returns 1 on success, or 0 if the connection has finished
+*/
+int sendFds(int connection_fd, const void * data, int size, int * fds, int num_fds)
+{
+    struct msghdr message;
+    struct iovec data_vector;
+    // Space for the control message, aligned as cmsghdr requires
+    union
+    {
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+    } control;
+    struct cmsghdr * header;
+
+    if (num_fds > MAX_PASSED_FDS)
+    {
+        errno = EINVAL;
+        fatalError("ERROR: sendFds");
+    }
+
+    bzero(&message, sizeof message);
+    data_vector.iov_base = (void *)data;
+    data_vector.iov_len = size;
+    message.msg_iov = &data_vector;
+    message.msg_iovlen = 1;
+
+    // The descriptors go in an SCM_RIGHTS control message
+    if (num_fds > 0)
+    {
+        bzero(&control, sizeof control);
+        message.msg_control = control.buffer;
+        message.msg_controllen = CMSG_SPACE(sizeof(int) * num_fds);
+        header = CMSG_FIRSTHDR(&message);
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int) * num_fds);
+        memcpy(CMSG_DATA(header), fds, sizeof(int) * num_fds);
+    }
+
+    if (sendmsg(connection_fd, &message, MSG_NOSIGNAL) == -1)
+    {
+        // The other process went away
+        if (errno == EPIPE || errno == ECONNRESET)
+        {
+            return 0;
+        }
+        fatalError("ERROR: sendmsg");
+    }
+
+    return 1;
+}
+
+/*
+    Receive file descriptors sent with sendFds
+    Stores the data bytes in 'data' and up to 'max_fds' descriptors in 'fds'
+    Returns the number of descriptors received, or -1 if the connection has finished
+*/
+int recvFds(int connection_fd, void * data, int size, int * fds, int max_fds)
+{
+    struct msghdr message;
+    struct iovec data_vector;
+    union
+    {
+        struct cmsghdr align;
+        char buffer[CMSG_SPACE(sizeof(int) * MAX_PASSED_FDS)];
+    } control;
+    struct cmsghdr * header;
+    int bytes_read;
+    int num_fds = 0;
+
+    bzero(&message, sizeof message);
+    data_vector.iov_base = data;
+    data_vector.iov_len = size;
+    message.msg_iov = &data_vector;
+    message.msg_iovlen = 1;
+    message.msg_control = control.buffer;
+    message.msg_controllen = sizeof control.buffer;
+
+    bytes_read = recvmsg(connection_fd, &message, MSG_CMSG_CLOEXEC);
+    if (bytes_read == -1)
+    {
+        if (errno == ECONNRESET)
+        {
+            return -1;
+        }
+        fatalError("ERROR: recvmsg");
+    }
+    if (bytes_read == 0)
+    {
+        return -1;
+    }
+
+    // Collect the descriptors
+    for (header = CMSG_FIRSTHDR(&message); header != NULL; header = CMSG_NXTHDR(&message, header))
+    {
+        if (header->cmsg_level == SOL_SOCKET && header->cmsg_type == SCM_RIGHTS)
+        {
+            int received = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            int * passed = (int *)CMSG_DATA(header);
+
+            for (int i = 0; i < received; i++)
+            {
+                // Keep what fits, close the rest so they do not leak
+                if (num_fds < max_fds)
+                {
+                    fds[num_fds++] = passed[i];
+                }
+                else
+                {
+                    close(passed[i]);
+                }
+            }
+        }
+    }
+
+    // The descriptors arrive with the first byte, the rest of the data may come later
+    if (bytes_read < size && recv(connection_fd, (char *)data + bytes_read, size - bytes_read, MSG_WAITALL) != size - bytes_read)
+    {
+        for (int i = 0; i < num_fds; i++)
+        {
+            close(fds[i]);
+        }
+        return -1;
+    }
+
+    return num_fds;
+}
+
 /*
     Send a string with error validation
     Receive the file descriptor, a string to store the message and the max string size
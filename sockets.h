@@ -22,9 +22,14 @@
 #include <netdb.h>
 #include <arpa/inet.h>
 #include <ifaddrs.h>
+#include <sys/un.h>
+#include <poll.h>
 
 #include "fatal_error.h"
 
+// Most file descriptors that can be passed in a single message
+#define MAX_PASSED_FDS 64
+
 /*
 	Show the local IP addresses, to allow testing
 	Based on code from:
@@ -32,20 +37,84 @@
 */
 void printLocalIPs();
 
+/*
+    Check if an endpoint string names a Unix domain socket
+    Accepted forms are "unix:/path/to/socket" and "unix:@name" for the abstract namespace
+    Returns 1 for a Unix endpoint, or 0 for a TCP port / address
+*/
+int isUnixEndpoint(const char * endpoint);
+
 /*
     Prepare and open the listening socket
+    The port can also be a Unix endpoint ("unix:/path" or "unix:@name")
     Returns the file descriptor for the socket
-    Remember to close the socket when finished
+    Remember to close the socket with closeServer when finished
 */
 int initServer(char * port, int max_queue);
 
+/*
+    Close a listening socket
+    Removes the socket file for Unix endpoints bound to a path
+*/
+void closeServer(int server_fd);
+
+/*
+    Wait until one of the listening sockets has a pending connection
+    The wait also ends when 'wake_fd' becomes readable, use -1 to wait only for clients
+    Returns the position of the listener, or -1 if woken by 'wake_fd'
+*/
+int waitForClient(int * server_fds, int num_servers, int wake_fd);
+
+/*
+    Wait for a connection on any of the listening sockets and accept it
+    Prints the address of the client that connected
+    Stores the position of the listener used in 'listener', unless it is NULL
+    Returns the file descriptor for the new connection
+*/
+int acceptClient(int * server_fds, int num_servers, int * listener);
+
 /*
     Open and connect the socket to the server
+    The address can also be a Unix endpoint, in which case the port is ignored
     Returns the file descriptor for the socket
     Remember to close the socket when finished
 */
 int connectSocket(char * address, char * port);
 
+/*
+    Start connecting a non blocking socket to the server, without waiting for the connection
+    The address can also be a Unix endpoint, in which case the port is ignored
+    Returns the file descriptor for the socket, or -1 if the connection failed already
+    The socket becomes writable when the connection ends, check it with finishConnect
+*/
+int startConnect(char * address, char * port);
+
+/*
+    Check how the connection started with startConnect ended, once the socket is writable
+    Returns 1 if it is connected, or 0 if it failed
+*/
+int finishConnect(int connection_fd);
+
+/*
+    Wait up to 'milliseconds' until a socket has something to receive, or was closed
+    Returns 1 when a receive would not block, or 0 if the time ran out
+*/
+int waitSocket(int connection_fd, int milliseconds);
+
+/*
+    Send file descriptors to another process over a Unix domain socket
+    The data bytes travel together with the descriptors, at least one byte is required
+    Returns 1 on success, or 0 if the connection has finished
+*/
+int sendFds(int connection_fd, const void * data, int size, int * fds, int num_fds);
+
+/*
+    Receive file descriptors sent with sendFds
+    Stores the data bytes in 'data' and up to 'max_fds' descriptors in 'fds'
+    Returns the number of descriptors received, or -1 if the connection has finished
+*/
+int recvFds(int connection_fd, void * data, int size, int * fds, int max_fds);
+
 /*
     Send a string with error validation
     Receive the file descriptor, a string to store the message and the max string size
@@ -0,0 +1,139 @@
+/*
+    Solo practice without a server
+    See solo.h for the description
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "solo.h"
+#include "delta_update.h"
+#include "fred_game.h"
+#include "Game_Codes.h"
+
+#define COLORNUM 7
+
+// State of the engine, only used by its thread
+typedef struct solo_struct
+{
+    //Side of the engine of the rings
+    connection_t connection;
+    delta_baseline_t baseline;
+    //What the client was last sent
+    socketCommunication_t state;
+    fred_game_t game;
+    int playerStates[1];
+    uint64_t alive[FRED_ALIVE_WORDS(1)];
+    uint64_t random;
+} solo_t;
+
+static void *soloThread(void *arg);
+
+/*
+    Next number of a xorshift64* generator
+*/
+static uint64_t nextRandom(uint64_t *state)
+{
+    uint64_t x = *state ? *state : 0x2545F4914F6CDD1DULL;
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+connection_t *startSolo()
+{
+    solo_t *solo = malloc(sizeof(solo_t));
+    connection_t *connection = connectLocal(&solo->connection);
+    struct timespec now;
+    pthread_t tid;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    solo->random = now.tv_nsec ^ ((uint64_t)now.tv_sec << 32) ^ getpid();
+    memset(&solo->baseline, 0, sizeof solo->baseline);
+    fredStart(&solo->game, 1, solo->playerStates, solo->alive, malloc(SOLO_CAPACITY * sizeof(int)), SOLO_CAPACITY);
+
+    if (pthread_create(&tid, NULL, &soloThread, solo) != 0)
+    {
+        fprintf(stderr, "ERROR: pthread_create\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_detach(tid);
+
+    return connection;
+}
+
+/*
+    Play a color with the rules and send the result to the client
+    The player gets the turn after a new color, and loses it once the sequence was repeated
+    Returns 1 on success, or 0 if the client has gone
+*/
+static int playColor(solo_t *solo, int color)
+{
+    fred_update_t update;
+
+    //Make more space for the colors when the sequence is full
+    while (fredPlay(&solo->game, color, &update) == FRED_FULL)
+    {
+        solo->game.capacity *= 2;
+        solo->game.sequence = realloc(solo->game.sequence, solo->game.capacity * sizeof(int));
+    }
+
+    solo->state.color = update.color;
+    solo->state.wrongColor = update.wrongColor;
+    solo->state.newColor = update.newColor;
+    solo->state.newRound = update.newRound;
+    solo->state.gameState = solo->game.gameState;
+    //The next color is added by the engine, the player watches meanwhile
+    solo->state.playerState = update.newColor ? PWAIT : solo->game.playerStates[0];
+
+    return sendUpdate(&solo->connection, &solo->baseline, &solo->state);
+}
+
+/*
+    Thread of the engine: a new color, then the colors of the player until the sequence
+    was repeated or a color was wrong
+*/
+static void *soloThread(void *arg)
+{
+    solo_t *solo = (solo_t *)arg;
+    socketCommunication_t message;
+    int id;
+    int playing;
+
+    //The client sends its ID first, like to a server
+    playing = recvMessage(&solo->connection, &id, sizeof(int));
+
+    //The first color is announced like every new one
+    memset(&solo->state, 0, sizeof solo->state);
+    solo->state.playersExpected = 1;
+    solo->state.playerState = PWAIT;
+    solo->state.gameState = GACTIVE;
+    solo->state.newColor = 1;
+    playing = playing && sendUpdate(&solo->connection, &solo->baseline, &solo->state);
+
+    while (playing && solo->game.gameState == GACTIVE)
+    {
+        usleep(SOLO_PAUSE_MS * 1000);
+        playing = playColor(solo, nextRandom(&solo->random) % COLORNUM + 1);
+
+        while (playing && solo->state.playerState == PACTIVE)
+        {
+            playing = recvMessage(&solo->connection, &message, sizeof(socketCommunication_t)) && playColor(solo, message.color);
+        }
+    }
+
+    shutConnection(&solo->connection);
+    free(solo->game.sequence);
+    free(solo);
+
+    return NULL;
+}
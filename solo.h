@@ -0,0 +1,28 @@
+/*
+    Solo practice without a server ("FFClient solo")
+    - The rules of libfred run in a thread of the client, which talks to it through the
+      shared memory rings of connectLocal: no socket, and no system call while both sides spin
+    - Classic Simon: the engine adds a color at random, and the player repeats the whole
+      sequence to get the next one. A wrong color ends the game
+    - The engine sends the same updates as the server, so the client plays it like any other game
+*/
+
+#ifndef SOLO_H
+#define SOLO_H
+
+#include "connection.h"
+
+// Endpoint given to the client instead of a server
+#define SOLO_ENDPOINT "solo"
+// Milliseconds the engine waits before adding a color, while the client shows the last one
+#define SOLO_PAUSE_MS 1000
+// Colors the sequence has space for at first, it grows when full
+#define SOLO_CAPACITY 64
+
+/*
+    Start the engine in a new thread
+    Returns the connection of the client to it
+*/
+connection_t *startSolo();
+
+#endif  /* NOT SOLO_H */
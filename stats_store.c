@@ -0,0 +1,429 @@
+/*
+    Stats of the players, kept across games in a file
+    See stats_store.h for the description
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stats_store.h"
+
+// "FRED" at the beginning of the file
+#define STATS_MAGIC 0x44455246
+#define STATS_VERSION 1
+// Records of a new file, doubled every time it is full
+#define STATS_INITIAL_PLAYERS 1024
+
+// Beginning of the file, the size of a cache line so the records are aligned
+typedef struct stats_header_struct
+{
+    uint32_t magic;
+    uint32_t version;
+    //Records the file has space for
+    int32_t capacity;
+    //Records in use
+    int32_t count;
+    char reserved[48];
+} stats_header_t;
+
+/*
+    Bytes of a file with space for 'capacity' records
+*/
+static size_t fileSize(int capacity)
+{
+    return sizeof(stats_header_t) + (size_t)capacity * sizeof(player_stats_t);
+}
+
+/*
+    Map the file with space for 'capacity' records
+    Returns 1 on success, or 0 on error
+*/
+static int mapFile(stats_store_t *store, int capacity)
+{
+    int protection = store->readOnly ? PROT_READ : PROT_READ | PROT_WRITE;
+    void *region = mmap(NULL, fileSize(capacity), protection, MAP_SHARED, store->fd, 0);
+
+    if (region == MAP_FAILED)
+    {
+        return 0;
+    }
+
+    store->header = region;
+    store->records = (player_stats_t *)(store->header + 1);
+
+    return 1;
+}
+
+/*
+    First place to look for a player in the hash table
+*/
+static inline int hashID(stats_store_t *store, int id)
+{
+    return ((uint32_t)id * 2654435761u) & store->slotMask;
+}
+
+/*
+    Put every record in a hash table with space for twice the capacity of the file
+*/
+static void buildSlots(stats_store_t *store)
+{
+    int size = 1;
+    int slot;
+
+    while (size < 2 * store->header->capacity)
+    {
+        size *= 2;
+    }
+
+    free(store->slots);
+    store->slots = malloc(size * sizeof(int));
+    store->slotMask = size - 1;
+    memset(store->slots, -1, size * sizeof(int));
+
+    for (int i = 0; i < store->header->count; i++)
+    {
+        slot = hashID(store, store->records[i].id);
+        while (store->slots[slot] != -1)
+        {
+            slot = (slot + 1) & store->slotMask;
+        }
+        store->slots[slot] = i;
+    }
+}
+
+/*
+    Sort the records by wins, counting the players with every number of wins
+*/
+static void buildLeaderboard(stats_store_t *store)
+{
+    int count = store->header->count;
+    int *next;
+
+    store->mostWins = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (store->records[i].wins > store->mostWins)
+        {
+            store->mostWins = store->records[i].wins;
+        }
+    }
+
+    store->order = malloc(store->header->capacity * sizeof(int));
+    store->position = malloc(store->header->capacity * sizeof(int));
+    store->ahead = calloc(store->mostWins + 1, sizeof(int));
+    next = calloc(store->mostWins + 1, sizeof(int));
+
+    //Players with more than n wins, from the most wins down
+    for (int i = 0; i < count; i++)
+    {
+        next[store->records[i].wins]++;
+    }
+    for (int wins = store->mostWins - 1; wins >= 0; wins--)
+    {
+        store->ahead[wins] = store->ahead[wins + 1] + next[wins + 1];
+    }
+
+    //Every player goes after the ones with more wins
+    memcpy(next, store->ahead, (store->mostWins + 1) * sizeof(int));
+    for (int i = 0; i < count; i++)
+    {
+        store->order[next[store->records[i].wins]] = i;
+        store->position[i] = next[store->records[i].wins];
+        next[store->records[i].wins]++;
+    }
+
+    free(next);
+}
+
+/*
+    Double the records of the file
+    Returns 1 on success, or 0 if the file can't grow
+*/
+static int growFile(stats_store_t *store)
+{
+    stats_header_t *header = store->header;
+    int capacity = header->capacity * 2;
+
+    //A file with holes would raise SIGBUS on the first record written to a full disk, so the
+    //blocks are taken now, when running out of space is only an error
+    if (posix_fallocate(store->fd, 0, fileSize(capacity)) != 0)
+    {
+        return 0;
+    }
+
+    //The old mapping stays in use until the new one exists
+    if (!mapFile(store, capacity))
+    {
+        return 0;
+    }
+    munmap(header, fileSize(header->capacity));
+    store->header->capacity = capacity;
+
+    store->order = realloc(store->order, capacity * sizeof(int));
+    store->position = realloc(store->position, capacity * sizeof(int));
+    buildSlots(store);
+
+    return 1;
+}
+
+/*
+    Create the stats of a new player, with the fewest wins
+    Returns the record, or NULL if there is no space for it
+*/
+static player_stats_t *addPlayer(stats_store_t *store, int id)
+{
+    int index = store->header->count;
+    int slot;
+
+    if (index == store->header->capacity && !growFile(store))
+    {
+        return NULL;
+    }
+
+    bzero(&store->records[index], sizeof(player_stats_t));
+    store->records[index].id = id;
+    store->header->count++;
+
+    slot = hashID(store, id);
+    while (store->slots[slot] != -1)
+    {
+        slot = (slot + 1) & store->slotMask;
+    }
+    store->slots[slot] = index;
+
+    //Nobody has fewer than 0 wins, the new player goes last
+    store->order[index] = index;
+    store->position[index] = index;
+
+    return &store->records[index];
+}
+
+/*
+    Count a win, moving the player to the front of the players with as many wins as it had
+*/
+static void addWin(stats_store_t *store, int index)
+{
+    int wins = store->records[index].wins;
+    int from = store->position[index];
+    int to = store->ahead[wins];
+    int other = store->order[to];
+
+    store->order[from] = other;
+    store->position[other] = from;
+    store->order[to] = index;
+    store->position[index] = to;
+
+    store->ahead[wins]++;
+    store->records[index].wins++;
+
+    if (store->records[index].wins > store->mostWins)
+    {
+        store->mostWins = store->records[index].wins;
+        store->ahead = realloc(store->ahead, (store->mostWins + 1) * sizeof(int));
+        store->ahead[store->mostWins] = 0;
+    }
+}
+
+/*
+    Map a file that already has a store, and build the indexes
+    The records of a file are only trusted if it has space for all of them
+    Returns 1 on success, or 0 if it isn't a stats file
+*/
+static int mapStats(stats_store_t *store, struct stat *info)
+{
+    int capacity;
+
+    if ((size_t)info->st_size < sizeof(stats_header_t) || !mapFile(store, 0))
+    {
+        return 0;
+    }
+    if (store->header->magic != STATS_MAGIC || store->header->version != STATS_VERSION
+        || store->header->capacity < 1 || (size_t)info->st_size < fileSize(store->header->capacity)
+        || store->header->count < 0 || store->header->count > store->header->capacity)
+    {
+        munmap(store->header, sizeof(stats_header_t));
+        return 0;
+    }
+    capacity = store->header->capacity;
+    munmap(store->header, sizeof(stats_header_t));
+    if (!mapFile(store, capacity))
+    {
+        return 0;
+    }
+
+    buildSlots(store);
+    buildLeaderboard(store);
+
+    return 1;
+}
+
+/*
+    Open the store in 'path', creating it if it doesn't exist, and build the indexes
+    Returns 1 on success, or 0 if the file can't be used
+*/
+int openStats(stats_store_t *store, const char *path)
+{
+    struct stat info;
+
+    bzero(store, sizeof(stats_store_t));
+    store->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (store->fd == -1 || fstat(store->fd, &info) == -1)
+    {
+        return 0;
+    }
+
+    //A new file, with its blocks taken like when it grows
+    if (info.st_size == 0)
+    {
+        if (posix_fallocate(store->fd, 0, fileSize(STATS_INITIAL_PLAYERS)) != 0 || !mapFile(store, STATS_INITIAL_PLAYERS))
+        {
+            close(store->fd);
+            return 0;
+        }
+        store->header->magic = STATS_MAGIC;
+        store->header->version = STATS_VERSION;
+        store->header->capacity = STATS_INITIAL_PLAYERS;
+        store->header->count = 0;
+
+        buildSlots(store);
+        buildLeaderboard(store);
+    }
+    else if (!mapStats(store, &info))
+    {
+        close(store->fd);
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+    Open the store in 'path' only to read it, without ever creating or changing the file
+    Returns 1 on success, or 0 if it isn't a stats file
+*/
+int readStats(stats_store_t *store, const char *path)
+{
+    struct stat info;
+
+    bzero(store, sizeof(stats_store_t));
+    store->readOnly = 1;
+    store->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (store->fd == -1 || fstat(store->fd, &info) == -1)
+    {
+        return 0;
+    }
+
+    if (!mapStats(store, &info))
+    {
+        close(store->fd);
+        return 0;
+    }
+
+    return 1;
+}
+
+/*
+    Write the store back to the file, unless it was only read, and close it
+*/
+void closeStats(stats_store_t *store)
+{
+    size_t size = fileSize(store->header->capacity);
+
+    if (!store->readOnly)
+    {
+        msync(store->header, size, MS_SYNC);
+    }
+    munmap(store->header, size);
+    close(store->fd);
+
+    free(store->slots);
+    free(store->order);
+    free(store->position);
+    free(store->ahead);
+}
+
+/*
+    Stats of a player
+    Returns the record, or NULL if the player has none
+*/
+player_stats_t *findPlayer(stats_store_t *store, int id)
+{
+    int slot = hashID(store, id);
+
+    while (store->slots[slot] != -1)
+    {
+        if (store->records[store->slots[slot]].id == id)
+        {
+            return &store->records[store->slots[slot]];
+        }
+        slot = (slot + 1) & store->slotMask;
+    }
+
+    return NULL;
+}
+
+/*
+    Add the result of a game to the stats of the player, creating them for a new player
+*/
+void recordResult(stats_store_t *store, stats_result_t *result)
+{
+    player_stats_t *player = findPlayer(store, result->id);
+
+    if (player == NULL)
+    {
+        player = addPlayer(store, result->id);
+        if (player == NULL)
+        {
+            return;
+        }
+    }
+
+    player->games++;
+    player->turnsSurvived += result->turns;
+    if (result->sequence > player->longestSequence)
+    {
+        player->longestSequence = result->sequence;
+    }
+    if (result->winner)
+    {
+        addWin(store, player - store->records);
+    }
+}
+
+/*
+    Rank of a player by wins, players with as many wins share the rank
+    Returns the rank, from 1, or 0 if the player has no stats
+*/
+int playerRank(stats_store_t *store, int id)
+{
+    player_stats_t *player = findPlayer(store, id);
+
+    if (player == NULL)
+    {
+        return 0;
+    }
+
+    return store->ahead[player->wins] + 1;
+}
+
+/*
+    The players with the most wins, best first
+    'top' must have space for 'k' records
+    Returns the number of records stored, less than 'k' if there are fewer players
+*/
+int topPlayers(stats_store_t *store, player_stats_t **top, int k)
+{
+    int count = k < store->header->count ? k : store->header->count;
+
+    for (int i = 0; i < count; i++)
+    {
+        top[i] = &store->records[store->order[i]];
+    }
+
+    return count;
+}
@@ -0,0 +1,106 @@
+/*
+    Stats of the players, kept across games in a file
+    - The file is a header followed by one fixed size record per player, mapped in memory,
+      so a result only changes a few words and the kernel writes them back
+    - The records are found by player ID with a hash table, and the leaderboard (by wins)
+      is an array kept in order as the results come in: a win moves the player to the front
+      of the players with as many wins as it had, so every result takes constant time,
+      the top K players are the first K of the array and the rank of a player is a lookup
+    - The game threads don't touch the store: they put their results in a lock-free queue
+      with many producers and one consumer (mpsc_queue.h), and a full queue drops the result
+      instead of making a game wait
+*/
+
+#ifndef STATS_STORE_H
+#define STATS_STORE_H
+
+#include <stdint.h>
+
+// Results that can wait in the queue, a power of 2
+#define STATS_QUEUE_SIZE 4096
+
+// Stats of one player, as stored in the file
+typedef struct player_stats_struct
+{
+    int32_t id;
+    int32_t games;
+    int32_t wins;
+    //Longest sequence of colors of all its games
+    int32_t longestSequence;
+    //Turns of the games played while the player was in them
+    int64_t turnsSurvived;
+} player_stats_t;
+
+// Result of one player in one game
+typedef struct stats_result_struct
+{
+    int id;
+    int winner;
+    //Colors of the sequence when the player was out, or when it won
+    int sequence;
+    //Turns of the game until then
+    int turns;
+} stats_result_t;
+
+// Store of the stats, only used by one thread at a time
+typedef struct stats_store_struct
+{
+    int fd;
+    //Opened with readStats, the file is never written
+    int readOnly;
+    //Mapped file: header, then the records
+    struct stats_header_struct *header;
+    player_stats_t *records;
+    //Slot of the record of every player, by a hash of its ID, -1 when free
+    int *slots;
+    int slotMask;
+    //Slots of the records from the most wins to the fewest, and the position of every slot
+    int *order;
+    int *position;
+    //Number of players with more than n wins, for n up to the most wins of a player
+    int *ahead;
+    int mostWins;
+} stats_store_t;
+
+/*
+    Open the store in 'path', creating it if it doesn't exist, and build the indexes
+    Returns 1 on success, or 0 if the file can't be used
+*/
+int openStats(stats_store_t *store, const char *path);
+
+/*
+    Open the store in 'path' only to read it, without ever creating or changing the file
+    Returns 1 on success, or 0 if it isn't a stats file
+*/
+int readStats(stats_store_t *store, const char *path);
+
+/*
+    Write the store back to the file, unless it was only read, and close it
+*/
+void closeStats(stats_store_t *store);
+
+/*
+    Add the result of a game to the stats of the player, creating them for a new player
+*/
+void recordResult(stats_store_t *store, stats_result_t *result);
+
+/*
+    Stats of a player
+    Returns the record, or NULL if the player has none
+*/
+player_stats_t *findPlayer(stats_store_t *store, int id);
+
+/*
+    Rank of a player by wins, players with as many wins share the rank
+    Returns the rank, from 1, or 0 if the player has no stats
+*/
+int playerRank(stats_store_t *store, int id);
+
+/*
+    The players with the most wins, best first
+    'top' must have space for 'k' records
+    Returns the number of records stored, less than 'k' if there are fewer players
+*/
+int topPlayers(stats_store_t *store, player_stats_t **top, int k);
+
+#endif  /* NOT STATS_STORE_H */
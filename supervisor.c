@@ -0,0 +1,366 @@
+/*
+    Supervisor mode for the server
+    See supervisor.h for the description
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "supervisor.h"
+#include "connection.h"
+#include "sockets.h"
+#include "fatal_error.h"
+#include "admission.h"
+
+// Data byte that goes with a passed client, telling which kind of listener it came from
+#define CLIENT_SOCKET 'T'
+#define CLIENT_SHM 'S'
+#define CLIENT_TLS 'E'
+
+// State of a worker process, as seen by the supervisor
+typedef struct worker_struct
+{
+    pid_t pid;
+    //Supervisor end of the channel to the worker
+    int channel_fd;
+    //Players connected to the worker, in games or waiting for one
+    int load;
+    //Players passed to the worker that are not yet in a formed game
+    int pending;
+} worker_t;
+
+// Data used by the supervisor loop
+typedef struct supervisor_struct
+{
+    int *server_fds;
+    int *transports;
+    int numServers;
+    worker_t workers[MAX_WORKERS];
+    int numWorkers;
+    worker_main_t workerMain;
+    admission_t *admission;
+} supervisor_t;
+
+// Reports can come from the thread forming games and from the game threads
+static pthread_mutex_t reportMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+    Start the worker process in the given slot
+*/
+static void spawnWorker(supervisor_t *supervisor, int slot)
+{
+    int channel[2];
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, channel) == -1)
+    {
+        fatalError("ERROR: socketpair");
+    }
+
+    // Anything still buffered would be printed again by the worker
+    fflush(stdout);
+
+    pid = fork();
+    if (pid == -1)
+    {
+        fatalError("ERROR: fork");
+    }
+
+    // The worker only keeps its end of its own channel
+    if (pid == 0)
+    {
+        for (int i = 0; i < supervisor->numServers; i++)
+        {
+            close(supervisor->server_fds[i]);
+        }
+        for (int i = 0; i < supervisor->numWorkers; i++)
+        {
+            if (i != slot && supervisor->workers[i].channel_fd != -1)
+            {
+                close(supervisor->workers[i].channel_fd);
+            }
+        }
+        close(channel[0]);
+
+        supervisor->workerMain(channel[1], slot);
+        exit(EXIT_SUCCESS);
+    }
+
+    close(channel[1]);
+    supervisor->workers[slot].pid = pid;
+    supervisor->workers[slot].channel_fd = channel[0];
+    supervisor->workers[slot].load = 0;
+    supervisor->workers[slot].pending = 0;
+
+    printf("Worker %d started with pid %d\n", slot, pid);
+}
+
+/*
+    Collect a worker that went away and start a replacement
+    The games of the worker are lost, the other workers are not affected
+*/
+static void replaceWorker(supervisor_t *supervisor, int slot)
+{
+    worker_t *worker = &supervisor->workers[slot];
+    int status;
+
+    close(worker->channel_fd);
+    worker->channel_fd = -1;
+
+    waitpid(worker->pid, &status, 0);
+    if (WIFSIGNALED(status))
+    {
+        printf("Worker %d (pid %d) killed by signal %d, %d players lost\n", slot, worker->pid, WTERMSIG(status), worker->load);
+    }
+    else
+    {
+        printf("Worker %d (pid %d) exited with status %d, %d players lost\n", slot, worker->pid, WEXITSTATUS(status), worker->load);
+    }
+
+    spawnWorker(supervisor, slot);
+}
+
+/*
+    Choose the worker for a new client
+    A game that is still being formed has to stay in one worker, otherwise the least loaded one is used
+*/
+static int chooseWorker(supervisor_t *supervisor)
+{
+    int chosen = 0;
+
+    for (int i = 0; i < supervisor->numWorkers; i++)
+    {
+        if (supervisor->workers[i].pending > 0)
+        {
+            return i;
+        }
+        if (supervisor->workers[i].load < supervisor->workers[chosen].load)
+        {
+            chosen = i;
+        }
+    }
+
+    return chosen;
+}
+
+/*
+    Pass a client that was just accepted to one of the workers
+*/
+static void placeClient(supervisor_t *supervisor, int client_fd, int transport)
+{
+    char kind = transport == TRANSPORT_SHM ? CLIENT_SHM : transport == TRANSPORT_TLS ? CLIENT_TLS : CLIENT_SOCKET;
+    int slot = chooseWorker(supervisor);
+
+    // A worker that cannot receive the client has died, replace it and try again
+    while (!sendFds(supervisor->workers[slot].channel_fd, &kind, 1, &client_fd, 1))
+    {
+        replaceWorker(supervisor, slot);
+        slot = chooseWorker(supervisor);
+    }
+
+    supervisor->workers[slot].load++;
+    supervisor->workers[slot].pending++;
+
+    // The worker has its own copy of the socket now
+    close(client_fd);
+}
+
+/*
+    Players passed to the workers that no game took yet
+*/
+static int pendingClients(supervisor_t *supervisor)
+{
+    int pending = 0;
+
+    for (int i = 0; i < supervisor->numWorkers; i++)
+    {
+        pending += supervisor->workers[i].pending;
+    }
+
+    return pending;
+}
+
+/*
+    Accept the clients waiting on a listener, and pass the ones within the limits to the workers
+*/
+static void admitClients(supervisor_t *supervisor, int listener)
+{
+    int clients[ADMISSION_BATCH];
+    int transport = supervisor->transports[listener];
+    int accepted = acceptBatch(supervisor->server_fds[listener], clients, ADMISSION_BATCH);
+    int refused = 0;
+
+    for (int i = 0; i < accepted; i++)
+    {
+        if (pendingClients(supervisor) < ADMISSION_PENDING && admitClient(supervisor->admission, clients[i]))
+        {
+            placeClient(supervisor, clients[i], transport);
+        }
+        else
+        {
+            refuseClient(supervisor->admission, clients[i], transport);
+            refused++;
+        }
+    }
+
+    if (refused > 0)
+    {
+        printf("Received %d incomming connections, %d refused (server full)\n", accepted, refused);
+    }
+    else if (accepted > 0)
+    {
+        printf("Received %d incomming connections\n", accepted);
+    }
+}
+
+/*
+    Read a report from a worker and update its load
+    Returns 1 on success, or 0 if the worker has gone away
+*/
+static int readReport(supervisor_t *supervisor, int slot)
+{
+    worker_t *worker = &supervisor->workers[slot];
+    worker_report_t report;
+
+    if (recv(worker->channel_fd, &report, sizeof report, MSG_WAITALL) != sizeof report)
+    {
+        return 0;
+    }
+
+    if (report.type == REPORT_FORMED)
+    {
+        worker->pending -= report.players;
+        if (worker->pending < 0)
+        {
+            worker->pending = 0;
+        }
+    }
+    else if (report.type == REPORT_FINISHED)
+    {
+        worker->load -= report.players;
+        if (worker->load < 0)
+        {
+            worker->load = 0;
+        }
+    }
+
+    return 1;
+}
+
+/*
+    Start the worker processes and pass them the connections from the listeners
+    Never returns
+*/
+void runSupervisor(int *server_fds, int *transports, int numServers, int numWorkers, admission_t *admission, worker_main_t workerMain)
+{
+    supervisor_t supervisor;
+    struct pollfd events[numServers + MAX_WORKERS];
+
+    supervisor.server_fds = server_fds;
+    supervisor.transports = transports;
+    supervisor.numServers = numServers;
+    supervisor.numWorkers = numWorkers < MAX_WORKERS ? numWorkers : MAX_WORKERS;
+    supervisor.workerMain = workerMain;
+    supervisor.admission = admission;
+
+    for (int i = 0; i < supervisor.numWorkers; i++)
+    {
+        supervisor.workers[i].channel_fd = -1;
+    }
+    for (int i = 0; i < supervisor.numWorkers; i++)
+    {
+        spawnWorker(&supervisor, i);
+    }
+
+    while (1)
+    {
+        // Listeners first, then the channels to the workers
+        for (int i = 0; i < numServers; i++)
+        {
+            events[i].fd = server_fds[i];
+            events[i].events = POLLIN;
+            events[i].revents = 0;
+        }
+        for (int i = 0; i < supervisor.numWorkers; i++)
+        {
+            events[numServers + i].fd = supervisor.workers[i].channel_fd;
+            events[numServers + i].events = POLLIN;
+            events[numServers + i].revents = 0;
+        }
+
+        if (poll(events, numServers + supervisor.numWorkers, -1) == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            fatalError("ERROR: poll");
+        }
+
+        // Reports go first, so the loads are up to date when placing new clients
+        for (int i = 0; i < supervisor.numWorkers; i++)
+        {
+            if (events[numServers + i].revents && !readReport(&supervisor, i))
+            {
+                replaceWorker(&supervisor, i);
+            }
+        }
+
+        for (int i = 0; i < numServers; i++)
+        {
+            if (events[i].revents & POLLIN)
+            {
+                admitClients(&supervisor, i);
+            }
+        }
+    }
+}
+
+/*
+    Worker side: wait for the next client from the supervisor
+    Stores in 'transport' the kind of listener the client came through (see connection.h)
+    Returns the socket of the client, or -1 if the supervisor is gone
+*/
+int recvClient(int supervisor_fd, int *transport)
+{
+    char kind;
+    int client_fd;
+    int received = 0;
+
+    // A message without a descriptor means it could not be passed, wait for the next one
+    while (received == 0)
+    {
+        received = recvFds(supervisor_fd, &kind, 1, &client_fd, 1);
+    }
+    if (received == -1)
+    {
+        return -1;
+    }
+
+    *transport = kind == CLIENT_SHM ? TRANSPORT_SHM : kind == CLIENT_TLS ? TRANSPORT_TLS : TRANSPORT_SOCKET;
+
+    return client_fd;
+}
+
+/*
+    Worker side: tell the supervisor that a number of players were formed into a game,
+    or that they finished playing
+*/
+void reportToSupervisor(int supervisor_fd, reportType_t type, int players)
+{
+    worker_report_t report;
+
+    report.type = type;
+    report.players = players;
+
+    pthread_mutex_lock(&reportMutex);
+    send(supervisor_fd, &report, sizeof report, MSG_NOSIGNAL);
+    pthread_mutex_unlock(&reportMutex);
+}
@@ -0,0 +1,56 @@
+/*
+    Supervisor mode for the server
+    - The front process accepts every connection and passes the socket
+      with SCM_RIGHTS to one of N worker processes
+    - Every worker runs its own set of games, so a crash only takes down its own games
+    - The players of a game that is still being formed all go to the same worker,
+      new games go to the worker with the fewest connected players
+    - Workers report back when a game is formed and when it finishes
+    - A worker that dies is replaced by a new one
+    - New clients are accepted in batches and checked against the limits of admission.h,
+      also when the workers hold too many clients that no game took yet
+*/
+
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+
+#include "admission.h"
+
+// Most worker processes that can be started
+#define MAX_WORKERS 64
+
+// Types of reports from a worker to the supervisor
+typedef enum reportType {REPORT_FORMED, REPORT_FINISHED} reportType_t;
+
+// Message sent from a worker to the supervisor
+typedef struct worker_report_struct
+{
+    int type;
+    //Number of players the report refers to
+    int players;
+} worker_report_t;
+
+// Function that runs in every worker process, receiving the channel to the supervisor and its slot
+typedef void (*worker_main_t)(int supervisor_fd, int worker);
+
+/*
+    Start the worker processes and pass them the connections from the listeners
+    The clients over the limits in 'admission' are refused
+    Never returns
+*/
+void runSupervisor(int *server_fds, int *transports, int numServers, int numWorkers, admission_t *admission, worker_main_t workerMain);
+
+/*
+    Worker side: wait for the next client from the supervisor
+    Stores in 'transport' the kind of listener the client came through (see connection.h)
+    Returns the socket of the client, or -1 if the supervisor is gone
+*/
+int recvClient(int supervisor_fd, int *transport);
+
+/*
+    Worker side: tell the supervisor that a number of players were formed into a game,
+    or that they finished playing
+*/
+void reportToSupervisor(int supervisor_fd, reportType_t type, int players);
+
+#endif  /* NOT SUPERVISOR_H */
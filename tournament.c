@@ -0,0 +1,143 @@
+/*
+    Tournaments of Fabulous Fred
+    See tournament.h for the description
+*/
+
+#include <stdlib.h>
+
+#include "tournament.h"
+
+/*
+    Order of a Swiss roster: best score first, then by the order of the roster
+*/
+static int compareEntrants(const void *a, const void *b)
+{
+    const entrant_t *first = (const entrant_t *)a;
+    const entrant_t *second = (const entrant_t *)b;
+
+    if (first->score != second->score)
+    {
+        return second->score - first->score;
+    }
+
+    return first->id - second->id;
+}
+
+/*
+    Move the entrants still in a bracket to the front, keeping their order,
+    so the winners of neighbouring matches meet in the next round
+*/
+static void compactBracket(tournament_t *tournament)
+{
+    entrant_t entrant;
+    int seated = 0;
+
+    for (int i = 0; i < tournament->entrants; i++)
+    {
+        if (!tournament->roster[i].out)
+        {
+            entrant = tournament->roster[i];
+            tournament->roster[i] = tournament->roster[seated];
+            tournament->roster[seated] = entrant;
+            seated++;
+        }
+    }
+
+    tournament->seated = seated;
+}
+
+/*
+    Start a tournament, with the entrants numbered from 0 in the order of the roster
+    'roster' must have space for 'entrants' entrants
+    'perMatch' must be at least 2
+*/
+void tournamentStart(tournament_t *tournament, tournamentFormat_t format, entrant_t *roster, int entrants, int perMatch)
+{
+    tournament->format = format;
+    tournament->roster = roster;
+    tournament->entrants = entrants;
+    tournament->seated = entrants;
+    tournament->perMatch = perMatch;
+    tournament->round = 0;
+    tournament->matches = 0;
+
+    for (int i = 0; i < entrants; i++)
+    {
+        roster[i].id = i;
+        roster[i].score = 0;
+        roster[i].out = 0;
+    }
+
+    //Enough rounds for one entrant to be left in a bracket
+    tournament->rounds = 0;
+    for (int left = entrants; left > 1; left = (left + perMatch - 1) / perMatch)
+    {
+        tournament->rounds++;
+    }
+}
+
+/*
+    Seat the entrants for the next round, with the results of the last one
+    Returns the number of matches of the round,
+    or 0 if the tournament is over, then the first entrant of the roster is the champion
+*/
+int tournamentRound(tournament_t *tournament)
+{
+    if (tournament->format == TOURNAMENT_BRACKET)
+    {
+        compactBracket(tournament);
+    }
+    else
+    {
+        qsort(tournament->roster, tournament->entrants, sizeof(entrant_t), compareEntrants);
+    }
+
+    if (tournament->seated < 2 || tournament->round == tournament->rounds)
+    {
+        tournament->matches = 0;
+        return 0;
+    }
+
+    tournament->round++;
+    tournament->matches = (tournament->seated + tournament->perMatch - 1) / tournament->perMatch;
+
+    return tournament->matches;
+}
+
+/*
+    Players of a match of the current round, which are seated one after the other
+    The seat of the first player is stored in 'first'
+    Returns the number of players, a match of 1 player is a bye
+*/
+int tournamentMatch(tournament_t *tournament, int match, int *first)
+{
+    //The matches differ in one player at most
+    int size = tournament->seated / tournament->matches;
+    int larger = tournament->seated % tournament->matches;
+
+    *first = match * size + (match < larger ? match : larger);
+
+    return size + (match < larger);
+}
+
+/*
+    Record the result of the entrant in 'seat' in its match
+    'beaten' is the number of players that were out of the match before it
+*/
+void tournamentResult(tournament_t *tournament, int seat, int beaten, int winner)
+{
+    tournament->roster[seat].score += beaten;
+    if (tournament->format == TOURNAMENT_BRACKET && !winner)
+    {
+        tournament->roster[seat].out = 1;
+    }
+}
+
+/*
+    Check if the entrant in 'seat' has more to play or to hear of the tournament
+    Returns 1 for everybody in a Swiss tournament and for the entrants still in a bracket
+*/
+int tournamentGoesOn(tournament_t *tournament, int seat)
+{
+    return tournament->format == TOURNAMENT_SWISS || !tournament->roster[seat].out;
+}
@@ -0,0 +1,82 @@
+/*
+    Tournaments of Fabulous Fred
+    - Like the rules (libfred), no input / output, no threads and no memory allocation:
+      the caller gives the storage, plays the matches and reports the results
+    - Bracket: the winner of every match goes on to the next round, until only one is left
+    - Swiss: everybody plays every round, against entrants with about the same score,
+      and the best score after the last round wins
+    - Every round splits the entrants into matches of about the same size that can all be
+      played at the same time, so a round takes as long as its longest match whatever the
+      size of the roster, and the number of rounds only grows with its logarithm
+*/
+
+#ifndef TOURNAMENT_H
+#define TOURNAMENT_H
+
+// Kinds of tournament
+typedef enum tournamentFormat {TOURNAMENT_BRACKET, TOURNAMENT_SWISS} tournamentFormat_t;
+
+// One entrant of a tournament
+typedef struct entrant_struct
+{
+    //Number of the entrant in the roster of the caller
+    int id;
+    //Players beaten in all the matches so far
+    int score;
+    //Set once the entrant lost a match of a bracket
+    int out;
+} entrant_t;
+
+// State of one tournament
+typedef struct tournament_struct
+{
+    int format;
+    //Entrants in the order they are seated in the current round, in storage given by the caller
+    entrant_t *roster;
+    int entrants;
+    //Entrants playing the current round, the first ones of the roster
+    int seated;
+    //Most players in one match
+    int perMatch;
+    //Rounds played so far, including the current one
+    int round;
+    //Rounds of a Swiss tournament, as many as a bracket of the same roster would need
+    int rounds;
+    //Matches of the current round
+    int matches;
+} tournament_t;
+
+/*
+    Start a tournament, with the entrants numbered from 0 in the order of the roster
+    'roster' must have space for 'entrants' entrants
+    'perMatch' must be at least 2
+*/
+void tournamentStart(tournament_t *tournament, tournamentFormat_t format, entrant_t *roster, int entrants, int perMatch);
+
+/*
+    Seat the entrants for the next round, with the results of the last one
+    Returns the number of matches of the round,
+    or 0 if the tournament is over, then the first entrant of the roster is the champion
+*/
+int tournamentRound(tournament_t *tournament);
+
+/*
+    Players of a match of the current round, which are seated one after the other
+    The seat of the first player is stored in 'first'
+    Returns the number of players, a match of 1 player is a bye
+*/
+int tournamentMatch(tournament_t *tournament, int match, int *first);
+
+/*
+    Record the result of the entrant in 'seat' in its match
+    'beaten' is the number of players that were out of the match before it
+*/
+void tournamentResult(tournament_t *tournament, int seat, int beaten, int winner);
+
+/*
+    Check if the entrant in 'seat' has more to play or to hear of the tournament
+    Returns 1 for everybody in a Swiss tournament and for the entrants still in a bracket
+*/
+int tournamentGoesOn(tournament_t *tournament, int seat);
+
+#endif  /* NOT TOURNAMENT_H */
@@ -0,0 +1,304 @@
+/*
+    Server side of the WebSocket protocol (RFC 6455), for the browser gateway
+    See websocket.h for the description
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+
+#include "websocket.h"
+
+// Added to the key of the browser before hashing it, fixed by the protocol
+#define WS_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+
+/*
+    Rotate the bits of a word to the left, for SHA-1
+*/
+static uint32_t rotate(uint32_t value, int bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+/*
+    SHA-1 of a short message, only used for the accept key of the handshake
+*/
+static void sha1(const unsigned char *message, size_t length, unsigned char digest[20])
+{
+    uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0};
+    unsigned char block[64];
+    uint64_t bits = (uint64_t)length * 8;
+    //The message, a 1 bit, zeros up to 8 bytes before the end of a block, and the length
+    size_t total = (length + 8) / 64 * 64 + 64;
+
+    for (size_t start = 0; start < total; start += 64)
+    {
+        uint32_t w[80];
+        uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+
+        for (int i = 0; i < 64; i++)
+        {
+            size_t position = start + i;
+
+            if (position < length)
+            {
+                block[i] = message[position];
+            }
+            else if (position == length)
+            {
+                block[i] = 0x80;
+            }
+            else if (position >= total - 8)
+            {
+                block[i] = bits >> ((total - 1 - position) * 8);
+            }
+            else
+            {
+                block[i] = 0;
+            }
+        }
+
+        for (int i = 0; i < 16; i++)
+        {
+            w[i] = (uint32_t)block[i * 4] << 24 | (uint32_t)block[i * 4 + 1] << 16 | (uint32_t)block[i * 4 + 2] << 8 | block[i * 4 + 3];
+        }
+        for (int i = 16; i < 80; i++)
+        {
+            w[i] = rotate(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+        }
+
+        for (int i = 0; i < 80; i++)
+        {
+            uint32_t f, k, temp;
+
+            if (i < 20)
+            {
+                f = (b & c) | (~b & d);
+                k = 0x5A827999;
+            }
+            else if (i < 40)
+            {
+                f = b ^ c ^ d;
+                k = 0x6ED9EBA1;
+            }
+            else if (i < 60)
+            {
+                f = (b & c) | (b & d) | (c & d);
+                k = 0x8F1BBCDC;
+            }
+            else
+            {
+                f = b ^ c ^ d;
+                k = 0xCA62C1D6;
+            }
+            temp = rotate(a, 5) + f + e + k + w[i];
+            e = d;
+            d = c;
+            c = rotate(b, 30);
+            b = a;
+            a = temp;
+        }
+
+        h[0] += a;
+        h[1] += b;
+        h[2] += c;
+        h[3] += d;
+        h[4] += e;
+    }
+
+    for (int i = 0; i < 20; i++)
+    {
+        digest[i] = h[i / 4] >> (24 - (i % 4) * 8);
+    }
+}
+
+/*
+    Encode bytes in base64, with padding, ending the text with '\0'
+*/
+static void base64(const unsigned char *data, size_t length, char *text)
+{
+    static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    for (size_t i = 0; i < length; i += 3)
+    {
+        uint32_t group = (uint32_t)data[i] << 16;
+
+        group |= i + 1 < length ? (uint32_t)data[i + 1] << 8 : 0;
+        group |= i + 2 < length ? data[i + 2] : 0;
+        *text++ = digits[(group >> 18) & 63];
+        *text++ = digits[(group >> 12) & 63];
+        *text++ = i + 1 < length ? digits[(group >> 6) & 63] : '=';
+        *text++ = i + 2 < length ? digits[group & 63] : '=';
+    }
+    *text = '\0';
+}
+
+/*
+    Find the value of a header in the request, the names are not case sensitive
+    Returns 1 if found, or 0 otherwise
+*/
+static int findHeader(const char *request, const char *name, char *value, size_t size)
+{
+    size_t nameLength = strlen(name);
+    const char *line = strstr(request, "\r\n");
+
+    while (line != NULL && line[2] != '\r')
+    {
+        line += 2;
+        if (strncasecmp(line, name, nameLength) == 0 && line[nameLength] == ':')
+        {
+            const char *start = line + nameLength + 1;
+            const char *end = strstr(start, "\r\n");
+            size_t length;
+
+            while (*start == ' ')
+            {
+                start++;
+            }
+            length = end != NULL ? (size_t)(end - start) : strlen(start);
+            if (length >= size)
+            {
+                return 0;
+            }
+            memcpy(value, start, length);
+            value[length] = '\0';
+            return 1;
+        }
+        line = strstr(line, "\r\n");
+    }
+
+    return 0;
+}
+
+/*
+    Answer the HTTP upgrade request of a browser, with the key it sent hashed with the GUID of the protocol
+    Returns the length of the response, or 0 if the request is not a valid WebSocket upgrade
+*/
+int wsHandshake(const char *request, char *path, size_t pathSize, char *response, size_t responseSize)
+{
+    char upgrade[32];
+    char key[64];
+    char format[32];
+    unsigned char digest[20];
+    char accept[32];
+    int length;
+
+    snprintf(format, sizeof format, "GET %%%zus HTTP/1.1", pathSize - 1);
+    if (sscanf(request, format, path) != 1)
+    {
+        return 0;
+    }
+    if (!findHeader(request, "Upgrade", upgrade, sizeof upgrade) || strcasecmp(upgrade, "websocket") != 0)
+    {
+        return 0;
+    }
+    if (!findHeader(request, "Sec-WebSocket-Key", key, sizeof key - sizeof WS_GUID))
+    {
+        return 0;
+    }
+
+    strcat(key, WS_GUID);
+    sha1((const unsigned char *)key, strlen(key), digest);
+    base64(digest, sizeof digest, accept);
+
+    length = snprintf(response, responseSize,
+        "HTTP/1.1 101 Switching Protocols\r\n"
+        "Upgrade: websocket\r\n"
+        "Connection: Upgrade\r\n"
+        "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+
+    return length < (int)responseSize ? length : 0;
+}
+
+/*
+    Read the frame at the start of a buffer and unmask its payload in place
+    Returns the bytes of the frame, 0 if it is not complete yet, or -1 if it is not valid
+*/
+long wsDecodeFrame(unsigned char *buffer, size_t size, ws_frame_t *frame)
+{
+    size_t header = 2;
+    size_t length;
+    unsigned char *mask;
+
+    if (size < header)
+    {
+        return 0;
+    }
+    //Browsers must mask their frames, and these are never fragmented
+    if (!(buffer[0] & 0x80) || !(buffer[1] & 0x80))
+    {
+        return -1;
+    }
+
+    length = buffer[1] & 0x7F;
+    if (length == 126)
+    {
+        header += 2;
+        if (size < header)
+        {
+            return 0;
+        }
+        length = (size_t)buffer[2] << 8 | buffer[3];
+    }
+    else if (length == 127)
+    {
+        return -1;
+    }
+    if (length > WS_MAX_PAYLOAD)
+    {
+        return -1;
+    }
+
+    mask = buffer + header;
+    header += 4;
+    if (size < header + length)
+    {
+        return 0;
+    }
+
+    frame->opcode = buffer[0] & 0x0F;
+    frame->payload = buffer + header;
+    frame->length = length;
+    for (size_t i = 0; i < length; i++)
+    {
+        frame->payload[i] ^= mask[i % 4];
+    }
+
+    return header + length;
+}
+
+/*
+    Write a whole frame from the server, not masked, with the shortest length that fits
+    Returns the bytes of the frame
+*/
+size_t wsEncodeFrame(unsigned char *buffer, int opcode, const void *payload, size_t length)
+{
+    size_t header = 2;
+
+    buffer[0] = 0x80 | opcode;
+    if (length < 126)
+    {
+        buffer[1] = length;
+    }
+    else if (length <= 0xFFFF)
+    {
+        buffer[1] = 126;
+        buffer[2] = length >> 8;
+        buffer[3] = length;
+        header = 4;
+    }
+    else
+    {
+        buffer[1] = 127;
+        for (int i = 0; i < 8; i++)
+        {
+            buffer[2 + i] = (uint64_t)length >> ((7 - i) * 8);
+        }
+        header = 10;
+    }
+
+    memcpy(buffer + header, payload, length);
+
+    return header + length;
+}
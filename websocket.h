@@ -0,0 +1,51 @@
+/*
+    Server side of the WebSocket protocol (RFC 6455), for the browser gateway
+    - Only the parts a gateway needs: the HTTP upgrade and whole (unfragmented) frames
+    - Nothing here does input / output, the caller owns the buffers and the sockets
+*/
+
+#ifndef WEBSOCKET_H
+#define WEBSOCKET_H
+
+#include <stddef.h>
+
+// Opcodes of the frames
+#define WS_TEXT 0x1
+#define WS_BINARY 0x2
+#define WS_CLOSE 0x8
+#define WS_PING 0x9
+#define WS_PONG 0xA
+// Longest header of a frame sent by the server (not masked)
+#define WS_MAX_HEADER 10
+// Longest payload accepted from a browser
+#define WS_MAX_PAYLOAD 1024
+
+typedef struct ws_frame_struct
+{
+    int opcode;
+    //Points inside the buffer given to wsDecodeFrame, already unmasked
+    unsigned char *payload;
+    size_t length;
+} ws_frame_t;
+
+/*
+    Answer the HTTP upgrade request of a browser, a string with the whole request
+    Stores the path requested (with the query) in 'path', and the answer to send back in 'response'
+    Returns the length of the response, or 0 if the request is not a valid WebSocket upgrade
+*/
+int wsHandshake(const char *request, char *path, size_t pathSize, char *response, size_t responseSize);
+
+/*
+    Read the frame at the start of 'buffer', which has 'size' bytes, and unmask its payload in place
+    Returns the bytes of the frame, 0 if the frame is not complete yet,
+    or -1 if the frame is not valid (not masked, fragmented or too long)
+*/
+long wsDecodeFrame(unsigned char *buffer, size_t size, ws_frame_t *frame);
+
+/*
+    Write a whole frame to 'buffer', which must have room for the payload and WS_MAX_HEADER bytes
+    Returns the bytes of the frame
+*/
+size_t wsEncodeFrame(unsigned char *buffer, int opcode, const void *payload, size_t length);
+
+#endif  /* NOT WEBSOCKET_H */